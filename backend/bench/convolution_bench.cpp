@@ -0,0 +1,62 @@
+// Partitioned convolution cost per bundled impulse response: IR spectrum
+// build time (first use) vs cached lookup, and CPU per second of one mono
+// stream with the two-stage partitioning vs a single 512-frame partitioning.
+//
+//   g++ -std=c++20 -O2 -march=native convolution_bench.cpp -o convolution_bench
+//   ./convolution_bench [seconds]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "../src/convolution.h"
+
+using clock_type = std::chrono::steady_clock;
+
+static double elapsed_ms(clock_type::time_point t0) {
+    return std::chrono::duration<double, std::milli>(clock_type::now() - t0).count();
+}
+
+int main(int argc, char* argv[]) {
+    const int sample_rate = 44100;
+    const int block = dsp::HEAD_BLOCK;
+    double seconds = argc > 1 ? std::atof(argv[1]) : 20.0;
+    int frames = (int)(seconds * sample_rate);
+
+    std::vector<float> source(frames), out(frames);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    for (auto& s : source) s = noise(rng) * 0.5f;
+
+    std::printf("%-10s %7s %10s %10s %12s %12s\n",
+                "impulse", "IR s", "build ms", "cached ms", "% core", "uniform %");
+    for (auto& room : dsp::room_models()) {
+        auto t0 = clock_type::now();
+        auto spectra = dsp::bundled_ir_spectra(room.name, sample_rate);
+        double build = elapsed_ms(t0);
+        t0 = clock_type::now();
+        dsp::bundled_ir_spectra(room.name, sample_rate);
+        double cached = elapsed_ms(t0);
+
+        dsp::Convolver conv;
+        conv.init(spectra->left);
+        t0 = clock_type::now();
+        for (int at = 0; at < frames; at += block)
+            conv.process(source.data() + at, out.data() + at, std::min(block, frames - at));
+        double two_stage = elapsed_ms(t0) / seconds / 10.0;
+
+        // Same IR as one uniform 512-frame partitioning
+        auto ir = dsp::generate_impulse(room, sample_rate);
+        auto uniform = dsp::make_ir_segment(ir.left.data(), (int)ir.left.size(), block);
+        dsp::HeadConvolver single;
+        single.init(&uniform);
+        t0 = clock_type::now();
+        for (int at = 0; at < frames; at += block)
+            single.process(source.data() + at, out.data() + at, std::min(block, frames - at));
+        double uniform_pct = elapsed_ms(t0) / seconds / 10.0;
+
+        std::printf("%-10s %7.2f %10.2f %10.4f %11.2f%% %11.2f%%\n", room.name,
+                    (double)spectra->length / sample_rate, build, cached, two_stage, uniform_pct);
+    }
+    return 0;
+}
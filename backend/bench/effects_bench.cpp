@@ -0,0 +1,45 @@
+// CPU cost of each server-side effect, per second of stereo 44.1 kHz audio.
+//
+//   g++ -std=c++20 -O2 -march=native effects_bench.cpp -o effects_bench
+//   ./effects_bench [seconds]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "../src/effects.h"
+
+int main(int argc, char* argv[]) {
+    const int sample_rate = 44100;
+    const int block = 512;
+    double seconds = argc > 1 ? std::atof(argv[1]) : 20.0;
+    int frames = (int)(seconds * sample_rate);
+
+    // Decaying noise bursts every quarter second: exercises tails and gating
+    std::vector<float> source(frames * 2);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    for (int i = 0; i < frames; ++i) {
+        float env = std::exp(-(i % (sample_rate / 4)) / 2000.0f);
+        source[i * 2]     = noise(rng) * env * 0.5f;
+        source[i * 2 + 1] = noise(rng) * env * 0.5f;
+    }
+
+    std::printf("%-18s %12s %10s\n", "effect", "ms / audio s", "% of core");
+    std::vector<float> buf(frames * 2);
+    for (auto& [type, params] : dsp::effect_definitions()) {
+        auto spec = dsp::effect_spec_from_json({{"type", type}});
+        auto fx = dsp::make_effect(spec, sample_rate);
+        buf = source;
+
+        dsp::DenormalGuard denormal_guard;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int at = 0; at < frames; at += block)
+            fx->process(buf.data() + at * 2, std::min(block, frames - at));
+        auto t1 = std::chrono::steady_clock::now();
+
+        double ms = std::chrono::duration<double, std::milli>(t1 - t0).count() / seconds;
+        std::printf("%-18s %12.3f %9.2f%%\n", type.c_str(), ms, ms / 10.0);
+    }
+    return 0;
+}
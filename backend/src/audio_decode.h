@@ -0,0 +1,434 @@
+#pragma once
+
+#define MINIMP3_IMPLEMENTATION
+#define MINIMP3_FLOAT_OUTPUT
+#include "../deps/minimp3.h"
+#include "../deps/minimp3_ex.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "flac_decode.h"
+#include "mapped_file.h"
+
+namespace renderer {
+
+// ============================================================
+//  PCM sample representation
+// ============================================================
+
+struct PcmSample {
+    std::vector<float> data;   // interleaved stereo
+    int sample_rate = 44100;
+    int channels    = 2;
+    int num_frames  = 0;
+};
+
+// Frames [first, first + count) of a file; count < 0 runs to the end
+struct FrameRange {
+    int64_t first = 0;
+    int64_t count = -1;
+};
+
+// What a decoder wrote into the caller's memory
+struct DecodedRange {
+    int64_t frames      = 0;
+    int     sample_rate = 0;
+};
+
+// ============================================================
+//  Decode MP3 to float PCM using minimp3
+// ============================================================
+
+// Streaming MP3 reader. minimp3 maps the file read-only and decodes one
+// frame at a time into its own float buffer, which read() widens to
+// stereo straight into the caller's memory, so a long file can be
+// consumed in bounded memory or decoded once into a buffer of its final
+// size. The duration comes from the scan minimp3 does on open.
+class Mp3Reader {
+public:
+    explicit Mp3Reader(const std::string& path) : dec_(std::make_unique<mp3dec_ex_t>()) {
+        if (mp3dec_ex_open(dec_.get(), path.c_str(), MP3D_SEEK_TO_BYTE) || dec_->info.channels < 1) {
+            mp3dec_ex_close(dec_.get());
+            throw std::runtime_error("Failed to decode MP3: " + path);
+        }
+    }
+
+    ~Mp3Reader() { mp3dec_ex_close(dec_.get()); }
+
+    Mp3Reader(const Mp3Reader&) = delete;
+    Mp3Reader& operator=(const Mp3Reader&) = delete;
+
+    int sample_rate() const { return dec_->info.hz; }
+    int64_t frames() const { return (int64_t)(dec_->samples / dec_->info.channels); }
+
+    // Decodes up to max_frames frames into interleaved stereo `lr`
+    // (mono is duplicated, channels past the second dropped); returns
+    // the frames written, 0 at the end of the stream
+    int read(float* lr, int max_frames) {
+        const int channels = dec_->info.channels;
+        int done = 0;
+        while (done < max_frames) {
+            mp3d_sample_t* pcm = nullptr;
+            mp3dec_frame_info_t frame;
+            size_t n = mp3dec_ex_read_frame(dec_.get(), &pcm, &frame,
+                                            (size_t)(max_frames - done) * channels);
+            if (n == 0) break;
+            const int count = (int)(n / channels);
+            float* dst = lr + (size_t)done * 2;
+            if (channels == 1) {
+                for (int i = 0; i < count; ++i) dst[i * 2] = dst[i * 2 + 1] = pcm[i];
+            } else {
+                for (int i = 0; i < count; ++i) {
+                    dst[i * 2]     = pcm[i * channels];
+                    dst[i * 2 + 1] = pcm[i * channels + 1];
+                }
+            }
+            done += count;
+        }
+        if (done == 0 && dec_->last_error)
+            throw std::runtime_error("MP3 decode error " + std::to_string(dec_->last_error));
+        return done;
+    }
+
+private:
+    std::unique_ptr<mp3dec_ex_t> dec_;   // large (decoder state and a frame of samples)
+};
+
+inline PcmSample decode_mp3_to_pcm(const std::string& path) {
+    Mp3Reader reader(path);
+    PcmSample pcm;
+    pcm.sample_rate = reader.sample_rate();
+    pcm.channels = 2;
+    pcm.data.resize((size_t)reader.frames() * 2);
+
+    // Straight into place; a truncated file can end short of the scan's count
+    int64_t at = 0;
+    while (at < reader.frames()) {
+        int n = reader.read(pcm.data.data() + at * 2, (int)std::min<int64_t>(1 << 20, reader.frames() - at));
+        if (n == 0) break;
+        at += n;
+    }
+    pcm.data.resize((size_t)at * 2);
+    pcm.num_frames = (int)at;
+    return pcm;
+}
+
+// Frames [range.first, range.first + range.count) of an MP3 (count >= 0)
+// decoded into interleaved stereo `lr`. Frames ahead of the range are
+// decoded and dropped rather than seeked past, so the range comes out as
+// it does in a whole-file decode.
+inline DecodedRange decode_mp3_into(const std::string& path, FrameRange range, float* lr) {
+    constexpr int SKIP_FRAMES = 4096;
+    Mp3Reader reader(path);
+    std::vector<float> skipped;
+    for (int64_t left = range.first; left > 0;) {
+        const int n = (int)std::min<int64_t>(left, SKIP_FRAMES);
+        skipped.resize((size_t)n * 2);
+        const int got = reader.read(skipped.data(), n);
+        if (got == 0) return {0, reader.sample_rate()};
+        left -= got;
+    }
+    int64_t at = 0;
+    while (at < range.count) {
+        int n = reader.read(lr + at * 2, (int)std::min<int64_t>(1 << 20, range.count - at));
+        if (n == 0) break;
+        at += n;
+    }
+    return {at, reader.sample_rate()};
+}
+
+// ============================================================
+//  Uncompressed PCM in a container (WAV, AIFF)
+// ============================================================
+
+// Interleaved integer or float samples as they sit in the file
+struct PcmLayout {
+    const uint8_t* data = nullptr;
+    int64_t frames      = 0;
+    int     channels    = 0;
+    int     bits        = 0;   // 8, 16, 24 or 32
+    bool    is_float    = false;
+    bool    big_endian  = false;
+    bool    unsigned8   = false;   // WAV's 8-bit samples are offset binary
+    int     sample_rate = 0;
+};
+
+inline float pcm_sample(const PcmLayout& in, const uint8_t* p) {
+    const int width = in.bits / 8;
+    uint32_t v = 0;
+    for (int b = 0; b < width; ++b)
+        v |= (uint32_t)p[in.big_endian ? b : width - 1 - b] << (8 * (3 - b));
+    if (in.is_float) {
+        float f;
+        std::memcpy(&f, &v, sizeof(f));
+        return f;
+    }
+    if (in.unsigned8) v ^= 0x80000000u;
+    return (int32_t)v / 2147483648.0f;
+}
+
+// `range` cut to the frames the layout has: first frame and count
+inline std::pair<int64_t, int64_t> layout_frames(const PcmLayout& in, FrameRange range) {
+    const int64_t first = std::clamp<int64_t>(range.first, 0, in.frames);
+    const int64_t count = range.count < 0 ? in.frames - first
+                                          : std::min(range.count, in.frames - first);
+    return {first, count};
+}
+
+// Widens `count` frames from `first` of the layout into stereo `lr` (mono
+// is duplicated, channels past the second dropped). Little-endian float
+// stereo is the bank's own layout and is copied as is.
+inline void widen_layout(const PcmLayout& in, int64_t first, int64_t count, float* lr) {
+    const size_t width = in.bits / 8, stride = width * in.channels;
+    const uint8_t* src = in.data + first * stride;
+    if (in.is_float && in.channels == 2 && !in.big_endian && std::endian::native == std::endian::little) {
+        std::memcpy(lr, src, (size_t)count * stride);
+        return;
+    }
+    for (int64_t i = 0; i < count; ++i, src += stride) {
+        lr[i * 2]     = pcm_sample(in, src);
+        lr[i * 2 + 1] = in.channels > 1 ? pcm_sample(in, src + width) : lr[i * 2];
+    }
+}
+
+inline PcmSample pcm_from_layout(const PcmLayout& in, FrameRange range) {
+    const auto [first, count] = layout_frames(in, range);
+    PcmSample pcm;
+    pcm.sample_rate = in.sample_rate;
+    pcm.num_frames = (int)count;
+    pcm.data.resize((size_t)count * 2);
+    widen_layout(in, first, count, pcm.data.data());
+    return pcm;
+}
+
+// `range` (count >= 0) of the layout straight into the caller's `lr`
+inline DecodedRange layout_into(const PcmLayout& in, FrameRange range, float* lr) {
+    const auto [first, count] = layout_frames(in, range);
+    widen_layout(in, first, count, lr);
+    return {count, in.sample_rate};
+}
+
+inline void check_layout(PcmLayout& in, size_t data_bytes, const std::string& path, const char* kind) {
+    const bool supported = in.is_float ? in.bits == 32
+                                       : (in.bits == 8 || in.bits == 16 || in.bits == 24 || in.bits == 32);
+    if (!in.data || in.channels < 1 || in.sample_rate <= 0 || !supported)
+        throw std::runtime_error(std::string("Unsupported ") + kind + " format: " + path);
+    in.frames = std::min<int64_t>(in.frames, (int64_t)(data_bytes / (in.bits / 8 * in.channels)));
+}
+
+// ============================================================
+//  WAV (PCM 8/16/24/32-bit or 32-bit float)
+// ============================================================
+
+inline PcmLayout parse_wav(const uint8_t* bytes, size_t size, const std::string& path) {
+    auto le16 = [&](size_t at) { return (uint32_t)bytes[at] | (uint32_t)bytes[at + 1] << 8; };
+    auto le32 = [&](size_t at) { return le16(at) | le16(at + 2) << 16; };
+    if (size < 12 || std::memcmp(bytes, "RIFF", 4) != 0 || std::memcmp(bytes + 8, "WAVE", 4) != 0) {
+        throw std::runtime_error("Not a WAV file: " + path);
+    }
+
+    PcmLayout in;
+    int format = 0;
+    size_t data_bytes = 0;
+    for (size_t at = 12; at + 8 <= size;) {
+        const uint32_t chunk = le32(at + 4);
+        if (std::memcmp(bytes + at, "fmt ", 4) == 0 && chunk >= 16 && at + 24 <= size) {
+            format         = (int)le16(at + 8);
+            in.channels    = (int)le16(at + 10);
+            in.sample_rate = (int)le32(at + 12);
+            in.bits        = (int)le16(at + 22);
+            if (format == 0xFFFE && chunk >= 40 && at + 34 <= size) format = (int)le16(at + 32);   // extensible
+        } else if (std::memcmp(bytes + at, "data", 4) == 0) {
+            in.data = bytes + at + 8;
+            data_bytes = std::min<size_t>(chunk, size - at - 8);
+        }
+        at += 8 + (size_t)chunk + (chunk & 1);
+    }
+    if (format != 1 && format != 3) throw std::runtime_error("Unsupported WAV format: " + path);
+    in.is_float = format == 3;
+    in.unsigned8 = in.bits == 8;
+    in.frames = INT64_MAX;
+    check_layout(in, data_bytes, path, "WAV");
+    return in;
+}
+
+inline PcmSample decode_wav_to_pcm(const std::string& path, FrameRange range = {}) {
+    MappedInput file(path);
+    return pcm_from_layout(parse_wav(file.data(), file.size(), path), range);
+}
+
+inline DecodedRange decode_wav_into(const std::string& path, FrameRange range, float* lr) {
+    MappedInput file(path);
+    return layout_into(parse_wav(file.data(), file.size(), path), range, lr);
+}
+
+// ============================================================
+//  AIFF / AIFF-C (PCM 8/16/24/32-bit, either byte order, 32-bit float)
+// ============================================================
+
+constexpr double MAX_AIFF_SAMPLE_RATE = 768000.0;
+
+inline PcmLayout parse_aiff(const uint8_t* bytes, size_t size, const std::string& path) {
+    auto be16 = [&](size_t at) { return (uint32_t)bytes[at] << 8 | (uint32_t)bytes[at + 1]; };
+    auto be32 = [&](size_t at) { return be16(at) << 16 | be16(at + 2); };
+    if (size < 12 || std::memcmp(bytes, "FORM", 4) != 0 ||
+        (std::memcmp(bytes + 8, "AIFF", 4) != 0 && std::memcmp(bytes + 8, "AIFC", 4) != 0)) {
+        throw std::runtime_error("Not an AIFF file: " + path);
+    }
+
+    PcmLayout in;
+    in.big_endian = true;
+    size_t data_bytes = 0;
+    bool common = false;
+    for (size_t at = 12; at + 8 <= size;) {
+        const uint32_t chunk = be32(at + 4);
+        if (std::memcmp(bytes + at, "COMM", 4) == 0 && chunk >= 18 && at + 26 <= size) {
+            in.channels = (int)be16(at + 8);
+            in.frames   = be32(at + 10);
+            in.bits     = ((int)be16(at + 14) + 7) / 8 * 8;
+            // 80-bit extended sample rate: sign and exponent, then a 64-bit
+            // mantissa with an explicit integer bit. Anything outside
+            // 1 Hz - 768 kHz is refused before it's converted to int.
+            const bool negative = be16(at + 16) & 0x8000;
+            const int exponent = (int)(be16(at + 16) & 0x7FFF) - 16383 - 63;
+            const uint64_t mantissa = (uint64_t)be32(at + 18) << 32 | be32(at + 22);
+            const double rate = !negative && exponent >= -128 && exponent <= 32
+                                    ? std::ldexp((double)mantissa, exponent) : 0.0;
+            if (!(rate >= 1.0 && rate <= MAX_AIFF_SAMPLE_RATE))
+                throw std::runtime_error("Unsupported AIFF sample rate: " + path);
+            in.sample_rate = (int)rate;
+            if (chunk >= 22 && at + 30 <= size) {
+                const uint8_t* type = bytes + at + 26;
+                if (std::memcmp(type, "sowt", 4) == 0) in.big_endian = false;
+                else if (std::memcmp(type, "fl32", 4) == 0 || std::memcmp(type, "FL32", 4) == 0) in.is_float = true;
+                else if (std::memcmp(type, "NONE", 4) != 0 && std::memcmp(type, "twos", 4) != 0)
+                    throw std::runtime_error("Compressed AIFF-C is not supported: " + path);
+            }
+            common = true;
+        } else if (std::memcmp(bytes + at, "SSND", 4) == 0 && at + 16 <= size) {
+            const size_t offset = be32(at + 8);
+            const size_t start = at + 16 + offset;
+            if (start <= size) {
+                in.data = bytes + start;
+                data_bytes = std::min<size_t>(chunk >= 8 + offset ? chunk - 8 - offset : 0, size - start);
+            }
+        }
+        at += 8 + (size_t)chunk + (chunk & 1);
+    }
+    if (!common) throw std::runtime_error("AIFF file has no COMM chunk: " + path);
+    check_layout(in, data_bytes, path, "AIFF");
+    return in;
+}
+
+inline PcmSample decode_aiff_to_pcm(const std::string& path, FrameRange range = {}) {
+    MappedInput file(path);
+    return pcm_from_layout(parse_aiff(file.data(), file.size(), path), range);
+}
+
+inline DecodedRange decode_aiff_into(const std::string& path, FrameRange range, float* lr) {
+    MappedInput file(path);
+    return layout_into(parse_aiff(file.data(), file.size(), path), range, lr);
+}
+
+// ============================================================
+//  FLAC
+// ============================================================
+
+inline PcmSample decode_flac_to_pcm(const std::string& path) {
+    MappedInput file(path);
+    PcmSample pcm;
+    auto info = flac::decode(file.data(), file.size(), pcm.data);
+    pcm.sample_rate = info.sample_rate;
+    pcm.num_frames = (int)(pcm.data.size() / 2);
+    return pcm;
+}
+
+// ============================================================
+//  Decoder registry
+// ============================================================
+
+// A decoder for one file format. The manifest records each library
+// layer's format, so loading goes straight to its decoder; decoders with
+// random access read just the frames the layer plays. Decoders with
+// decode_into write a range straight into the caller's memory (the
+// bank's arena), at most range.count frames.
+struct AudioDecoder {
+    std::string              format;       // as recorded in the manifest: "mp3", "wav", ...
+    std::vector<std::string> extensions;   // lower case, with the dot
+    bool                     random_access = false;
+    std::function<PcmSample(const std::string& path, FrameRange range)> decode;
+    std::function<DecodedRange(const std::string& path, FrameRange range, float* lr)> decode_into;   // optional
+};
+
+// Registered decoders, the built-in ones first. Register at startup,
+// before any decoding starts.
+inline std::vector<AudioDecoder>& audio_decoders() {
+    static std::vector<AudioDecoder> decoders = {
+        {"mp3",  {".mp3"}, false, [](const std::string& path, FrameRange) { return decode_mp3_to_pcm(path); },
+         decode_mp3_into},
+        {"wav",  {".wav", ".wave"}, true, decode_wav_to_pcm, decode_wav_into},
+        {"aiff", {".aif", ".aiff", ".aifc"}, true, decode_aiff_to_pcm, decode_aiff_into},
+        {"flac", {".flac"}, false, [](const std::string& path, FrameRange) { return decode_flac_to_pcm(path); }, {}},
+    };
+    return decoders;
+}
+
+// Adds a decoder, replacing any registered for the same format
+inline void register_decoder(AudioDecoder decoder) {
+    auto& decoders = audio_decoders();
+    std::erase_if(decoders, [&](const AudioDecoder& d) { return d.format == decoder.format; });
+    decoders.push_back(std::move(decoder));
+}
+
+// Format of a file by its extension; empty if no decoder takes it
+inline std::string audio_format_for(const std::string& path) {
+    auto dot = path.find_last_of("./\\");
+    if (dot == std::string::npos || path[dot] != '.') return {};
+    std::string ext = path.substr(dot);
+    for (auto& ch : ext) ch = (char)std::tolower((unsigned char)ch);
+    for (auto& d : audio_decoders())
+        if (std::find(d.extensions.begin(), d.extensions.end(), ext) != d.extensions.end()) return d.format;
+    return {};
+}
+
+inline const AudioDecoder* find_decoder(const std::string& format) {
+    for (auto& d : audio_decoders())
+        if (d.format == format) return &d;
+    return nullptr;
+}
+
+// Decode a library file with the decoder for `format`, or for its
+// extension when no format is given (files from before formats were
+// recorded are MP3). Decoders without random access decode the whole
+// file and the range is cut from it.
+inline PcmSample decode_audio_file(const std::string& path, const std::string& format = {},
+                                   FrameRange range = {}) {
+    const std::string f = format.empty() ? audio_format_for(path) : format;
+    const AudioDecoder* decoder = find_decoder(f.empty() ? "mp3" : f);
+    if (!decoder) throw std::runtime_error("No decoder for format '" + f + "': " + path);
+    if (decoder->random_access) return decoder->decode(path, range);
+
+    auto pcm = decoder->decode(path, {});
+    if (range.first > 0 || range.count >= 0) {
+        const int first = (int)std::clamp<int64_t>(range.first, 0, pcm.num_frames);
+        const int count = range.count < 0 ? pcm.num_frames - first
+                                          : (int)std::min<int64_t>(range.count, pcm.num_frames - first);
+        if (first > 0) std::copy(pcm.data.begin() + first * 2, pcm.data.begin() + (first + count) * 2, pcm.data.begin());
+        pcm.data.resize((size_t)count * 2);
+        pcm.num_frames = count;
+    }
+    return pcm;
+}
+
+} // namespace renderer
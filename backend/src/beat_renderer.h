@@ -1,24 +1,36 @@
 #pragma once
 
-#define MINIMP3_IMPLEMENTATION
-#include "../deps/minimp3.h"
-#include "../deps/minimp3_ex.h"
-
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <system_error>
 #include <vector>
 
 #include "../deps/json.hpp"
+#include "buffer_pool.h"
+#include "cancellation.h"
+#include "effects.h"
+#include "mapped_file.h"
+#include "melody.h"
 #include "midi_writer.h"
+#include "mixer.h"
 #include "models.h"
+#include "render_pipeline.h"
+#include "sample_bank.h"
 #include "sample_library.h"
+#include "stretch.h"
+#include "synth.h"
 #include "utils.h"
 
 namespace fs = std::filesystem;
@@ -27,234 +39,1174 @@ using json = nlohmann::json;
 namespace renderer {
 
 // ============================================================
-//  PCM sample representation
+//  WAV writer helpers
 // ============================================================
 
-struct PcmSample {
-    std::vector<float> data;   // interleaved stereo
-    int sample_rate = 44100;
-    int channels    = 2;
-    int num_frames  = 0;
+namespace detail {
+
+inline void store_le16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+inline void store_le32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+inline void store_le64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+} // namespace detail
+
+// RIFF sizes are 32-bit; past 4 GB the file is written as RF64 (EBU Tech
+// 3306), whose ds64 chunk carries the 64-bit sizes and leaves 0xFFFFFFFF
+// in the RIFF and data size fields
+inline bool wav16_needs_rf64(int64_t frames) {
+    return 36 + (uint64_t)frames * 4 > 0xFFFFFFFFull;
+}
+
+inline size_t wav16_header_bytes(int64_t frames) { return wav16_needs_rf64(frames) ? 80 : 44; }
+
+namespace detail {
+
+// Header for 16-bit PCM stereo, wav16_header_bytes(frames) long
+inline void wav16_header(uint8_t* h, int64_t frames, int sample_rate) {
+    const int channels = 2;
+    const uint64_t data_size = (uint64_t)frames * channels * 2; // 16-bit = 2 bytes
+    const bool rf64 = wav16_needs_rf64(frames);
+
+    std::memcpy(h, rf64 ? "RF64" : "RIFF", 4);
+    store_le32(h + 4, rf64 ? 0xFFFFFFFFu : (uint32_t)(36 + data_size));
+    std::memcpy(h + 8, "WAVE", 4);
+    h += 12;
+
+    if (rf64) {
+        std::memcpy(h, "ds64", 4);
+        store_le32(h + 4, 28);
+        store_le64(h + 8, 72 + data_size);                 // RIFF size
+        store_le64(h + 16, data_size);
+        store_le64(h + 24, (uint64_t)frames);              // sample count
+        store_le32(h + 32, 0);                             // no extra table entries
+        h += 36;
+    }
+
+    std::memcpy(h, "fmt ", 4);
+    store_le32(h + 4, 16);                             // chunk size
+    store_le16(h + 8, 1);                              // PCM format
+    store_le16(h + 10, channels);                      // channels
+    store_le32(h + 12, sample_rate);                   // sample rate
+    store_le32(h + 16, sample_rate * channels * 2);    // byte rate
+    store_le16(h + 20, channels * 2);                  // block align
+    store_le16(h + 22, 16);                            // bits per sample
+
+    std::memcpy(h + 24, "data", 4);
+    store_le32(h + 28, rf64 ? 0xFFFFFFFFu : (uint32_t)data_size);
+}
+
+// Float -> int16, optionally with TPDF dither (+-1 LSB triangular noise,
+// fixed seed so renders stay reproducible)
+struct Pcm16Quantizer {
+    bool     dither = false;
+    uint32_t rng = 0x9E3779B9u;
+
+    float uniform() {
+        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+        return (float)rng * (1.0f / 4294967296.0f);
+    }
+
+    int16_t operator()(float x) {
+        if (dither) {
+            float v = x * 32767.0f + (uniform() - uniform());
+            return (int16_t)std::clamp(std::lround(v), -32768L, 32767L);
+        }
+        return (int16_t)(std::clamp(x, -1.0f, 1.0f) * 32767.0f);
+    }
 };
 
+} // namespace detail
+
 // ============================================================
-//  Decode MP3 to float PCM using minimp3
+//  WAV output
 // ============================================================
 
-inline PcmSample decode_mp3_to_pcm(const std::string& path) {
-    mp3dec_t mp3d;
-    mp3dec_file_info_t info;
-    mp3dec_init(&mp3d);
-
-    if (mp3dec_load(&mp3d, path.c_str(), &info, nullptr, nullptr)) {
-        throw std::runtime_error("Failed to decode MP3: " + path);
-    }
-
-    PcmSample pcm;
-    pcm.sample_rate = info.hz;
-    pcm.channels = info.channels;
-    pcm.num_frames = (int)info.samples / info.channels;
-
-    // Convert int16 to float and ensure stereo
-    if (info.channels == 1) {
-        // Mono -> stereo
-        pcm.channels = 2;
-        pcm.data.resize(pcm.num_frames * 2);
-        for (int i = 0; i < pcm.num_frames; ++i) {
-            float s = info.buffer[i] / 32768.0f;
-            pcm.data[i * 2]     = s;
-            pcm.data[i * 2 + 1] = s;
+// Encode and write stages of a 16-bit WAV (RF64 past 4 GB): append()
+// quantizes float frames into chunks on the calling thread while a writer
+// thread puts the chunks before them on disk. finish() must run for the
+// file to be complete.
+class Wav16Writer {
+public:
+    static constexpr int64_t CHUNK_FRAMES = 1 << 15;
+    static constexpr int     CHUNKS = 4;
+
+    Wav16Writer(const fs::path& wav_path, int64_t frames, int sample_rate, bool dither,
+                StageCounters* encode = nullptr, StageCounters* write = nullptr)
+        : file_(wav_path.string(), std::ios::binary), quantize_{dither},
+          encode_(encode ? *encode : own_encode_), write_(write ? *write : own_write_) {
+        if (!file_) throw std::runtime_error("Cannot create WAV file");
+        uint8_t header[80];
+        detail::wav16_header(header, frames, sample_rate);
+        file_.write(reinterpret_cast<const char*>(header), (std::streamsize)wav16_header_bytes(frames));
+
+        for (int c = 0; c < CHUNKS; ++c) {
+            chunks_[c].resize((size_t)CHUNK_FRAMES * 2 * sizeof(int16_t));
+            free_.push(c);
         }
-    } else {
-        // Already stereo (or more, just take first 2 channels)
-        pcm.data.resize(pcm.num_frames * 2);
-        for (int i = 0; i < pcm.num_frames; ++i) {
-            pcm.data[i * 2]     = info.buffer[i * info.channels]     / 32768.0f;
-            pcm.data[i * 2 + 1] = info.buffer[i * info.channels + 1] / 32768.0f;
+        writer_ = std::make_unique<StageThread>([this] { write_chunks(); });
+    }
+
+    ~Wav16Writer() {
+        if (writer_) filled_.close();   // unfinished: let the writer drain and exit
+    }
+
+    Wav16Writer(const Wav16Writer&) = delete;
+    Wav16Writer& operator=(const Wav16Writer&) = delete;
+
+    // Interleaved stereo, each sample scaled by `gain` before quantizing
+    void append(const float* lr, int64_t frames, float gain = 1.0f) {
+        for (int64_t i = 0, total = frames * 2; i < total;) {
+            if (current_ < 0) next_chunk();
+            StageTimer busy(encode_.busy_seconds);
+            uint8_t* out = chunks_[current_].data();
+            const int64_t n = std::min<int64_t>(total - i, CHUNK_FRAMES * 2 - samples_);
+            for (int64_t k = 0; k < n; ++k) {
+                float x = lr[i + k];
+                if (gain != 1.0f) x *= gain;
+                detail::store_le16(out + (samples_ + k) * 2, (uint16_t)quantize_(x));
+            }
+            samples_ += n;
+            i += n;
+            if (samples_ == CHUNK_FRAMES * 2) hand_over();
+        }
+    }
+
+    void finish() {
+        if (current_ >= 0 && samples_ > 0) hand_over();
+        filled_.close();
+        auto writer = std::move(writer_);
+        writer->join();
+        file_.close();
+        if (!file_) throw std::runtime_error("Cannot write WAV file");
+    }
+
+private:
+    void next_chunk() {
+        bool got;
+        {
+            StageTimer stall(encode_.stall_seconds);
+            got = free_.pop(current_);
+        }
+        if (!got) {   // the writer failed
+            auto writer = std::move(writer_);
+            writer->join();
+            throw std::runtime_error("Cannot write WAV file");
         }
+        samples_ = 0;
     }
 
-    free(info.buffer);
-    return pcm;
+    void hand_over() {
+        encode_.items++;
+        StageTimer stall(encode_.stall_seconds);
+        filled_.push({current_, (size_t)samples_ * 2});
+        current_ = -1;
+    }
+
+    // Writer thread
+    void write_chunks() {
+        std::pair<int, size_t> chunk;
+        for (;;) {
+            bool got;
+            {
+                StageTimer stall(write_.stall_seconds);
+                got = filled_.pop(chunk);
+            }
+            if (!got) break;
+            StageTimer busy(write_.busy_seconds);
+            file_.write(reinterpret_cast<const char*>(chunks_[chunk.first].data()), (std::streamsize)chunk.second);
+            if (!file_) {
+                filled_.stop();
+                free_.close();
+                throw std::runtime_error("Cannot write WAV file");
+            }
+            write_.items++;
+            free_.push(chunk.first);
+        }
+        free_.close();
+    }
+
+    std::ofstream                            file_;
+    detail::Pcm16Quantizer                   quantize_;
+    StageCounters                            own_encode_{"encode"}, own_write_{"write"};
+    StageCounters&                           encode_;
+    StageCounters&                           write_;
+    std::array<std::vector<uint8_t>, CHUNKS> chunks_;
+    SpscQueue<int>                           free_{CHUNKS};     // writer -> encoder
+    SpscQueue<std::pair<int, size_t>>        filled_{CHUNKS};   // encoder -> writer: chunk, bytes
+    int                                      current_ = -1;     // chunk being encoded
+    int64_t                                  samples_ = 0;      // ... and the samples in it
+    std::unique_ptr<StageThread>             writer_;           // last: joined first
+};
+
+// Interleaved stereo float -> 16-bit PCM WAV (RF64 past 4 GB)
+inline void write_wav16(const fs::path& wav_path, const float* buffer,
+                        int64_t actual_frames, int sample_rate, bool dither = false) {
+    Wav16Writer out(wav_path, actual_frames, sample_rate, dither);
+    out.append(buffer, actual_frames);
+    out.finish();
 }
 
 // ============================================================
-//  Sample Bank: loads all samples into memory
+//  True peak (4x oversampled, after ITU-R BS.1770 annex 2)
 // ============================================================
 
-class SampleBank {
-public:
-    bool loaded = false;
-
-    bool load(const fs::path& output_dir) {
-        auto manifest = samples::load_manifest(output_dir);
-        auto dir = samples::library_dir(output_dir);
-
-        bank_.clear();
-        for (auto& s : samples::get_all_percussion_samples()) {
-            if (!manifest.contains(s.name)) continue;
-            auto file = dir / manifest[s.name].get<std::string>();
-            if (!fs::exists(file)) continue;
-            try {
-                bank_[s.midi_note] = decode_mp3_to_pcm(file.string());
-            } catch (...) {
-                // Skip samples that fail to decode
+// Frames either side of a frame that its true-peak value depends on
+constexpr int TRUE_PEAK_RADIUS = 6;
+
+// Highest inter-sample peak of interleaved stereo over frames
+// [begin, end): each gap between samples is reconstructed at three
+// intermediate phases with a 12-tap windowed-sinc interpolator reading
+// neighbours from the whole signal
+inline float true_peak(const float* lr, int64_t frames, int64_t begin, int64_t end) {
+    constexpr int OVERSAMPLE = 4, TAPS = 2 * TRUE_PEAK_RADIUS;
+    static const auto kernel = [] {
+        std::array<std::array<float, TAPS>, OVERSAMPLE> k{};
+        for (int p = 0; p < OVERSAMPLE; ++p)
+            for (int t = 0; t < TAPS; ++t) {
+                double x = t - (TAPS / 2 - 1) - (double)p / OVERSAMPLE;
+                double s = x == 0.0 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+                double w = 0.5 + 0.5 * std::cos(M_PI * x / (TAPS / 2));
+                k[p][t] = (float)(s * w);
             }
+        return k;
+    }();
+
+    float peak = 0.0f;
+    for (int64_t f = begin; f < end; ++f) {
+        peak = std::max({peak, std::abs(lr[f * 2]), std::abs(lr[f * 2 + 1])});
+        for (int p = 1; p < OVERSAMPLE; ++p) {
+            float l = 0.0f, r = 0.0f;
+            for (int t = 0; t < TAPS; ++t) {
+                int64_t i = f - (TAPS / 2 - 1) + t;
+                if (i < 0 || i >= frames) continue;
+                l += lr[i * 2] * kernel[p][t];
+                r += lr[i * 2 + 1] * kernel[p][t];
+            }
+            peak = std::max({peak, std::abs(l), std::abs(r)});
         }
-        loaded = !bank_.empty();
-        return loaded;
     }
+    return peak;
+}
 
-    const PcmSample* get(uint8_t midi_note) const {
-        auto it = bank_.find(midi_note);
-        return it != bank_.end() ? &it->second : nullptr;
-    }
+inline float true_peak(const float* lr, int64_t frames) { return true_peak(lr, frames, 0, frames); }
+
+// Peak stage: scans a render for its normalization peak on a thread of its
+// own while the mix is still filling it. The mix posts how far it has got;
+// frames a true-peak radius behind that are final and get scanned, so when
+// mixing ends only the tail is left. `scanned` runs on the peak thread
+// after each range it is done with.
+class PeakStage {
+public:
+    static constexpr int64_t SCAN_FRAMES = 1 << 14;   // least worth waking up for
+
+    PeakStage(const float* lr, int64_t frames, bool oversampled, StageCounters& counters,
+              std::function<void(int64_t, int64_t)> scanned = {})
+        : PeakStage(lr, frames, 0, frames, oversampled, counters, std::move(scanned)) {}
 
-    size_t size() const { return bank_.size(); }
+    // Only frames [begin, end) of the `frames` long signal; the rest are
+    // true-peak neighbours
+    PeakStage(const float* lr, int64_t frames, int64_t begin, int64_t end, bool oversampled,
+              StageCounters& counters, std::function<void(int64_t, int64_t)> scanned = {})
+        : lr_(lr), frames_(frames), begin_(begin), end_(end), oversampled_(oversampled),
+          counters_(counters), scanned_(std::move(scanned)), thread_([this] { run(); }) {}
+
+    ~PeakStage() { posted_.close(); }
+
+    PeakStage(const PeakStage&) = delete;
+    PeakStage& operator=(const PeakStage&) = delete;
+
+    // Mix side: frames [0, through) are final
+    void mixed(int64_t through) { posted_.push(through); }
+
+    // Once frames [0, frames) are posted: the peak of the scanned range
+    float finish() {
+        posted_.close();
+        thread_.join();
+        return peak_;
+    }
 
 private:
-    std::map<uint8_t, PcmSample> bank_;
+    void run() {
+        dsp::DenormalGuard denormal_guard;   // same arithmetic as the mixing thread
+        int64_t scanned = begin_, through = 0;
+        for (;;) {
+            bool got;
+            {
+                StageTimer stall(counters_.stall_seconds);
+                got = posted_.pop(through);
+            }
+            if (!got) break;
+            while (posted_.try_pop(through)) {}
+            const int64_t ready = std::min(end_, through >= frames_ ? frames_ : through - TRUE_PEAK_RADIUS);
+            if (ready <= scanned || (ready - scanned < SCAN_FRAMES && ready < end_)) continue;
+
+            StageTimer busy(counters_.busy_seconds);
+            if (oversampled_) {
+                peak_ = std::max(peak_, true_peak(lr_, frames_, scanned, ready));
+            } else {
+                for (size_t i = (size_t)scanned * 2; i < (size_t)ready * 2; ++i)
+                    peak_ = std::max(peak_, std::abs(lr_[i]));
+            }
+            if (scanned_) scanned_(scanned, ready);
+            counters_.items++;
+            scanned = ready;
+        }
+    }
+
+    const float*                          lr_;
+    int64_t                               frames_;
+    int64_t                               begin_, end_;   // scanned range
+    bool                                  oversampled_;
+    StageCounters&                        counters_;
+    std::function<void(int64_t, int64_t)> scanned_;
+    float                                 peak_ = 0.0f;
+    SpscQueue<int64_t>                    posted_{64};   // mixed-through positions, one per block
+    StageThread                           thread_;       // last: starts once the rest exists
 };
 
 // ============================================================
-//  WAV writer helpers
+//  Render request
 // ============================================================
 
-namespace detail {
+// Draft renders are for auditioning: half rate, linear interpolation, no
+// inserts or master chain, plain peak normalize. Master renders get the
+// full chain, 4-point interpolation, a -1 dBTP true-peak ceiling and
+// dither. Both go through the same MixEngine.
+enum class Quality { DRAFT, MASTER };
+
+struct QualityProfile {
+    int  sample_rate;
+    bool effects;       // bus inserts and master chain
+    bool hermite;       // 4-point interpolation for resampled voices, else linear
+    bool true_peak;     // -1 dBTP ceiling instead of sample-peak normalize
+    bool dither;
+};
 
-inline void write_le16(std::ofstream& f, uint16_t v) {
-    f.put(v & 0xFF);
-    f.put((v >> 8) & 0xFF);
+inline const QualityProfile& quality_profile(Quality q) {
+    static const QualityProfile draft  = {22050, false, false, false, false};
+    static const QualityProfile master = {44100, true,  true,  true,  true};
+    return q == Quality::DRAFT ? draft : master;
 }
 
-inline void write_le32(std::ofstream& f, uint32_t v) {
-    f.put(v & 0xFF);
-    f.put((v >> 8) & 0xFF);
-    f.put((v >> 16) & 0xFF);
-    f.put((v >> 24) & 0xFF);
+inline Quality quality_from_str(const std::string& s) {
+    if (s == "draft")  return Quality::DRAFT;
+    if (s == "master") return Quality::MASTER;
+    throw std::invalid_argument("Unknown quality: " + s);
 }
 
-} // namespace detail
+inline std::string quality_to_str(Quality q) { return q == Quality::DRAFT ? "draft" : "master"; }
+
+// BUFFER mixes the whole render in a pooled float buffer, then writes the
+// WAV; MAPPED mixes straight into the memory-mapped output file (POSIX,
+// falls back to BUFFER elsewhere)
+enum class OutputMode { BUFFER, MAPPED };
+
+inline OutputMode output_mode_from_str(const std::string& s) {
+    if (s == "buffer") return OutputMode::BUFFER;
+    if (s == "mapped") return OutputMode::MAPPED;
+    throw std::invalid_argument("Unknown output mode: " + s);
+}
+
+struct RenderRequest {
+    Genre      genre = Genre::AFROBEATS;
+    Mood       mood  = Mood::CHILL;
+    MusicalKey key   = MusicalKey::C_MINOR;   // bassline and chords
+    int    bpm      = 120;
+    double duration = 30.0;   // seconds
+    mixer::MixerSettings mixer;
+    std::vector<dsp::EffectSpec> effects;   // master chain
+    Quality quality = Quality::MASTER;
+    OutputMode output = OutputMode::BUFFER;
+    int    loop_bars = 0;     // > 0: a seamless loop of this many bars instead of `duration`
+    groove::Feel feel;        // groove and humanize the composition is played with
+    std::shared_ptr<CancelToken> cancel;   // checked every block; none: runs to completion
+};
 
 // ============================================================
-//  Core beat renderer: MIDI patterns + samples -> WAV
+//  Event compile: notes -> voices with their zone already chosen
 // ============================================================
 
-inline std::string render_beat(SampleBank& bank, const fs::path& output_dir,
-                               Genre genre, int bpm, double duration_seconds) {
-    if (!bank.loaded) {
-        throw std::runtime_error("Sample bank not loaded");
-    }
-
-    const int sample_rate = 44100;
-    const int channels = 2;
+struct Voice {
+    int64_t  frame_offset;
+    int      length;      // output frames
+    uint32_t zone;        // index into SampleBank::zones()
+    float    amplitude;
+    float    rate;        // source frames per output frame at onset
+    uint8_t  group;       // mixer bus
+    float    bend = 0.0f; // octaves the rate slides by over bend_frames
+    int      bend_frames = 0;
+    synth::Model model = synth::NONE;   // synth voice instead of a bank sample
+    float    pitch = 0.0f, glide_from = 0.0f;
+    int      hold = 0;    // synth: frames before release
+    uint32_t synth_slot = 0;   // synth: index of its state, numbered in voice order
+};
 
-    // 1. Generate MIDI notes using the existing pattern system
-    auto pattern_fn = midi::get_pattern_for_genre(genre);
+// Synth state slots a voice list needs
+inline size_t synth_slots(const std::vector<Voice>& voices) {
+    for (auto v = voices.rbegin(); v != voices.rend(); ++v)
+        if (v->model != synth::NONE) return v->synth_slot + 1;
+    return 0;
+}
 
-    double beats_per_bar = 4.0;
-    double seconds_per_bar = (beats_per_bar / bpm) * 60.0;
-    int total_bars = std::max(1, (int)(duration_seconds / seconds_per_bar));
+// Source frame a sample voice has reached `t` frames after onset. With a
+// bend the rate moves exponentially, rate * 2^(bend * t / T), so position
+// is its closed-form integral; after T the rate holds.
+inline double voice_position(const Voice& v, int t) {
+    if (v.bend == 0.0f || v.bend_frames <= 0) return (double)v.rate * t;
+    const double T = v.bend_frames, b = v.bend;
+    const double tb = std::min<double>(t, T);
+    double pos = v.rate * T / (b * M_LN2) * (std::exp2(b * tb / T) - 1.0);
+    if (t > T) pos += v.rate * std::exp2(b) * (t - T);
+    return pos;
+}
 
-    std::vector<midi::Note> notes;
-    for (int bar = 0; bar < total_bars; ++bar) {
-        uint32_t bar_start = bar * midi::WHOLE;
-        pattern_fn(notes, bar_start);
-    }
+inline synth::Model synth_model_for_channel(uint8_t channel) {
+    if (channel == midi::BASS_CHANNEL)     return synth::BASS_808;
+    if (channel == midi::LOG_DRUM_CHANNEL) return synth::LOG_DRUM;
+    if (channel == midi::CHORD_CHANNEL)    return synth::KEYS;
+    return synth::NONE;
+}
 
-    // 2. Allocate stereo float buffer
-    int total_frames = (int)(sample_rate * duration_seconds) + sample_rate; // +1s padding
-    std::vector<float> buffer(total_frames * channels, 0.0f);
+// Velocity layer and round-robin selection happen here, once per note, and
+// notes on muted / non-soloed buses are dropped, so the mix loop only walks
+// a flat list of audible voices. Drum-channel notes play bank samples;
+// pitched channels play synth voices, a log drum gliding from the previous
+// log drum note when it began less than a half note earlier. Voices come
+// out sorted by start frame.
+inline std::vector<Voice> compile_voices(std::vector<midi::Note> notes,
+                                         const SampleBank& bank,
+                                         const mixer::MixerSettings& mix, int bpm,
+                                         int sample_rate, int64_t total_frames) {
+    // Round-robin must advance in playback order
+    std::stable_sort(notes.begin(), notes.end(),
+                     [](const midi::Note& a, const midi::Note& b) { return a.tick < b.tick; });
 
-    // 3. Mix each note into the buffer
+    RoundRobinState rr{};
+    uint32_t synth_voices = 0;
+    std::vector<Voice> voices;
+    voices.reserve(notes.size());
+    std::array<const midi::Note*, 16> previous{};   // last note per pitched channel
     for (auto& note : notes) {
-        const PcmSample* sample = bank.get(note.pitch);
-        if (!sample) continue;
+        if (note.channel != midi::DRUM_CHANNEL) {
+            const midi::Note* prev = previous[note.channel & 0x0F];
+            previous[note.channel & 0x0F] = &note;
+            synth::Model model = synth_model_for_channel(note.channel);
+            if (model == synth::NONE || !mix.note_audible(note)) continue;
+
+            int64_t frame_offset = (int64_t)(note.tick * 60.0 / (bpm * midi::TPQ) * sample_rate);
+            if (frame_offset >= total_frames) continue;
+            int hold = std::max(1, (int)(note.duration * 60.0 / (bpm * midi::TPQ) * sample_rate));
+            int length = (int)std::min<int64_t>(synth::voice_frames(model, hold, sample_rate),
+                                                total_frames - frame_offset);
+            bool glide = prev && note.tick - prev->tick < (uint32_t)midi::HALF;
+
+            Voice v{frame_offset, length, 0, note.velocity / 127.0f, 1.0f,
+                    (uint8_t)mixer::group_for(note)};
+            v.model      = model;
+            v.pitch      = note.pitch;
+            v.glide_from = glide ? prev->pitch : note.pitch;
+            v.hold       = hold;
+            v.synth_slot = synth_voices++;
+            voices.push_back(v);
+            continue;
+        }
+
+        if (!mix.note_audible(note)) continue;
+        const SampleZone* zone = bank.select(note.pitch, note.velocity, rr);
+        if (!zone) continue;
 
         // Convert tick to time: time = tick * 60.0 / (bpm * TPQ)
         double time = note.tick * 60.0 / (bpm * midi::TPQ);
-        int frame_offset = (int)(time * sample_rate);
-
+        int64_t frame_offset = (int64_t)(time * sample_rate);
         if (frame_offset >= total_frames) continue;
 
         // Velocity scaling
         float amplitude = note.velocity / 127.0f;
 
-        // Resample if needed (simple nearest-neighbor for different sample rates)
-        double rate_ratio = (double)sample->sample_rate / sample_rate;
+        // Sample rate conversion and per-note pitch both go into the
+        // playback rate; the mix loop reads with 4-point interpolation
+        double rate_ratio = (double)zone->sample_rate / sample_rate * std::exp2(note.cents / 1200.0);
+        double slowest = rate_ratio * std::min(1.0, std::exp2(note.bend / 1200.0));
+        int length = (int)std::min<int64_t>((int64_t)(zone->num_frames / slowest),
+                                            total_frames - frame_offset);
+        if (length <= 0) continue;
+
+        Voice v{frame_offset, length, (uint32_t)(zone - bank.zones().data()),
+                amplitude, (float)rate_ratio, (uint8_t)mixer::group_for(note)};
+        if (note.bend != 0) {
+            v.bend = note.bend / 1200.0f;
+            v.bend_frames = std::max(1, (int)(note.duration * 60.0 / (bpm * midi::TPQ) * sample_rate));
+        }
+        voices.push_back(v);
+    }
+    return voices;
+}
+
+// ============================================================
+//  Sidechain ducking, driven by the event stream
+// ============================================================
+
+struct SidechainTrigger {
+    int64_t frame;
+    float strength;   // depth * velocity
+};
+
+// Trigger frames for one sidechain, sorted. Uses every trigger note,
+// audible or not: a muted kick still drives the pump.
+inline std::vector<SidechainTrigger> compile_sidechain(const std::vector<midi::Note>& notes,
+                                                       const mixer::SidechainSettings& sc,
+                                                       int bpm, int sample_rate) {
+    std::vector<SidechainTrigger> triggers;
+    for (auto& note : notes) {
+        if (note.channel != midi::DRUM_CHANNEL) continue;
+        if (std::find(sc.triggers.begin(), sc.triggers.end(), note.pitch) == sc.triggers.end())
+            continue;
+        double time = note.tick * 60.0 / (bpm * midi::TPQ);
+        triggers.push_back({(int64_t)(time * sample_rate), sc.depth * note.velocity / 127.0f});
+    }
+    std::sort(triggers.begin(), triggers.end(),
+              [](const SidechainTrigger& a, const SidechainTrigger& b) { return a.frame < b.frame; });
+    return triggers;
+}
+
+// Gain-reduction envelope: linear attack to the trigger's strength, then
+// exponential release. One multiply-add per frame, and nothing at all
+// while the envelope is at rest.
+class SidechainEnvelope {
+public:
+    SidechainEnvelope(const mixer::SidechainSettings& sc, std::vector<SidechainTrigger> triggers,
+                      int sample_rate)
+        : targets_(sc.targets), triggers_(std::move(triggers)) {
+        attack_frames_ = std::max(1, (int)(sc.attack * sample_rate));
+        release_coeff_ = (float)std::exp(std::log(0.01) / (sc.release * sample_rate));
+    }
+
+    // Bus gains for [start, start + frames) into `gains`; false when the
+    // envelope is at rest for the whole block (gains left untouched)
+    bool render(float* gains, int64_t start, int frames) {
+        const int64_t end = start + frames;
+        bool triggered = next_ < triggers_.size() && triggers_[next_].frame < end;
+        if (!triggered && attack_left_ == 0 && env_ < REST) {
+            env_ = 0.0f;
+            return false;
+        }
+        for (int i = 0; i < frames; ++i) {
+            while (next_ < triggers_.size() && triggers_[next_].frame <= start + i) {
+                float target = std::max(env_, triggers_[next_++].strength);
+                attack_step_ = (target - env_) / attack_frames_;
+                attack_left_ = attack_frames_;
+            }
+            if (attack_left_ > 0) {
+                env_ += attack_step_;
+                --attack_left_;
+            } else {
+                env_ *= release_coeff_;
+            }
+            gains[i] = 1.0f - env_;
+        }
+        return true;
+    }
+
+    const std::vector<int>& targets() const { return targets_; }
+
+    // Swap in the trigger list of a longer render of the same notes; the
+    // triggers already consumed are the same prefix of it
+    void extend(std::vector<SidechainTrigger> triggers) { triggers_ = std::move(triggers); }
+
+private:
+    static constexpr float REST = 1e-4f;
+
+    std::vector<int>              targets_;
+    std::vector<SidechainTrigger> triggers_;
+    size_t next_ = 0;
+    int    attack_frames_ = 1, attack_left_ = 0;
+    float  attack_step_ = 0.0f, release_coeff_ = 0.0f;
+    float  env_ = 0.0f;
+};
+
+// ============================================================
+//  Mix engine: voices -> group buses -> stereo master, per block
+// ============================================================
+
+constexpr int BLOCK_FRAMES = 512;
+
+class MixEngine {
+public:
+    MixEngine(const SampleBank& bank, const std::vector<Voice>& voices,
+              const mixer::MixerSettings& mix,
+              const std::vector<dsp::EffectSpec>& master_effects, int sample_rate,
+              std::vector<std::vector<SidechainTrigger>> sidechain_triggers = {},
+              bool hermite = true)
+        : bank_(bank), voices_(voices), mix_(mix),
+          buses_(mixer::group_count(), std::vector<float>(BLOCK_FRAMES * 2)),
+          bus_used_(mixer::group_count(), false),
+          bus_fx_(mixer::group_count()),
+          master_fx_(master_effects, sample_rate),
+          sample_rate_(sample_rate),
+          hermite_(hermite),
+          synth_state_(synth_slots(voices)),
+          synth_out_(BLOCK_FRAMES),
+          duck_gains_(BLOCK_FRAMES) {
+        for (int g = 0; g < mixer::group_count(); ++g) {
+            if (mix.audible(g) && !mix.buses[g].effects.empty())
+                bus_fx_[g] = dsp::EffectChain(mix.buses[g].effects, sample_rate);
+        }
+        for (size_t i = 0; i < mix.sidechains.size() && i < sidechain_triggers.size(); ++i)
+            sidechains_.emplace_back(mix.sidechains[i], std::move(sidechain_triggers[i]), sample_rate);
+    }
+
+    // Render the next `frames` (<= BLOCK_FRAMES) frames into `out`
+    // (interleaved stereo, overwritten)
+    void render_block(float* out, int frames) {
+        mix_voices(frames);
+        mix_buses(out, frames);
+        position_ += frames;
+    }
+
+    // Stems instead of a master: each bus after its inserts, before
+    // ducking and gain/pan, into `stems[g]` where that isn't null (zeros
+    // when the bus was idle); `used[g]` tells whether it carried signal
+    void render_stems_block(float* const* stems, uint8_t* used, int frames) {
+        mix_voices(frames);
+        for (int g = 0; g < (int)buses_.size(); ++g) {
+            used[g] = bus_used_[g];
+            if (!stems[g]) continue;
+            if (used[g]) std::copy(buses_[g].begin(), buses_[g].begin() + frames * 2, stems[g]);
+            else         std::fill(stems[g], stems[g] + frames * 2, 0.0f);
+        }
+        position_ += frames;
+    }
+
+    // The master block render_block would have made, from stems recorded
+    // by render_stems_block (null where the bus isn't part of this mix).
+    // Construct with no voices and no bus inserts; the stems carry both.
+    void mix_stems_block(const float* const* stems, const uint8_t* used, float* out, int frames) {
+        for (int g = 0; g < (int)buses_.size(); ++g) {
+            bus_used_[g] = stems[g] && used[g];
+            if (bus_used_[g]) std::copy(stems[g], stems[g] + frames * 2, buses_[g].begin());
+        }
+        mix_buses(out, frames);
+        position_ += frames;
+    }
+
+    int64_t position() const { return position_; }
+
+    // Voices handed to the mix so far
+    size_t voices_started() const { return next_voice_; }
+
+    // The voice list (owned by the caller) was recompiled for a longer
+    // render: same voices in the same order, followed by new ones, with
+    // lengths no longer cut at the old end. Continue with it.
+    void extend(std::vector<std::vector<SidechainTrigger>> sidechain_triggers) {
+        synth_state_.resize(synth_slots(voices_));
+        for (size_t i = 0; i < sidechains_.size() && i < sidechain_triggers.size(); ++i)
+            sidechains_[i].extend(std::move(sidechain_triggers[i]));
+    }
+
+private:
+    // Voices of the block at position_ -> buses, through the insert chains
+    void mix_voices(int frames) {
+        const int64_t block_start = position_;
+        const int64_t block_end = block_start + frames;
+
+        // Start voices that begin inside this block
+        while (next_voice_ < voices_.size() && voices_[next_voice_].frame_offset < block_end) {
+            active_.push_back((uint32_t)next_voice_++);
+            if (bank_.compressed()) {
+                if (windows_.size() < active_.size()) windows_.emplace_back();
+                windows_[active_.size() - 1].frames = 0;
+            }
+        }
+
+        // Buses with an insert chain run every block so tails ring out
+        for (int g = 0; g < (int)buses_.size(); ++g) {
+            bus_used_[g] = !bus_fx_[g].empty();
+            if (bus_used_[g]) std::fill(buses_[g].begin(), buses_[g].begin() + frames * 2, 0.0f);
+        }
+
+        // Voices -> buses
+        size_t keep = 0;
+        auto keep_voice = [&](size_t a) {
+            if (bank_.compressed()) std::swap(windows_[keep], windows_[a]);
+            active_[keep++] = active_[a];
+        };
+        for (size_t a = 0; a < active_.size(); ++a) {
+            const uint32_t vi = active_[a];
+            const Voice& v = voices_[vi];
+            // Timeline frames are 64-bit; offsets inside a voice or a block fit in int
+            const int64_t from = std::max(v.frame_offset, block_start);
+            const int64_t to   = std::min(v.frame_offset + v.length, block_end);
+            const int t_from = (int)(from - v.frame_offset), t_to = (int)(to - v.frame_offset);
+            const int dst0   = (int)(from - block_start) - t_from;   // block index of voice frame 0
+
+            auto& bus = buses_[v.group];
+            if (!bus_used_[v.group]) {
+                std::fill(bus.begin(), bus.begin() + frames * 2, 0.0f);
+                bus_used_[v.group] = true;
+            }
+
+            if (v.model != synth::NONE) {
+                synth::VoiceNote note{v.model, v.pitch, v.glide_from, v.hold, v.amplitude};
+                synth::render_voice(note, t_from, t_to - t_from, sample_rate_,
+                                    synth_state_[v.synth_slot], synth_out_.data());
+                synth::add_mono(bus.data() + (dst0 + t_from) * 2, synth_out_.data(), t_to - t_from);
+                if (v.frame_offset + v.length > block_end) keep_voice(a);
+                continue;
+            }
+
+            // Source frame f is src[(f - base) * 2]: the arena, or on a
+            // compressed bank the voice's window of decoded blocks, moved
+            // up to this block's read positions (interpolation taps included)
+            const SampleZone& zone = bank_.zones()[v.zone];
+            const int zone_frames = (int)zone.num_frames;
+            const bool unpitched = v.rate == 1.0f && v.bend == 0.0f;
+            const float* src;
+            int base = 0;
+            if (bank_.compressed()) {
+                SourceWindow& w = windows_[a];
+                const int64_t lo = unpitched ? t_from : (int64_t)std::floor(voice_position(v, t_from)) - 1;
+                const int64_t hi = unpitched ? t_to : (int64_t)voice_position(v, t_to) + 3;
+                fill_window(w, zone, std::max<int64_t>(lo, 0), std::min<int64_t>(hi, zone_frames));
+                src = w.lr.data();
+                base = (int)w.first;
+            } else {
+                src = bank_.frames(zone);   // always stereo after decode
+            }
+            if (unpitched) {
+                for (int src_frame = t_from; src_frame < t_to; ++src_frame) {
+                    if (src_frame >= zone_frames) break;
+                    int dst_idx = (dst0 + src_frame) * 2;
+                    bus[dst_idx]     += src[(src_frame - base) * 2]     * v.amplitude;
+                    bus[dst_idx + 1] += src[(src_frame - base) * 2 + 1] * v.amplitude;
+                }
+            } else {
+                // Position is exact at control points, linear in between
+                for (int t0 = t_from; t0 < t_to; t0 += dsp::CONTROL_FRAMES) {
+                    int n = std::min(dsp::CONTROL_FRAMES, t_to - t0);
+                    double p0 = voice_position(v, t0);
+                    double inc = (voice_position(v, t0 + n) - p0) / n;
+                    for (int i = 0; i < n; ++i) {
+                        double pos = p0 + inc * i;
+                        if (pos >= zone_frames) break;
+                        const double rel = pos - base;
+                        float l, r;
+                        if (hermite_) {
+                            stretch::hermite_frame(src, zone_frames - base, rel, l, r);
+                        } else {
+                            int i0 = (int)rel;
+                            float t = (float)(rel - i0);
+                            int i1 = std::min(i0 + 1, zone_frames - base - 1);
+                            l = src[i0 * 2]     + (src[i1 * 2]     - src[i0 * 2])     * t;
+                            r = src[i0 * 2 + 1] + (src[i1 * 2 + 1] - src[i0 * 2 + 1]) * t;
+                        }
+                        int dst_idx = (dst0 + t0 + i) * 2;
+                        bus[dst_idx]     += l * v.amplitude;
+                        bus[dst_idx + 1] += r * v.amplitude;
+                    }
+                }
+            }
 
-        int frames_to_mix = std::min(sample->num_frames, total_frames - frame_offset);
-        if (rate_ratio != 1.0) {
-            frames_to_mix = std::min((int)(sample->num_frames / rate_ratio),
-                                     total_frames - frame_offset);
+            if (v.frame_offset + v.length > block_end) keep_voice(a);
         }
+        active_.resize(keep);
 
-        for (int i = 0; i < frames_to_mix; ++i) {
-            int src_frame = (int)(i * rate_ratio);
-            if (src_frame >= sample->num_frames) break;
+        // Inserts
+        for (int g = 0; g < (int)buses_.size(); ++g)
+            if (bus_used_[g]) bus_fx_[g].process(buses_[g].data(), frames);
+    }
 
-            int dst_idx = (frame_offset + i) * channels;
-            int src_idx = src_frame * 2; // samples are always stereo after decode
+    // Decoded codec blocks around a compressed-bank voice's read position
+    struct SourceWindow {
+        int64_t            first = 0;    // first frame held
+        int64_t            frames = 0;
+        std::vector<float> lr;
+    };
 
-            buffer[dst_idx]     += sample->data[src_idx]     * amplitude;
-            buffer[dst_idx + 1] += sample->data[src_idx + 1] * amplitude;
+    // Make `w` cover zone frames [lo, hi) in whole codec blocks, dropping
+    // blocks behind lo and decoding only those not held yet
+    void fill_window(SourceWindow& w, const SampleZone& zone, int64_t lo, int64_t hi) {
+        if (lo >= hi) return;
+        constexpr int64_t B = codec::BLOCK_FRAMES;
+        const int64_t first = lo / B * B;
+        const int64_t end = (hi + B - 1) / B * B;
+        if (w.frames == 0 || first < w.first || first > w.first + w.frames) {
+            w.first = first;
+            w.frames = 0;
+        } else if (first > w.first) {
+            w.lr.erase(w.lr.begin(), w.lr.begin() + (first - w.first) * 2);
+            w.frames -= first - w.first;
+            w.first = first;
+        }
+        if (w.first + w.frames < end) {
+            const int64_t held = w.frames, blocks = (end - w.first - held) / B;
+            w.lr.resize((size_t)(held + blocks * B) * 2);
+            bank_.decode(zone, (w.first + held) / B, blocks, w.lr.data() + held * 2);
+            w.frames += blocks * B;
         }
     }
 
-    // 4. Trim to actual duration (remove padding)
-    int actual_frames = (int)(sample_rate * duration_seconds);
-    actual_frames = std::min(actual_frames, total_frames);
+    // Sidechain ducking on the target buses, then buses -> master
+    void mix_buses(float* out, int frames) {
+        for (auto& sc : sidechains_) {
+            if (!sc.render(duck_gains_.data(), position_, frames)) continue;
+            for (int g : sc.targets()) {
+                if (!bus_used_[g]) continue;
+                float* bus = buses_[g].data();
+                for (int i = 0; i < frames; ++i) {
+                    bus[i * 2]     *= duck_gains_[i];
+                    bus[i * 2 + 1] *= duck_gains_[i];
+                }
+            }
+        }
+
+        // Buses -> master with gain and constant-power pan
+        std::fill(out, out + frames * 2, 0.0f);
+        for (int g = 0; g < (int)buses_.size(); ++g) {
+            if (!bus_used_[g]) continue;
+            const auto& b = mix_.buses[g];
+            float gl, gr;
+            mixer::pan_gains(b.pan, gl, gr);
+            gl *= b.gain;
+            gr *= b.gain;
+            const float* bus = buses_[g].data();
+            for (int i = 0; i < frames; ++i) {
+                out[i * 2]     += bus[i * 2]     * gl;
+                out[i * 2 + 1] += bus[i * 2 + 1] * gr;
+            }
+        }
+        master_fx_.process(out, frames);
+    }
+
+    const SampleBank&                bank_;
+    const std::vector<Voice>&        voices_;
+    const mixer::MixerSettings&      mix_;
+    std::vector<std::vector<float>>  buses_;
+    std::vector<bool>                bus_used_;
+    std::vector<dsp::EffectChain>    bus_fx_;
+    dsp::EffectChain                 master_fx_;
+    int                              sample_rate_;
+    bool                             hermite_;
+    std::vector<synth::VoiceState>   synth_state_;   // by Voice::synth_slot
+    std::vector<float>               synth_out_;
+    std::vector<SidechainEnvelope>   sidechains_;
+    std::vector<float>               duck_gains_;
+    std::vector<uint32_t>            active_;
+    std::vector<SourceWindow>        windows_;       // compressed bank: by active_ slot
+    size_t                           next_voice_ = 0;
+    int64_t                          position_ = 0;
+};
 
-    // 5. Peak normalize to prevent clipping
+// ============================================================
+//  Render metrics
+// ============================================================
+
+struct RenderStats {
+    std::string id;
+    double   seconds = 0.0;         // wall time
+    double   audio_seconds = 0.0;
+    long     page_faults = 0;       // taken by the rendering thread
+    uint64_t allocations = 0;       // fresh pool buffers (0 when reused)
+    size_t   buffer_bytes = 0;
+    double   reused_seconds = 0.0;  // already mixed by an earlier render of the same beat
+    std::vector<StageCounters> stages = {};   // pipeline order; empty when not tracked
+};
+
+// Counters of the offline render pipeline. Mix and peak scan overlap; the
+// peak sets the gain, so encode and write (which overlap each other) only
+// start once mixing is done.
+struct RenderStages {
+    StageCounters compile{"compile"};   // notes -> voices and sidechain triggers
+    StageCounters mix{"mix"};
+    StageCounters peak{"peak"};
+    StageCounters encode{"encode"};     // gain, dither, 16-bit
+    StageCounters write{"write"};
+
+    std::vector<StageCounters> list() const { return {compile, mix, peak, encode, write}; }
+};
+
+// Totals plus the most recent renders, for GET /api/metrics
+class RenderMetrics {
+public:
+    static constexpr size_t RECENT = 20;
+
+    void record(RenderStats s) {
+        std::lock_guard lock(mutex_);
+        renders_++;
+        page_faults_ += s.page_faults;
+        allocations_ += s.allocations;
+        for (auto& stage : s.stages) {
+            auto& total = stage_totals_[stage.name];
+            total.audio_seconds += s.audio_seconds;
+            total.busy_seconds += stage.busy_seconds;
+            total.stall_seconds += stage.stall_seconds;
+        }
+        recent_.push_back(std::move(s));
+        if (recent_.size() > RECENT) recent_.erase(recent_.begin());
+    }
+
+    json to_json() const {
+        std::lock_guard lock(mutex_);
+        json recent = json::array();
+        for (auto it = recent_.rbegin(); it != recent_.rend(); ++it) {
+            json r = {{"id", it->id}, {"seconds", it->seconds},
+                      {"audio_seconds", it->audio_seconds},
+                      {"page_faults", it->page_faults},
+                      {"allocations", it->allocations},
+                      {"buffer_bytes", it->buffer_bytes},
+                      {"reused_seconds", it->reused_seconds}};
+            if (!it->stages.empty()) r["pipeline"] = stages_to_json(it->stages, it->audio_seconds);
+            recent.push_back(std::move(r));
+        }
+        // Throughput of each stage over every render that tracked it
+        json stages = json::object();
+        for (auto& [name, total] : stage_totals_)
+            stages[name] = {{"busy_seconds", total.busy_seconds}, {"stall_seconds", total.stall_seconds},
+                            {"realtime", total.busy_seconds > 0.0 ? total.audio_seconds / total.busy_seconds : 0.0}};
+        return {{"renders", renders_}, {"page_faults", page_faults_},
+                {"allocations", allocations_}, {"stages", stages}, {"recent", recent}};
+    }
+
+private:
+    mutable std::mutex       mutex_;
+    uint64_t                 renders_ = 0;
+    long                     page_faults_ = 0;
+    uint64_t                 allocations_ = 0;
+    std::vector<RenderStats> recent_;   // oldest first
+
+    struct StageTotal {
+        double audio_seconds = 0.0;
+        double busy_seconds = 0.0;
+        double stall_seconds = 0.0;
+    };
+    std::map<std::string, StageTotal> stage_totals_;   // by stage name
+};
+
+inline RenderMetrics& render_metrics() {
+    static RenderMetrics metrics;
+    return metrics;
+}
+
+// ============================================================
+//  Core beat renderer: MIDI patterns + samples -> WAV
+// ============================================================
+
+constexpr double LONG_RENDER_SECONDS = 600.0;        // switch to mapped output above this
+constexpr double MAX_RENDER_SECONDS  = 12 * 3600.0;
+
+// Gain that brings `peak` under the profile's ceiling (1 if already under)
+inline float normalize_gain(float peak, const QualityProfile& quality) {
+    // Master holds inter-sample peaks under -1 dBTP
+    const float ceiling   = quality.true_peak ? dsp::db_to_gain(-1.0f) : 0.95f;
+    const float threshold = quality.true_peak ? ceiling : 1.0f;
+    return peak > threshold ? ceiling / peak : 1.0f;
+}
+
+// Normalize interleaved stereo `buffer` and write it as a WAV
+inline void write_normalized(const fs::path& wav_path, const float* buffer, int64_t frames,
+                             int sample_rate, const QualityProfile& quality) {
+    const int channels = 2;
     float peak = 0.0f;
-    for (int i = 0; i < actual_frames * channels; ++i) {
-        peak = std::max(peak, std::abs(buffer[i]));
+    if (quality.true_peak) {
+        peak = true_peak(buffer, frames);
+    } else {
+        for (int64_t i = 0; i < frames * channels; ++i) {
+            peak = std::max(peak, std::abs(buffer[i]));
+        }
     }
-    if (peak > 1.0f) {
-        float gain = 0.95f / peak;
-        for (int i = 0; i < actual_frames * channels; ++i) {
-            buffer[i] *= gain;
+
+    Wav16Writer out(wav_path, frames, sample_rate, quality.dither);
+    out.append(buffer, frames, normalize_gain(peak, quality));
+    out.finish();
+}
+
+// Mix `frames` frames into a pooled buffer while the peak stage scans
+// behind the mix, then encode and write the WAV with the normalize gain.
+// Returns the buffer's size in bytes.
+inline size_t render_buffered(MixEngine& engine, const fs::path& wav_path, int64_t frames,
+                              int64_t total_frames, int sample_rate, const QualityProfile& quality,
+                              RenderStages& stages, CancelToken* cancel = nullptr) {
+    const int channels = 2;
+
+    // Stereo float buffer from the pool (zeroed, already faulted in)
+    auto lease = render_buffer_pool().acquire((size_t)total_frames * channels);
+    float* buffer = lease.data();
+    PeakStage peaks(buffer, frames, quality.true_peak, stages.peak);
+    while (engine.position() < total_frames) {
+        checkpoint(cancel);
+        int n = (int)std::min<int64_t>(BLOCK_FRAMES, total_frames - engine.position());
+        {
+            StageTimer busy(stages.mix.busy_seconds);
+            engine.render_block(buffer + engine.position() * channels, n);
         }
+        stages.mix.items++;
+        StageTimer stall(stages.mix.stall_seconds);
+        peaks.mixed(engine.position());
     }
+    const float gain = normalize_gain(peaks.finish(), quality);
 
-    // 6. Write 16-bit PCM WAV
-    std::string beat_id = "offline_" + random_hex_id(12);
-    auto wav_path = output_dir / (beat_id + ".wav");
+    Wav16Writer out(wav_path, frames, sample_rate, quality.dither, &stages.encode, &stages.write);
+    out.append(buffer, frames, gain);
+    out.finish();
+    return lease.capacity() * sizeof(float);
+}
 
-    std::ofstream f(wav_path.string(), std::ios::binary);
-    if (!f) throw std::runtime_error("Cannot create WAV file");
+// Mix straight into the output file. The mapping is first filled with
+// float frames block by block while the peak stage scans behind the mix
+// and releases the pages it is done with; an in-place conversion to
+// 16-bit (each int16 lands at or before the float it came from) then
+// walks it window by window. Resident memory stays around one window
+// whatever the length, and long renders go out as RF64. Output is
+// byte-identical to render_buffered.
+inline void render_mapped(MixEngine& engine, const fs::path& wav_path, int64_t frames,
+                          int sample_rate, const QualityProfile& quality, RenderStages& stages,
+                          CancelToken* cancel = nullptr) {
+    constexpr int64_t WINDOW_FRAMES = 1 << 16;
+    const size_t header_bytes = wav16_header_bytes(frames);
+    const size_t frame_bytes = 2 * sizeof(float);
+    const size_t pcm16_frame_bytes = 2 * sizeof(int16_t);
+    MappedFile file(wav_path, header_bytes + (size_t)frames * frame_bytes);
+    uint8_t* pcm_bytes = file.data() + header_bytes;
+    float* pcm = reinterpret_cast<float*>(pcm_bytes);
 
-    uint32_t data_size = actual_frames * channels * 2; // 16-bit = 2 bytes
-    uint32_t file_size = 36 + data_size;
+    // 1. Mix, with the peak scanned behind it
+    float peak;
+    {
+        PeakStage peaks(pcm, frames, quality.true_peak, stages.peak, [&](int64_t begin, int64_t end) {
+            file.release(header_bytes + (size_t)begin * frame_bytes, (size_t)(end - begin) * frame_bytes);
+        });
+        while (engine.position() < frames) {
+            checkpoint(cancel);
+            int n = (int)std::min<int64_t>(BLOCK_FRAMES, frames - engine.position());
+            {
+                StageTimer busy(stages.mix.busy_seconds);
+                engine.render_block(pcm + (size_t)engine.position() * 2, n);
+            }
+            stages.mix.items++;
+            StageTimer stall(stages.mix.stall_seconds);
+            peaks.mixed(engine.position());
+        }
+        peak = peaks.finish();
+    }
 
-    // RIFF header
-    f.write("RIFF", 4);
-    detail::write_le32(f, file_size);
-    f.write("WAVE", 4);
+    // 2. Normalize and quantize in place, then cut the file to 16-bit size;
+    //    writing is left to the kernel's writeback
+    const float gain = normalize_gain(peak, quality);
+    detail::Pcm16Quantizer quantize{quality.dither};
+    for (int64_t w = 0; w < frames; w += WINDOW_FRAMES) {
+        checkpoint(cancel);
+        StageTimer busy(stages.encode.busy_seconds);
+        int64_t end = std::min(frames, w + WINDOW_FRAMES);
+        for (size_t i = (size_t)w * 2; i < (size_t)end * 2; ++i) {
+            float x;
+            std::memcpy(&x, pcm_bytes + i * 4, 4);
+            if (gain != 1.0f) x *= gain;
+            detail::store_le16(pcm_bytes + i * 2, (uint16_t)quantize(x));
+        }
+        // This window's 16-bit frames are final and no later float lies below them
+        file.release(header_bytes + (size_t)w * pcm16_frame_bytes, (size_t)(end - w) * pcm16_frame_bytes);
+        stages.encode.items++;
+    }
+    StageTimer busy(stages.write.busy_seconds);
+    detail::wav16_header(file.data(), frames, sample_rate);
+    file.finish(header_bytes + (size_t)frames * pcm16_frame_bytes);
+    stages.write.items++;
+}
 
-    // fmt chunk
-    f.write("fmt ", 4);
-    detail::write_le32(f, 16);               // chunk size
-    detail::write_le16(f, 1);                // PCM format
-    detail::write_le16(f, channels);         // channels
-    detail::write_le32(f, sample_rate);      // sample rate
-    detail::write_le32(f, sample_rate * channels * 2); // byte rate
-    detail::write_le16(f, channels * 2);     // block align
-    detail::write_le16(f, 16);               // bits per sample
+// Renders an arbitrary note stream (ticks at req.bpm) with the request's
+// mixer and effects; genre, mood and key are not consulted. Writes
+// <id>.wav, a fresh id unless one is given.
+inline std::string render_notes(const SampleBank& bank, const fs::path& output_dir,
+                                const std::vector<midi::Note>& notes, const RenderRequest& req,
+                                const std::string& id = {}) {
+    if (!bank.loaded) {
+        throw std::runtime_error("Sample bank not loaded");
+    }
+
+    const QualityProfile& quality = quality_profile(req.quality);
+    const int sample_rate = quality.sample_rate;
+    const int bpm = req.bpm;
+    const double duration_seconds = req.duration;
+
+    mixer::MixerSettings mix = req.mixer;
+    static const std::vector<dsp::EffectSpec> no_effects;
+    if (!quality.effects)
+        for (auto& bus : mix.buses) bus.effects.clear();
+
+    const auto started = std::chrono::steady_clock::now();
+    const long faults_before = thread_page_faults();
+    const uint64_t allocations_before = BufferPool::thread_allocations();
+
+    if (!(duration_seconds > 0.0) || duration_seconds > MAX_RENDER_SECONDS)
+        throw std::invalid_argument("Duration must be between 0 and 12 hours");
 
-    // data chunk
-    f.write("data", 4);
-    detail::write_le32(f, data_size);
+    // 1. Render length: the requested duration, plus 1 s of padding the
+    //    buffered path mixes and trims
+    int64_t actual_frames = (int64_t)(sample_rate * duration_seconds);
+    int64_t total_frames = actual_frames + sample_rate;
 
-    // Convert float to int16 and write
-    for (int i = 0; i < actual_frames * channels; ++i) {
-        float s = std::clamp(buffer[i], -1.0f, 1.0f);
-        int16_t sample16 = (int16_t)(s * 32767.0f);
-        f.put(sample16 & 0xFF);
-        f.put((sample16 >> 8) & 0xFF);
+    // 2. Resolve layers and cull muted buses once
+    RenderStages stages;
+    std::vector<Voice> voices;
+    std::vector<std::vector<SidechainTrigger>> sidechain_triggers;
+    {
+        StageTimer busy(stages.compile.busy_seconds);
+        voices = compile_voices(notes, bank, mix, bpm, sample_rate, total_frames);
+        for (auto& sc : mix.sidechains)
+            sidechain_triggers.push_back(compile_sidechain(notes, sc, bpm, sample_rate));
+        stages.compile.items = notes.size();
     }
 
+    // 3. Mix block by block, normalize and write 16-bit PCM WAV: the peak
+    //    is scanned behind the mix, the WAV written behind the encoder
+    dsp::DenormalGuard denormal_guard;
+    MixEngine engine(bank, voices, mix, quality.effects ? req.effects : no_effects, sample_rate,
+                     std::move(sidechain_triggers), quality.hermite);
+
+    std::string beat_id = id.empty() ? "offline_" + random_hex_id(12) : id;
+    auto wav_path = output_dir / (beat_id + ".wav");
+    size_t buffer_bytes = 0;
+    // Long renders always stream through the mapped file so memory stays flat
+    const bool mapped = req.output == OutputMode::MAPPED || duration_seconds > LONG_RENDER_SECONDS;
+    try {
+        if (mapped && MappedFile::supported()) {
+            render_mapped(engine, wav_path, actual_frames, sample_rate, quality, stages, req.cancel.get());
+        } else {
+            buffer_bytes = render_buffered(engine, wav_path, actual_frames, total_frames,
+                                           sample_rate, quality, stages, req.cancel.get());
+        }
+    } catch (...) {
+        std::error_code ec;
+        fs::remove(wav_path, ec);   // half-written
+        throw;
+    }
+
+    render_metrics().record({
+        beat_id,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count(),
+        actual_frames / (double)sample_rate,
+        thread_page_faults() - faults_before,
+        BufferPool::thread_allocations() - allocations_before,
+        buffer_bytes,
+        0.0,
+        stages.list(),
+    });
     return beat_id;
 }
 
+inline std::string render_beat(const SampleBank& bank, const fs::path& output_dir,
+                               const RenderRequest& req, const std::string& id = {}) {
+    // Drum pattern plus key-aware bassline and chords
+    auto notes = melody::compose_beat(req.genre, req.mood, req.key, req.bpm, req.duration, req.feel);
+    return render_notes(bank, output_dir, notes, req, id);
+}
+
 } // namespace renderer
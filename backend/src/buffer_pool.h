@@ -0,0 +1,232 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// Pool of large, 64-byte aligned float buffers for whole-render mixes.
+// Buffers come in power-of-two size classes and are written through once
+// when first allocated, so their pages are faulted in before a render
+// starts and stay resident for the next one. Each thread keeps its most
+// recently released buffer for a lock-free reacquire; everything else
+// idles in per-class free lists. Idle memory is bounded: a release that
+// would push it past the limit frees the buffer instead.
+namespace renderer {
+
+class BufferPool {
+public:
+    static constexpr size_t MIN_CLASS_FLOATS = size_t(1) << 18;   // 1 MB
+    static constexpr size_t ALIGNMENT = 64;
+
+    struct Stats {
+        uint64_t allocations = 0;       // fresh buffers from the system
+        uint64_t reuses = 0;            // acquires served from the pool
+        uint64_t thread_local_hits = 0; // ... of which without taking the lock
+        uint64_t frees = 0;             // releases over the idle limit
+        size_t   idle_bytes = 0;
+        size_t   leased_bytes = 0;
+        size_t   max_idle_bytes = 0;
+    };
+
+    // RAII handle to one pooled buffer; returns it on destruction
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(Lease&& o) noexcept { *this = std::move(o); }
+        Lease& operator=(Lease&& o) noexcept {
+            if (this != &o) {
+                reset();
+                pool_ = std::exchange(o.pool_, nullptr);
+                data_ = std::exchange(o.data_, nullptr);
+                size_ = std::exchange(o.size_, 0);
+                capacity_ = std::exchange(o.capacity_, 0);
+            }
+            return *this;
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease() { reset(); }
+
+        float*       data()       { return data_; }
+        const float* data() const { return data_; }
+        size_t size() const { return size_; }          // floats requested
+        size_t capacity() const { return capacity_; }  // floats in the size class
+
+        void reset() {
+            if (pool_) pool_->release({data_, capacity_});
+            pool_ = nullptr;
+            data_ = nullptr;
+            size_ = capacity_ = 0;
+        }
+
+    private:
+        friend class BufferPool;
+        BufferPool* pool_ = nullptr;
+        float*      data_ = nullptr;
+        size_t      size_ = 0;
+        size_t      capacity_ = 0;
+    };
+
+    explicit BufferPool(size_t max_idle_bytes) : max_idle_bytes_(max_idle_bytes) {}
+
+    ~BufferPool() {
+        for (auto& [cls, blocks] : free_)
+            for (auto& b : blocks) free_block(b);
+    }
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    static size_t class_floats(size_t floats) {
+        return std::bit_ceil(std::max(floats, MIN_CLASS_FLOATS));
+    }
+
+    // A buffer of at least `floats` floats, the first `floats` zeroed
+    Lease acquire(size_t floats) {
+        const size_t cls = class_floats(floats);
+        Block b = take(cls);
+        if (b.data) {
+            std::memset(b.data, 0, floats * sizeof(float));
+        } else {
+            b = {static_cast<float*>(::operator new(cls * sizeof(float), std::align_val_t(ALIGNMENT))), cls};
+            std::memset(b.data, 0, cls * sizeof(float));   // fault every page in now
+            allocations_.fetch_add(1, std::memory_order_relaxed);
+            thread_allocations()++;
+        }
+        leased_bytes_.fetch_add(cls * sizeof(float), std::memory_order_relaxed);
+
+        Lease lease;
+        lease.pool_ = this;
+        lease.data_ = b.data;
+        lease.size_ = floats;
+        lease.capacity_ = cls;
+        return lease;
+    }
+
+    Stats stats() const {
+        Stats s;
+        s.allocations = allocations_.load(std::memory_order_relaxed);
+        s.reuses = reuses_.load(std::memory_order_relaxed);
+        s.thread_local_hits = thread_local_hits_.load(std::memory_order_relaxed);
+        s.frees = frees_.load(std::memory_order_relaxed);
+        s.leased_bytes = leased_bytes_.load(std::memory_order_relaxed);
+        s.idle_bytes = idle_bytes_.load(std::memory_order_relaxed);
+        s.max_idle_bytes = max_idle_bytes_;
+        return s;
+    }
+
+    // Fresh allocations made by the calling thread, for per-render counts
+    static uint64_t& thread_allocations() {
+        thread_local uint64_t count = 0;
+        return count;
+    }
+
+private:
+    struct Block {
+        float* data = nullptr;
+        size_t floats = 0;
+    };
+
+    // Per-thread slot holding the last buffer this thread released
+    struct ThreadCache {
+        BufferPool* owner = nullptr;
+        Block block;
+        ~ThreadCache() {
+            if (owner && block.data) owner->release_shared(block);
+        }
+    };
+
+    ThreadCache& thread_cache() {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+
+    static void free_block(Block b) {
+        ::operator delete(b.data, std::align_val_t(ALIGNMENT));
+    }
+
+    Block take(size_t cls) {
+        ThreadCache& tc = thread_cache();
+        if (tc.owner == this && tc.block.floats == cls) {
+            Block b = std::exchange(tc.block, Block{});
+            idle_bytes_.fetch_sub(cls * sizeof(float), std::memory_order_relaxed);
+            reuses_.fetch_add(1, std::memory_order_relaxed);
+            thread_local_hits_.fetch_add(1, std::memory_order_relaxed);
+            return b;
+        }
+        std::lock_guard lock(mutex_);
+        auto it = free_.find(cls);
+        if (it == free_.end() || it->second.empty()) return {};
+        Block b = it->second.back();
+        it->second.pop_back();
+        idle_bytes_.fetch_sub(cls * sizeof(float), std::memory_order_relaxed);
+        reuses_.fetch_add(1, std::memory_order_relaxed);
+        return b;
+    }
+
+    void release(Block b) {
+        leased_bytes_.fetch_sub(b.floats * sizeof(float), std::memory_order_relaxed);
+        if (!reserve_idle(b.floats * sizeof(float))) {
+            frees_.fetch_add(1, std::memory_order_relaxed);
+            free_block(b);
+            return;
+        }
+        ThreadCache& tc = thread_cache();
+        if (!tc.block.data) {
+            tc.owner = this;
+            tc.block = b;
+            return;
+        }
+        release_shared(b);
+    }
+
+    // Put a block already counted as idle on the shared lists
+    void release_shared(Block b) {
+        std::lock_guard lock(mutex_);
+        free_[b.floats].push_back(b);
+    }
+
+    // Count `bytes` more idle memory if that stays within the limit
+    bool reserve_idle(size_t bytes) {
+        size_t idle = idle_bytes_.load(std::memory_order_relaxed);
+        do {
+            if (idle + bytes > max_idle_bytes_) return false;
+        } while (!idle_bytes_.compare_exchange_weak(idle, idle + bytes, std::memory_order_relaxed));
+        return true;
+    }
+
+    mutable std::mutex mutex_;
+    std::map<size_t, std::vector<Block>> free_;   // by size class
+    std::atomic<size_t> idle_bytes_{0};           // free lists + thread caches
+    const size_t max_idle_bytes_;
+    std::atomic<uint64_t> allocations_{0}, reuses_{0}, thread_local_hits_{0}, frees_{0};
+    std::atomic<size_t>   leased_bytes_{0};
+};
+
+// Shared pool for render mix buffers: up to 256 MB kept warm between renders
+inline BufferPool& render_buffer_pool() {
+    static BufferPool pool(size_t(256) << 20);
+    return pool;
+}
+
+// Minor + major page faults taken by the calling thread so far (0 where
+// the platform has no per-thread usage)
+inline long thread_page_faults() {
+#if defined(RUSAGE_THREAD)
+    rusage ru{};
+    if (getrusage(RUSAGE_THREAD, &ru) == 0) return ru.ru_minflt + ru.ru_majflt;
+#endif
+    return 0;
+}
+
+} // namespace renderer
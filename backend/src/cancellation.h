@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+
+// Cooperative cancellation for heavy requests. Work checks its token at
+// checkpoints (every mix block, every window written) and unwinds with
+// Cancelled once the client has gone away, the deadline has passed or the
+// work was cancelled outright; whoever started it removes the partial
+// output on the way out.
+namespace renderer {
+
+class Cancelled : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class CancelToken {
+public:
+    using clock = std::chrono::steady_clock;
+    static constexpr std::chrono::milliseconds PROBE_INTERVAL{50};
+
+    // Deadline `seconds` from now; none when not positive
+    void set_timeout(double seconds) {
+        if (seconds > 0.0)
+            deadline_ = clock::now() + std::chrono::duration_cast<clock::duration>(
+                                           std::chrono::duration<double>(seconds));
+    }
+
+    // Polled, at most every PROBE_INTERVAL and only on the thread doing
+    // the work, for whether it was abandoned (the client hanging up)
+    void set_probe(std::function<bool()> abandoned) { probe_ = std::move(abandoned); }
+
+    // Safe from any thread; the first reason sticks
+    void cancel(const char* reason = "Cancelled") {
+        const char* none = nullptr;
+        reason_.compare_exchange_strong(none, reason, std::memory_order_acq_rel);
+    }
+
+    bool cancelled() {
+        if (reason_.load(std::memory_order_acquire)) return true;
+        const auto now = clock::now();
+        if (now >= deadline_) {
+            cancel("Deadline exceeded");
+            return true;
+        }
+        if (probe_ && now >= next_probe_) {
+            next_probe_ = now + PROBE_INTERVAL;
+            if (probe_()) {
+                cancel("Client disconnected");
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char* reason() const { return reason_.load(std::memory_order_acquire); }
+
+    // Checkpoint: throws Cancelled once the work should stop
+    void check() {
+        if (cancelled()) throw Cancelled(reason());
+    }
+
+private:
+    std::atomic<const char*> reason_{nullptr};
+    clock::time_point        deadline_ = clock::time_point::max();
+    std::function<bool()>    probe_;
+    clock::time_point        next_probe_{};
+};
+
+// Checkpoint for work that may have no token
+inline void checkpoint(CancelToken* token) {
+    if (token) token->check();
+}
+
+} // namespace renderer
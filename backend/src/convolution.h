@@ -0,0 +1,367 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "fft.h"
+
+// Partitioned FFT convolution for long impulse responses.
+//
+// The IR is split in two uniformly partitioned segments (Gardner-style
+// non-uniform partitioning):
+//   head  h[0, TAIL_BLOCK)   HEAD_BLOCK partitions, zero latency
+//   tail  h[TAIL_BLOCK, end) TAIL_BLOCK partitions, computed one block late,
+//                            which the segment offset hides exactly
+// Both run overlap-save with a frequency-domain delay line, so a 3 s IR at
+// 44.1 kHz costs ~40 complex multiply-adds per sample instead of the ~260 a
+// single 512-frame partitioning would need.
+namespace dsp {
+
+constexpr int HEAD_BLOCK = 512;    // matches the renderer's BLOCK_FRAMES
+constexpr int TAIL_BLOCK = 4096;
+
+// ============================================================
+//  IR spectra
+// ============================================================
+
+// One uniformly partitioned slice of an IR: `count` partitions of `block`
+// frames, each stored as the (block + 1)-bin spectrum of a 2*block FFT
+struct IrSegment {
+    int block = 0;
+    int count = 0;
+    std::vector<cpx> spectra;
+
+    const cpx* partition(int p) const { return spectra.data() + (size_t)p * (block + 1); }
+};
+
+inline IrSegment make_ir_segment(const float* ir, int length, int block) {
+    IrSegment seg;
+    seg.block = block;
+    seg.count = length > 0 ? (length + block - 1) / block : 0;
+    seg.spectra.resize((size_t)seg.count * (block + 1));
+
+    auto plan = fft_plan(2 * block);
+    std::vector<float> buf(2 * block);
+    std::vector<cpx> work(2 * block);
+    for (int p = 0; p < seg.count; ++p) {
+        std::fill(buf.begin(), buf.end(), 0.0f);
+        int n = std::min(block, length - p * block);
+        std::copy(ir + (size_t)p * block, ir + (size_t)p * block + n, buf.begin());
+        plan->forward(buf.data(), seg.spectra.data() + (size_t)p * (block + 1), work.data());
+    }
+    return seg;
+}
+
+// Both segments of one IR channel
+struct IrChannel {
+    IrSegment head, tail;
+};
+
+inline IrChannel make_ir_channel(const std::vector<float>& ir) {
+    IrChannel ch;
+    int length = (int)ir.size();
+    ch.head = make_ir_segment(ir.data(), std::min(length, TAIL_BLOCK), HEAD_BLOCK);
+    if (length > TAIL_BLOCK)
+        ch.tail = make_ir_segment(ir.data() + TAIL_BLOCK, length - TAIL_BLOCK, TAIL_BLOCK);
+    return ch;
+}
+
+// ============================================================
+//  Segment convolvers
+// ============================================================
+
+// Complex multiply-accumulate over one partition; split out so the
+// compiler vectorizes it
+inline void spectrum_mac(cpx* acc, const cpx* x, const cpx* h, int bins) {
+    float* a = reinterpret_cast<float*>(acc);
+    const float* xs = reinterpret_cast<const float*>(x);
+    const float* hs = reinterpret_cast<const float*>(h);
+    for (int k = 0; k < bins; ++k) {
+        float xr = xs[2 * k], xi = xs[2 * k + 1];
+        float hr = hs[2 * k], hi = hs[2 * k + 1];
+        a[2 * k]     += xr * hr - xi * hi;
+        a[2 * k + 1] += xr * hi + xi * hr;
+    }
+}
+
+// Overlap-save state shared by both segment kinds: the 2*block input
+// window and a ring of past input spectra (the frequency-domain delay line)
+class SegmentState {
+public:
+    void init(const IrSegment* seg) {
+        seg_   = seg;
+        block_ = seg->block;
+        bins_  = block_ + 1;
+        plan_  = fft_plan(2 * block_);
+        window_.assign(2 * block_, 0.0f);
+        fdl_.assign((size_t)std::max(1, seg->count) * bins_, cpx{});
+        spectrum_.assign(bins_, cpx{});
+        acc_.assign(bins_, cpx{});
+        time_.assign(2 * block_, 0.0f);
+        work_.assign(2 * block_, cpx{});
+        head_ = 0;
+        fill_ = 0;
+    }
+
+protected:
+    void transform_window() { plan_->forward(window_.data(), spectrum_.data(), work_.data()); }
+
+    // acc = sum over partitions p >= first of H[p] * the committed spectrum
+    // (p - newest_partition) blocks older than the newest one
+    void accumulate_history(int first, int newest_partition) {
+        std::fill(acc_.begin(), acc_.end(), cpx{});
+        const int count = seg_->count;
+        for (int p = first; p < count; ++p) {
+            int age = p - newest_partition;
+            int slot = head_ - age;
+            if (slot < 0) slot += count;
+            spectrum_mac(acc_.data(), fdl_.data() + (size_t)slot * bins_, seg_->partition(p), bins_);
+        }
+    }
+
+    void commit_spectrum() {
+        if (seg_->count == 0) return;
+        head_ = (head_ + 1) % seg_->count;
+        std::copy(spectrum_.begin(), spectrum_.end(), fdl_.begin() + (size_t)head_ * bins_);
+    }
+
+    void advance_window() {
+        std::copy(window_.begin() + block_, window_.end(), window_.begin());
+        std::fill(window_.begin() + block_, window_.end(), 0.0f);
+        fill_ = 0;
+    }
+
+    void inverse(const std::vector<cpx>& bins) { plan_->inverse(bins.data(), time_.data(), work_.data()); }
+
+    const IrSegment* seg_ = nullptr;
+    std::shared_ptr<const FftPlan> plan_;
+    int block_ = 0, bins_ = 0;
+    std::vector<float> window_, time_;
+    std::vector<cpx> fdl_, spectrum_, acc_, work_;
+    int head_ = 0;   // FDL slot of the newest committed block
+    int fill_ = 0;   // frames of the current block received
+};
+
+// Head segment: zero latency for any call size. Each call transforms the
+// partly filled window (future frames are zero, so the outputs for frames
+// already received are exact); the history sum is computed once per block.
+class HeadConvolver : public SegmentState {
+public:
+    void init(const IrSegment* seg) {
+        SegmentState::init(seg);
+        history_.assign(bins_, cpx{});
+        sum_.assign(bins_, cpx{});
+    }
+
+    void process(const float* in, float* out, int frames) {
+        while (frames > 0) {
+            int n = std::min(frames, block_ - fill_);
+            std::copy(in, in + n, window_.begin() + block_ + fill_);
+            transform_window();
+
+            std::copy(history_.begin(), history_.end(), sum_.begin());
+            if (seg_->count > 0) spectrum_mac(sum_.data(), spectrum_.data(), seg_->partition(0), bins_);
+            inverse(sum_);
+            std::copy(time_.begin() + block_ + fill_, time_.begin() + block_ + fill_ + n, out);
+
+            fill_ += n;
+            if (fill_ == block_) {
+                commit_spectrum();
+                advance_window();
+                // Partition p pairs with the block p behind the next one
+                accumulate_history(1, 1);
+                history_.swap(acc_);
+            }
+            in += n; out += n; frames -= n;
+        }
+    }
+
+private:
+    std::vector<cpx> history_, sum_;
+};
+
+// Tail segment for IR frames from `block` on: a full block of input is
+// convolved when it completes and played out over the following block,
+// exactly when its first output is due. Adds into `out`.
+class TailConvolver : public SegmentState {
+public:
+    void init(const IrSegment* seg) {
+        SegmentState::init(seg);
+        play_.assign(block_, 0.0f);
+    }
+
+    void process_add(const float* in, float* out, int frames) {
+        while (frames > 0) {
+            int n = std::min(frames, block_ - fill_);
+            for (int i = 0; i < n; ++i) out[i] += play_[fill_ + i];
+            std::copy(in, in + n, window_.begin() + block_ + fill_);
+            fill_ += n;
+            if (fill_ == block_) {
+                transform_window();
+                commit_spectrum();
+                accumulate_history(0, 0);
+                inverse(acc_);
+                std::copy(time_.begin() + block_, time_.end(), play_.begin());
+                advance_window();
+            }
+            in += n; out += n; frames -= n;
+        }
+    }
+
+private:
+    std::vector<float> play_;
+};
+
+// One IR channel: output = input * ir, no latency
+class Convolver {
+public:
+    void init(std::shared_ptr<const IrChannel> ir) {
+        ir_ = std::move(ir);
+        head_.init(&ir_->head);
+        has_tail_ = ir_->tail.count > 0;
+        if (has_tail_) tail_.init(&ir_->tail);
+    }
+
+    void process(const float* in, float* out, int frames) {
+        head_.process(in, out, frames);
+        if (has_tail_) tail_.process_add(in, out, frames);
+    }
+
+private:
+    std::shared_ptr<const IrChannel> ir_;
+    HeadConvolver head_;
+    TailConvolver tail_;
+    bool has_tail_ = false;
+};
+
+// ============================================================
+//  Bundled impulse responses
+// ============================================================
+
+// The bundled rooms are synthesized deterministically rather than shipped
+// as audio: sparse early reflections, then a dense noise tail with an
+// exponential envelope whose high end decays faster than the low end.
+struct RoomModel {
+    const char* name;
+    float rt60;          // seconds
+    float predelay_ms;   // direct sound to first reflection
+    float early_ms;      // span of discrete early reflections
+    int   reflections;
+    float brightness;    // tail lowpass at t = 0, Hz
+    float damping;       // tail lowpass at t = rt60, as a fraction of brightness
+    float seed;
+};
+
+inline const std::vector<RoomModel>& room_models() {
+    static const std::vector<RoomModel> rooms = {
+        {"studio",    0.45f, 2.0f,  25.0f, 10, 9000.0f,  0.35f, 11},
+        {"room",      0.8f,  4.0f,  40.0f, 14, 8000.0f,  0.30f, 23},
+        {"chamber",   1.4f,  8.0f,  60.0f, 18, 7000.0f,  0.25f, 37},
+        {"plate",     2.0f,  0.0f,   0.0f,  0, 12000.0f, 0.50f, 41},
+        {"hall",      2.8f,  15.0f, 90.0f, 24, 6500.0f,  0.20f, 53},
+        {"cathedral", 4.0f,  25.0f, 140.0f, 30, 5000.0f, 0.15f, 67},
+    };
+    return rooms;
+}
+
+inline const RoomModel* find_room(const std::string& name) {
+    for (auto& r : room_models())
+        if (name == r.name) return &r;
+    return nullptr;
+}
+
+struct ImpulseResponse {
+    int sample_rate = 44100;
+    std::vector<float> left, right;
+};
+
+inline ImpulseResponse generate_impulse(const RoomModel& room, int sample_rate) {
+    ImpulseResponse ir;
+    ir.sample_rate = sample_rate;
+    const int length = (int)(room.rt60 * 1.1f * sample_rate);
+    const int predelay = (int)(room.predelay_ms * 0.001f * sample_rate);
+
+    for (int ch = 0; ch < 2; ++ch) {
+        auto& out = ch == 0 ? ir.left : ir.right;
+        out.assign(predelay + length, 0.0f);
+        uint32_t state = (uint32_t)(room.seed * 7919) + ch * 104729u + 1u;
+        auto next = [&] {   // xorshift32, uniform in [-1, 1)
+            state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+            return (float)((double)state / 2147483648.0 - 1.0);
+        };
+
+        // Late tail: -60 dB at rt60, lowpass closing from brightness to
+        // brightness * damping over the same span, 20 ms density build-up
+        const float decay = 6.9078f / (room.rt60 * sample_rate);
+        const int build = (int)(0.02f * sample_rate);
+        float lp = 0.0f, coeff = 0.0f;
+        for (int i = 0; i < length; ++i) {
+            if (i % 64 == 0) {
+                float t = (float)i / (room.rt60 * sample_rate);
+                float fc = room.brightness * std::pow(room.damping, std::min(t, 1.5f));
+                coeff = (float)std::exp(-2.0 * M_PI * fc / sample_rate);
+            }
+            lp = next() * (1.0f - coeff) + lp * coeff;
+            float env = std::exp(-decay * i);
+            if (i < build) env *= (float)i / build;
+            out[predelay + i] = lp * env;
+        }
+
+        // Early reflections: decaying taps of alternating sign
+        const int span = (int)(room.early_ms * 0.001f * sample_rate);
+        for (int r = 0; r < room.reflections && span > 0; ++r) {
+            int at = predelay + (int)((0.5f * (next() + 1.0f)) * span);
+            float gain = 0.6f * std::exp(-3.0f * (float)(at - predelay) / span) * (r % 2 ? -1.0f : 1.0f);
+            out[std::min(at, (int)out.size() - 1)] += gain;
+        }
+    }
+
+    // Unit energy per channel keeps the wet level independent of length
+    for (auto* ch : {&ir.left, &ir.right}) {
+        double energy = 0.0;
+        for (float v : *ch) energy += (double)v * v;
+        if (energy > 0.0) {
+            float g = (float)(1.0 / std::sqrt(energy));
+            for (float& v : *ch) v *= g;
+        }
+    }
+    return ir;
+}
+
+// Partitioned spectra of both IR channels
+struct IrSpectra {
+    std::shared_ptr<const IrChannel> left, right;
+    int length = 0;
+};
+
+inline std::shared_ptr<const IrSpectra> make_ir_spectra(const ImpulseResponse& ir) {
+    auto s = std::make_shared<IrSpectra>();
+    s->left   = std::make_shared<const IrChannel>(make_ir_channel(ir.left));
+    s->right  = std::make_shared<const IrChannel>(make_ir_channel(ir.right));
+    s->length = (int)std::max(ir.left.size(), ir.right.size());
+    return s;
+}
+
+// Bundled IR by name at a sample rate. Generating and transforming a long
+// IR costs far more than rendering with it, so spectra are cached for the
+// life of the process and shared by every render.
+inline std::shared_ptr<const IrSpectra> bundled_ir_spectra(const std::string& name, int sample_rate) {
+    static std::mutex mutex;
+    static std::map<std::pair<std::string, int>, std::shared_ptr<const IrSpectra>> cache;
+
+    const RoomModel* room = find_room(name);
+    if (!room) throw std::invalid_argument("Unknown impulse response: " + name);
+
+    std::lock_guard lock(mutex);
+    auto& entry = cache[{name, sample_rate}];
+    if (!entry) entry = make_ir_spectra(generate_impulse(*room, sample_rate));
+    return entry;
+}
+
+} // namespace dsp
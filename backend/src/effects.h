@@ -0,0 +1,788 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../deps/json.hpp"
+#include "convolution.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CRESCENT_DSP_SSE 1
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#endif
+
+using json = nlohmann::json;
+
+// Block-based effect DSP for server-side renders. Effect types, parameter
+// names and ranges mirror EFFECT_DEFINITIONS / PARAM_RANGES in the
+// frontend's effectChainStore.js, so a chain built in the EffectRack can be
+// sent as-is: [{"type": "Reverb", "params": {"decay": 2.5, ...}, "bypassed": false}]
+// All effects process interleaved stereo in place.
+namespace dsp {
+
+// ============================================================
+//  Denormal protection
+// ============================================================
+
+// Flush-to-zero / denormals-are-zero for the current thread while in scope.
+// Feedback paths (reverb combs, delay lines, filter states) decay into
+// denormals and would otherwise run 10-100x slower on their tails.
+class DenormalGuard {
+public:
+    DenormalGuard() {
+#if defined(CRESCENT_DSP_SSE)
+        saved_ = _mm_getcsr();
+        _mm_setcsr(saved_ | 0x8040);  // FTZ | DAZ
+#elif defined(__aarch64__)
+        uint64_t fpcr;
+        asm volatile("mrs %0, fpcr" : "=r"(fpcr));
+        saved_ = fpcr;
+        asm volatile("msr fpcr, %0" : : "r"(fpcr | (1ull << 24)));  // FZ
+#endif
+    }
+    ~DenormalGuard() {
+#if defined(CRESCENT_DSP_SSE)
+        _mm_setcsr((unsigned)saved_);
+#elif defined(__aarch64__)
+        asm volatile("msr fpcr, %0" : : "r"(saved_));
+#endif
+    }
+    DenormalGuard(const DenormalGuard&) = delete;
+    DenormalGuard& operator=(const DenormalGuard&) = delete;
+
+private:
+    uint64_t saved_ = 0;
+};
+
+// Portable fallback for states kept across blocks
+inline float flush_denormal(float x) { return std::abs(x) < 1e-15f ? 0.0f : x; }
+
+// ============================================================
+//  Shared building blocks
+// ============================================================
+
+constexpr double PI = 3.14159265358979323846;
+
+inline float db_to_gain(float db) { return std::pow(10.0f, db / 20.0f); }
+
+// Equal-power dry/wet crossfade, as Tone.js effects use
+struct WetMix {
+    float dry = 1.0f, wet = 0.0f;
+    void set(float amount) {
+        amount = std::clamp(amount, 0.0f, 1.0f);
+        dry = (float)std::cos(amount * PI / 2);
+        wet = (float)std::sin(amount * PI / 2);
+    }
+    float operator()(float d, float w) const { return d * dry + w * wet; }
+};
+
+// Table sine for LFOs; phase in cycles [0, 1)
+inline float lfo_sin(double phase) {
+    constexpr int N = 1024;
+    static const std::array<float, N + 1> table = [] {
+        std::array<float, N + 1> t{};
+        for (int i = 0; i <= N; ++i) t[i] = (float)std::sin(2.0 * PI * i / N);
+        return t;
+    }();
+    double p = (phase - std::floor(phase)) * N;
+    int i = (int)p;
+    float frac = (float)(p - i);
+    return table[i] + (table[i + 1] - table[i]) * frac;
+}
+
+struct Lfo {
+    double phase = 0.0, inc = 0.0;
+    void set(float hz, int sample_rate) { inc = hz / sample_rate; }
+    // Advance by n frames, returning the phase at the start
+    double advance(int n) {
+        double p = phase;
+        phase += inc * n;
+        phase -= std::floor(phase);
+        return p;
+    }
+};
+
+// Modulated effects recompute coefficients once per control block
+constexpr int CONTROL_FRAMES = 32;
+
+// ============================================================
+//  Biquad filters (RBJ cookbook), SIMD over the stereo pair
+// ============================================================
+
+struct BiquadCoeffs {
+    float b0 = 1, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+};
+
+namespace biquad {
+
+inline BiquadCoeffs normalize(double b0, double b1, double b2, double a0, double a1, double a2) {
+    return {(float)(b0 / a0), (float)(b1 / a0), (float)(b2 / a0), (float)(a1 / a0), (float)(a2 / a0)};
+}
+
+inline BiquadCoeffs lowpass(double fs, double f, double q) {
+    double w = 2 * PI * std::clamp(f, 10.0, fs * 0.49) / fs, c = std::cos(w), alpha = std::sin(w) / (2 * q);
+    return normalize((1 - c) / 2, 1 - c, (1 - c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+inline BiquadCoeffs highpass(double fs, double f, double q) {
+    double w = 2 * PI * std::clamp(f, 10.0, fs * 0.49) / fs, c = std::cos(w), alpha = std::sin(w) / (2 * q);
+    return normalize((1 + c) / 2, -(1 + c), (1 + c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+// Constant 0 dB peak gain
+inline BiquadCoeffs bandpass(double fs, double f, double q) {
+    double w = 2 * PI * std::clamp(f, 10.0, fs * 0.49) / fs, c = std::cos(w), alpha = std::sin(w) / (2 * q);
+    return normalize(alpha, 0, -alpha, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+inline BiquadCoeffs allpass(double fs, double f, double q) {
+    double w = 2 * PI * std::clamp(f, 10.0, fs * 0.49) / fs, c = std::cos(w), alpha = std::sin(w) / (2 * q);
+    return normalize(1 - alpha, -2 * c, 1 + alpha, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+inline BiquadCoeffs peaking(double fs, double f, double q, double gain_db) {
+    double A = std::pow(10.0, gain_db / 40), w = 2 * PI * std::clamp(f, 10.0, fs * 0.49) / fs;
+    double c = std::cos(w), alpha = std::sin(w) / (2 * q);
+    return normalize(1 + alpha * A, -2 * c, 1 - alpha * A, 1 + alpha / A, -2 * c, 1 - alpha / A);
+}
+
+inline BiquadCoeffs lowshelf(double fs, double f, double gain_db) {
+    double A = std::pow(10.0, gain_db / 40), w = 2 * PI * std::clamp(f, 10.0, fs * 0.49) / fs;
+    double c = std::cos(w), alpha = std::sin(w) / 2 * std::sqrt(2.0), sa = 2 * std::sqrt(A) * alpha;
+    return normalize(A * ((A + 1) - (A - 1) * c + sa), 2 * A * ((A - 1) - (A + 1) * c),
+                     A * ((A + 1) - (A - 1) * c - sa), (A + 1) + (A - 1) * c + sa,
+                     -2 * ((A - 1) + (A + 1) * c), (A + 1) + (A - 1) * c - sa);
+}
+
+inline BiquadCoeffs highshelf(double fs, double f, double gain_db) {
+    double A = std::pow(10.0, gain_db / 40), w = 2 * PI * std::clamp(f, 10.0, fs * 0.49) / fs;
+    double c = std::cos(w), alpha = std::sin(w) / 2 * std::sqrt(2.0), sa = 2 * std::sqrt(A) * alpha;
+    return normalize(A * ((A + 1) + (A - 1) * c + sa), -2 * A * ((A - 1) + (A + 1) * c),
+                     A * ((A + 1) + (A - 1) * c - sa), (A + 1) - (A - 1) * c + sa,
+                     2 * ((A - 1) - (A + 1) * c), (A + 1) - (A - 1) * c - sa);
+}
+
+} // namespace biquad
+
+// Transposed direct form II biquad running left and right in SIMD lanes.
+// Each lane may have its own coefficients (used by the stereo-spread LFO
+// effects); static filters just set both lanes the same.
+class StereoBiquad {
+public:
+    void set(const BiquadCoeffs& c) { set(c, c); }
+
+    void set(const BiquadCoeffs& l, const BiquadCoeffs& r) {
+#if defined(CRESCENT_DSP_SSE)
+        b0_ = _mm_setr_ps(l.b0, r.b0, 0, 0);
+        b1_ = _mm_setr_ps(l.b1, r.b1, 0, 0);
+        b2_ = _mm_setr_ps(l.b2, r.b2, 0, 0);
+        a1_ = _mm_setr_ps(l.a1, r.a1, 0, 0);
+        a2_ = _mm_setr_ps(l.a2, r.a2, 0, 0);
+#else
+        c_[0] = l;
+        c_[1] = r;
+#endif
+    }
+
+    void process(float* lr, int frames) {
+#if defined(CRESCENT_DSP_SSE)
+        __m128 z1 = z1_, z2 = z2_;
+        for (int i = 0; i < frames; ++i) {
+            double* p = reinterpret_cast<double*>(lr + i * 2);
+            __m128 x = _mm_castpd_ps(_mm_load_sd(p));
+            __m128 y = _mm_add_ps(_mm_mul_ps(b0_, x), z1);
+            z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1_, x), _mm_mul_ps(a1_, y)), z2);
+            z2 = _mm_sub_ps(_mm_mul_ps(b2_, x), _mm_mul_ps(a2_, y));
+            _mm_store_sd(p, _mm_castps_pd(y));
+        }
+        z1_ = z1;
+        z2_ = z2;
+#else
+        for (int ch = 0; ch < 2; ++ch) {
+            const BiquadCoeffs& c = c_[ch];
+            float z1 = z1_[ch], z2 = z2_[ch];
+            for (int i = 0; i < frames; ++i) {
+                float x = lr[i * 2 + ch];
+                float y = c.b0 * x + z1;
+                z1 = c.b1 * x - c.a1 * y + z2;
+                z2 = c.b2 * x - c.a2 * y;
+                lr[i * 2 + ch] = y;
+            }
+            z1_[ch] = flush_denormal(z1);
+            z2_[ch] = flush_denormal(z2);
+        }
+#endif
+    }
+
+private:
+#if defined(CRESCENT_DSP_SSE)
+    __m128 b0_ = _mm_setr_ps(1, 1, 0, 0), b1_ = _mm_setzero_ps(), b2_ = _mm_setzero_ps();
+    __m128 a1_ = _mm_setzero_ps(), a2_ = _mm_setzero_ps();
+    __m128 z1_ = _mm_setzero_ps(), z2_ = _mm_setzero_ps();
+#else
+    BiquadCoeffs c_[2];
+    float z1_[2] = {0, 0}, z2_[2] = {0, 0};
+#endif
+};
+
+// Interleaved stereo delay line with fractional reads
+class StereoDelay {
+public:
+    void init(int max_frames) {
+        size_ = max_frames + 2;
+        buf_.assign(size_ * 2, 0.0f);
+        pos_ = 0;
+    }
+
+    // Sample `delay` frames behind the write head (before this frame's write)
+    void read(float delay, float& l, float& r) const {
+        float d = std::clamp(delay, 1.0f, (float)(size_ - 2));
+        int di = (int)d;
+        float frac = d - di;
+        int i0 = pos_ - di;     if (i0 < 0) i0 += size_;
+        int i1 = i0 - 1;        if (i1 < 0) i1 += size_;
+        l = buf_[i0 * 2]     + (buf_[i1 * 2]     - buf_[i0 * 2])     * frac;
+        r = buf_[i0 * 2 + 1] + (buf_[i1 * 2 + 1] - buf_[i0 * 2 + 1]) * frac;
+    }
+
+    void write(float l, float r) {
+        buf_[pos_ * 2]     = l;
+        buf_[pos_ * 2 + 1] = r;
+        if (++pos_ == size_) pos_ = 0;
+    }
+
+private:
+    std::vector<float> buf_;
+    int size_ = 0, pos_ = 0;
+};
+
+// ============================================================
+//  Effect parameters (mirrors PARAM_RANGES in effectChainStore.js)
+// ============================================================
+
+struct ParamSpec {
+    const char* name;
+    float min, max, def;
+};
+
+inline const std::map<std::string, std::vector<ParamSpec>>& effect_definitions() {
+    static const std::map<std::string, std::vector<ParamSpec>> defs = {
+        {"EQ3",           {{"low", -24, 24, 0}, {"mid", -24, 24, 0}, {"high", -24, 24, 0},
+                           {"lowFrequency", 60, 1000, 400}, {"highFrequency", 1000, 8000, 2500}}},
+        {"Reverb",        {{"decay", 0.1f, 10, 2.5f}, {"wet", 0, 1, 0.4f}, {"preDelay", 0, 0.5f, 0.01f}}},
+        {"Compressor",    {{"threshold", -60, 0, -24}, {"ratio", 1, 20, 4},
+                           {"attack", 0.001f, 1, 0.003f}, {"release", 0.01f, 1, 0.25f}}},
+        {"FeedbackDelay", {{"delayTime", 0.01f, 1, 0.25f}, {"feedback", 0, 0.95f, 0.3f}, {"wet", 0, 1, 0.3f}}},
+        {"Distortion",    {{"distortion", 0, 1, 0.4f}, {"wet", 0, 1, 0.5f}}},
+        {"Chorus",        {{"frequency", 0.1f, 10, 1.5f}, {"delayTime", 0.5f, 20, 3.5f},
+                           {"depth", 0, 1, 0.7f}, {"wet", 0, 1, 0.5f}}},
+        {"Phaser",        {{"frequency", 0.1f, 10, 0.5f}, {"octaves", 1, 6, 3},
+                           {"baseFrequency", 100, 2000, 350}, {"wet", 0, 1, 0.5f}}},
+        {"PingPongDelay", {{"delayTime", 0.01f, 1, 0.2f}, {"feedback", 0, 0.95f, 0.3f}, {"wet", 0, 1, 0.3f}}},
+        {"BitCrusher",    {{"bits", 1, 16, 8}, {"wet", 0, 1, 0.5f}}},
+        {"Tremolo",       {{"frequency", 0.1f, 20, 4}, {"depth", 0, 1, 0.6f}, {"wet", 0, 1, 0.5f}}},
+        {"AutoFilter",    {{"frequency", 0.1f, 10, 1}, {"baseFrequency", 60, 2000, 200},
+                           {"octaves", 0.5f, 8, 2.6f}, {"wet", 0, 1, 0.5f}}},
+        {"AutoPanner",    {{"frequency", 0.1f, 10, 1}, {"depth", 0, 1, 1}, {"wet", 0, 1, 0.5f}}},
+        // Server-only: convolution with a bundled room, picked by params.impulse
+        {"ConvolutionReverb", {{"wet", 0, 1, 0.3f}, {"preDelay", 0, 0.5f, 0}}},
+    };
+    return defs;
+}
+
+struct EffectSpec {
+    std::string type;
+    std::map<std::string, float> params;   // every parameter, defaulted and clamped
+    std::string impulse;                   // ConvolutionReverb room name
+
+    float get(const std::string& name) const { return params.at(name); }
+};
+
+// Validates the type and clamps parameters into range; throws
+// std::invalid_argument for unknown effect types
+inline EffectSpec effect_spec_from_json(const json& j) {
+    auto type = j.value("type", std::string());
+    auto& defs = effect_definitions();
+    auto it = defs.find(type);
+    if (it == defs.end()) throw std::invalid_argument("Unknown effect type: " + type);
+
+    EffectSpec spec{type, {}, {}};
+    const json params = j.contains("params") && j["params"].is_object() ? j["params"] : json::object();
+    for (auto& p : it->second) {
+        float v = p.def;
+        if (params.contains(p.name) && params[p.name].is_number()) v = params[p.name].get<float>();
+        spec.params[p.name] = std::clamp(v, p.min, p.max);
+    }
+    if (type == "ConvolutionReverb") {
+        spec.impulse = params.value("impulse", std::string("hall"));
+        if (!find_room(spec.impulse))
+            throw std::invalid_argument("Unknown impulse response: " + spec.impulse);
+    }
+    return spec;
+}
+
+// Bypassed entries are dropped
+inline std::vector<EffectSpec> effect_chain_from_json(const json& arr) {
+    std::vector<EffectSpec> chain;
+    if (!arr.is_array()) return chain;
+    for (auto& e : arr) {
+        if (e.value("bypassed", false)) continue;
+        chain.push_back(effect_spec_from_json(e));
+    }
+    return chain;
+}
+
+// Normalized form (every parameter spelled out), so equal chains compare
+// equal however they were written
+inline json effect_chain_to_json(const std::vector<EffectSpec>& chain) {
+    json arr = json::array();
+    for (auto& s : chain) {
+        json e = {{"type", s.type}, {"params", s.params}};
+        if (!s.impulse.empty()) e["params"]["impulse"] = s.impulse;
+        arr.push_back(std::move(e));
+    }
+    return arr;
+}
+
+// ============================================================
+//  Effects
+// ============================================================
+
+class Effect {
+public:
+    virtual ~Effect() = default;
+    // In place, interleaved stereo
+    virtual void process(float* lr, int frames) = 0;
+};
+
+class EQ3 : public Effect {
+public:
+    EQ3(const EffectSpec& s, int fs) {
+        float lo = s.get("lowFrequency"), hi = s.get("highFrequency");
+        low_.set(biquad::lowshelf(fs, lo, s.get("low")));
+        mid_.set(biquad::peaking(fs, std::sqrt(lo * hi), 0.5, s.get("mid")));
+        high_.set(biquad::highshelf(fs, hi, s.get("high")));
+    }
+    void process(float* lr, int frames) override {
+        low_.process(lr, frames);
+        mid_.process(lr, frames);
+        high_.process(lr, frames);
+    }
+private:
+    StereoBiquad low_, mid_, high_;
+};
+
+// Feed-forward, stereo-linked, soft knee (Tone.Compressor's 30 dB default)
+class Compressor : public Effect {
+public:
+    Compressor(const EffectSpec& s, int fs)
+        : threshold_(s.get("threshold")), ratio_(s.get("ratio")),
+          attack_((float)std::exp(-1.0 / (s.get("attack") * fs))),
+          release_((float)std::exp(-1.0 / (s.get("release") * fs))) {}
+
+    void process(float* lr, int frames) override {
+        for (int i = 0; i < frames; ++i) {
+            float level = std::max(std::abs(lr[i * 2]), std::abs(lr[i * 2 + 1]));
+            float x = 20.0f * std::log10(std::max(level, 1e-9f));
+            float over = x - threshold_;
+            float y;
+            if (2 * over < -KNEE)                 y = x;
+            else if (2 * std::abs(over) <= KNEE)  y = x + (1 / ratio_ - 1) * (over + KNEE / 2) * (over + KNEE / 2) / (2 * KNEE);
+            else                                  y = threshold_ + over / ratio_;
+            float target = x - y;   // gain reduction in dB, >= 0
+            float coeff = target > reduction_ ? attack_ : release_;
+            reduction_ = target + (reduction_ - target) * coeff;
+            float g = db_to_gain(-reduction_);
+            lr[i * 2]     *= g;
+            lr[i * 2 + 1] *= g;
+        }
+    }
+private:
+    static constexpr float KNEE = 30.0f;
+    float threshold_, ratio_, attack_, release_;
+    float reduction_ = 0.0f;
+};
+
+class FeedbackDelay : public Effect {
+public:
+    FeedbackDelay(const EffectSpec& s, int fs)
+        : delay_(s.get("delayTime") * fs), feedback_(s.get("feedback")) {
+        line_.init((int)delay_ + 2);
+        mix_.set(s.get("wet"));
+    }
+    void process(float* lr, int frames) override {
+        for (int i = 0; i < frames; ++i) {
+            float dl, dr;
+            line_.read(delay_, dl, dr);
+            float l = lr[i * 2], r = lr[i * 2 + 1];
+            line_.write(l + dl * feedback_, r + dr * feedback_);
+            lr[i * 2]     = mix_(l, dl);
+            lr[i * 2 + 1] = mix_(r, dr);
+        }
+    }
+private:
+    StereoDelay line_;
+    float delay_, feedback_;
+    WetMix mix_;
+};
+
+// Mono input bounces left -> right -> left
+class PingPongDelay : public Effect {
+public:
+    PingPongDelay(const EffectSpec& s, int fs)
+        : delay_(s.get("delayTime") * fs), feedback_(s.get("feedback")) {
+        line_.init((int)delay_ + 2);
+        mix_.set(s.get("wet"));
+    }
+    void process(float* lr, int frames) override {
+        for (int i = 0; i < frames; ++i) {
+            float dl, dr;
+            line_.read(delay_, dl, dr);
+            float l = lr[i * 2], r = lr[i * 2 + 1];
+            line_.write((l + r) * 0.5f + dr * feedback_, dl);
+            lr[i * 2]     = mix_(l, dl);
+            lr[i * 2 + 1] = mix_(r, dr);
+        }
+    }
+private:
+    StereoDelay line_;
+    float delay_, feedback_;
+    WetMix mix_;
+};
+
+// Tone.Distortion's waveshaper curve
+class Distortion : public Effect {
+public:
+    Distortion(const EffectSpec& s, int) : k_(s.get("distortion") * 100.0f) { mix_.set(s.get("wet")); }
+    void process(float* lr, int frames) override {
+        const float deg = (float)(PI / 180.0);
+        for (int i = 0; i < frames * 2; ++i) {
+            float x = std::clamp(lr[i], -1.0f, 1.0f);
+            float y = (3 + k_) * x * 20 * deg / ((float)PI + k_ * std::abs(x));
+            lr[i] = mix_(lr[i], y);
+        }
+    }
+private:
+    float k_;
+    WetMix mix_;
+};
+
+class BitCrusher : public Effect {
+public:
+    BitCrusher(const EffectSpec& s, int) : step_(std::pow(0.5f, std::round(s.get("bits")) - 1)) {
+        mix_.set(s.get("wet"));
+    }
+    void process(float* lr, int frames) override {
+        for (int i = 0; i < frames * 2; ++i)
+            lr[i] = mix_(lr[i], step_ * std::floor(lr[i] / step_ + 0.5f));
+    }
+private:
+    float step_;
+    WetMix mix_;
+};
+
+// LFO-modulated short delay; channels 180 degrees apart
+class Chorus : public Effect {
+public:
+    Chorus(const EffectSpec& s, int fs)
+        : base_(s.get("delayTime") * 0.001f * fs), depth_(s.get("depth")) {
+        lfo_.set(s.get("frequency"), fs);
+        line_.init((int)(base_ * 2) + 4);
+        mix_.set(s.get("wet"));
+    }
+    void process(float* lr, int frames) override {
+        for (int i = 0; i < frames; ++i) {
+            double p = lfo_.advance(1);
+            float dl_time = base_ * (1.0f + 0.5f * depth_ * lfo_sin(p));
+            float dr_time = base_ * (1.0f + 0.5f * depth_ * lfo_sin(p + 0.5));
+            float dl, dr, tmp;
+            line_.read(dl_time, dl, tmp);
+            line_.read(dr_time, tmp, dr);
+            float l = lr[i * 2], r = lr[i * 2 + 1];
+            line_.write(l, r);
+            lr[i * 2]     = mix_(l, dl);
+            lr[i * 2 + 1] = mix_(r, dr);
+        }
+    }
+private:
+    StereoDelay line_;
+    Lfo lfo_;
+    float base_, depth_;
+    WetMix mix_;
+};
+
+// Allpass cascade swept from baseFrequency up `octaves`
+class Phaser : public Effect {
+public:
+    Phaser(const EffectSpec& s, int fs)
+        : fs_(fs), base_(s.get("baseFrequency")), octaves_(s.get("octaves")) {
+        lfo_.set(s.get("frequency"), fs);
+        mix_.set(s.get("wet"));
+    }
+    void process(float* lr, int frames) override {
+        float wet[CONTROL_FRAMES * 2];
+        for (int at = 0; at < frames; at += CONTROL_FRAMES) {
+            int n = std::min(CONTROL_FRAMES, frames - at);
+            double p = lfo_.advance(n);
+            float fl = base_ * std::pow(2.0f, octaves_ * (0.5f + 0.5f * lfo_sin(p)));
+            float fr = base_ * std::pow(2.0f, octaves_ * (0.5f + 0.5f * lfo_sin(p + 0.5)));
+            auto cl = biquad::allpass(fs_, fl, Q), cr = biquad::allpass(fs_, fr, Q);
+            std::copy(lr + at * 2, lr + (at + n) * 2, wet);
+            for (auto& stage : stages_) {
+                stage.set(cl, cr);
+                stage.process(wet, n);
+            }
+            for (int i = 0; i < n * 2; ++i) lr[at * 2 + i] = mix_(lr[at * 2 + i], wet[i]);
+        }
+    }
+private:
+    static constexpr double Q = 10.0;   // Tone.Phaser default
+    std::array<StereoBiquad, 4> stages_;
+    Lfo lfo_;
+    int fs_;
+    float base_, octaves_;
+    WetMix mix_;
+};
+
+class AutoFilter : public Effect {
+public:
+    AutoFilter(const EffectSpec& s, int fs)
+        : fs_(fs), base_(s.get("baseFrequency")), octaves_(s.get("octaves")) {
+        lfo_.set(s.get("frequency"), fs);
+        mix_.set(s.get("wet"));
+    }
+    void process(float* lr, int frames) override {
+        float wet[CONTROL_FRAMES * 2];
+        for (int at = 0; at < frames; at += CONTROL_FRAMES) {
+            int n = std::min(CONTROL_FRAMES, frames - at);
+            double p = lfo_.advance(n);
+            float fl = base_ * std::pow(2.0f, octaves_ * (0.5f + 0.5f * lfo_sin(p)));
+            float fr = base_ * std::pow(2.0f, octaves_ * (0.5f + 0.5f * lfo_sin(p + 0.5)));
+            filter_.set(biquad::lowpass(fs_, fl, 1.0), biquad::lowpass(fs_, fr, 1.0));
+            std::copy(lr + at * 2, lr + (at + n) * 2, wet);
+            filter_.process(wet, n);
+            for (int i = 0; i < n * 2; ++i) lr[at * 2 + i] = mix_(lr[at * 2 + i], wet[i]);
+        }
+    }
+private:
+    StereoBiquad filter_;
+    Lfo lfo_;
+    int fs_;
+    float base_, octaves_;
+    WetMix mix_;
+};
+
+class Tremolo : public Effect {
+public:
+    Tremolo(const EffectSpec& s, int fs) : depth_(s.get("depth")) {
+        lfo_.set(s.get("frequency"), fs);
+        mix_.set(s.get("wet"));
+    }
+    void process(float* lr, int frames) override {
+        for (int i = 0; i < frames; ++i) {
+            double p = lfo_.advance(1);
+            float gl = 1.0f - depth_ * (0.5f + 0.5f * lfo_sin(p));
+            float gr = 1.0f - depth_ * (0.5f + 0.5f * lfo_sin(p + 0.5));
+            lr[i * 2]     = mix_(lr[i * 2],     lr[i * 2] * gl);
+            lr[i * 2 + 1] = mix_(lr[i * 2 + 1], lr[i * 2 + 1] * gr);
+        }
+    }
+private:
+    Lfo lfo_;
+    float depth_;
+    WetMix mix_;
+};
+
+class AutoPanner : public Effect {
+public:
+    AutoPanner(const EffectSpec& s, int fs) : depth_(s.get("depth")) {
+        lfo_.set(s.get("frequency"), fs);
+        mix_.set(s.get("wet"));
+    }
+    void process(float* lr, int frames) override {
+        for (int at = 0; at < frames; at += CONTROL_FRAMES) {
+            int n = std::min(CONTROL_FRAMES, frames - at);
+            float pan = depth_ * lfo_sin(lfo_.advance(n));
+            double angle = (pan + 1.0) * PI / 4;
+            float gl = (float)(std::cos(angle) * std::sqrt(2.0));
+            float gr = (float)(std::sin(angle) * std::sqrt(2.0));
+            for (int i = at; i < at + n; ++i) {
+                lr[i * 2]     = mix_(lr[i * 2],     lr[i * 2] * gl);
+                lr[i * 2 + 1] = mix_(lr[i * 2 + 1], lr[i * 2 + 1] * gr);
+            }
+        }
+    }
+private:
+    Lfo lfo_;
+    float depth_;
+    WetMix mix_;
+};
+
+// Freeverb-style comb/allpass network; comb feedback is derived from
+// `decay` as an RT60 so the parameter means the same as Tone.Reverb's
+class Reverb : public Effect {
+public:
+    Reverb(const EffectSpec& s, int fs) {
+        double scale = fs / 44100.0;
+        float decay = s.get("decay");
+        static const int comb_tuning[8] = {1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617};
+        static const int ap_tuning[4]   = {556, 441, 341, 225};
+        for (int ch = 0; ch < 2; ++ch) {
+            int spread = ch * 23;
+            for (int c = 0; c < 8; ++c) {
+                auto& comb = combs_[ch][c];
+                comb.buf.assign((size_t)((comb_tuning[c] + spread) * scale), 0.0f);
+                comb.feedback = (float)std::pow(10.0, -3.0 * comb.buf.size() / (decay * fs));
+            }
+            for (int a = 0; a < 4; ++a)
+                allpasses_[ch][a].buf.assign((size_t)((ap_tuning[a] + spread) * scale), 0.0f);
+        }
+        predelay_frames_ = std::max(1.0f, s.get("preDelay") * fs);
+        predelay_.init((int)predelay_frames_ + 2);
+        mix_.set(s.get("wet"));
+    }
+
+    void process(float* lr, int frames) override {
+        for (int i = 0; i < frames; ++i) {
+            float pl, pr;
+            predelay_.read(predelay_frames_, pl, pr);
+            predelay_.write(lr[i * 2], lr[i * 2 + 1]);
+            float in = (pl + pr) * INPUT_GAIN;
+            float out[2];
+            for (int ch = 0; ch < 2; ++ch) {
+                float acc = 0.0f;
+                for (auto& comb : combs_[ch]) acc += comb.tick(in);
+                for (auto& ap : allpasses_[ch]) acc = ap.tick(acc);
+                out[ch] = acc;
+            }
+            lr[i * 2]     = mix_(lr[i * 2],     out[0] * WET_SCALE);
+            lr[i * 2 + 1] = mix_(lr[i * 2 + 1], out[1] * WET_SCALE);
+        }
+    }
+
+private:
+    static constexpr float INPUT_GAIN = 0.015f;
+    static constexpr float WET_SCALE  = 3.0f;
+    static constexpr float DAMP = 0.2f;
+
+    struct Comb {
+        std::vector<float> buf;
+        size_t pos = 0;
+        float feedback = 0.8f, store = 0.0f;
+        float tick(float x) {
+            float y = buf[pos];
+            store = flush_denormal(y * (1 - DAMP) + store * DAMP);
+            buf[pos] = x + store * feedback;
+            if (++pos == buf.size()) pos = 0;
+            return y;
+        }
+    };
+    struct Allpass {
+        std::vector<float> buf;
+        size_t pos = 0;
+        float tick(float x) {
+            float b = buf[pos];
+            buf[pos] = flush_denormal(x + b * 0.5f);
+            if (++pos == buf.size()) pos = 0;
+            return b - x;
+        }
+    };
+
+    std::array<std::array<Comb, 8>, 2>    combs_;
+    std::array<std::array<Allpass, 4>, 2> allpasses_;
+    StereoDelay predelay_;
+    float predelay_frames_;
+    WetMix mix_;
+};
+
+// Stereo convolution with a bundled IR (left and right IRs decorrelated).
+// IR spectra come from the process-wide cache, so only the first render at
+// a given sample rate pays for generating and transforming the room.
+class ConvolutionReverb : public Effect {
+public:
+    ConvolutionReverb(const EffectSpec& s, int fs) {
+        ir_ = bundled_ir_spectra(s.impulse, fs);
+        left_.init(ir_->left);
+        right_.init(ir_->right);
+        predelay_frames_ = s.get("preDelay") * fs;
+        if (predelay_frames_ >= 1.0f) predelay_.init((int)predelay_frames_ + 2);
+        mix_.set(s.get("wet"));
+        for (auto* b : {&in_l_, &in_r_, &out_l_, &out_r_}) b->assign(HEAD_BLOCK, 0.0f);
+    }
+
+    void process(float* lr, int frames) override {
+        for (int done = 0; done < frames; done += HEAD_BLOCK) {
+            int n = std::min(HEAD_BLOCK, frames - done);
+            float* block = lr + done * 2;
+            for (int i = 0; i < n; ++i) {
+                float l = block[i * 2], r = block[i * 2 + 1];
+                if (predelay_frames_ >= 1.0f) {
+                    predelay_.read(predelay_frames_, l, r);
+                    predelay_.write(block[i * 2], block[i * 2 + 1]);
+                }
+                in_l_[i] = l;
+                in_r_[i] = r;
+            }
+            left_.process(in_l_.data(), out_l_.data(), n);
+            right_.process(in_r_.data(), out_r_.data(), n);
+            for (int i = 0; i < n; ++i) {
+                block[i * 2]     = mix_(block[i * 2],     out_l_[i]);
+                block[i * 2 + 1] = mix_(block[i * 2 + 1], out_r_[i]);
+            }
+        }
+    }
+
+private:
+    std::shared_ptr<const IrSpectra> ir_;
+    Convolver left_, right_;
+    StereoDelay predelay_;
+    float predelay_frames_;
+    WetMix mix_;
+    std::vector<float> in_l_, in_r_, out_l_, out_r_;
+};
+
+inline std::unique_ptr<Effect> make_effect(const EffectSpec& s, int sample_rate) {
+    if (s.type == "EQ3")           return std::make_unique<EQ3>(s, sample_rate);
+    if (s.type == "Reverb")        return std::make_unique<Reverb>(s, sample_rate);
+    if (s.type == "Compressor")    return std::make_unique<Compressor>(s, sample_rate);
+    if (s.type == "FeedbackDelay") return std::make_unique<FeedbackDelay>(s, sample_rate);
+    if (s.type == "Distortion")    return std::make_unique<Distortion>(s, sample_rate);
+    if (s.type == "Chorus")        return std::make_unique<Chorus>(s, sample_rate);
+    if (s.type == "Phaser")        return std::make_unique<Phaser>(s, sample_rate);
+    if (s.type == "PingPongDelay") return std::make_unique<PingPongDelay>(s, sample_rate);
+    if (s.type == "BitCrusher")    return std::make_unique<BitCrusher>(s, sample_rate);
+    if (s.type == "Tremolo")       return std::make_unique<Tremolo>(s, sample_rate);
+    if (s.type == "AutoFilter")    return std::make_unique<AutoFilter>(s, sample_rate);
+    if (s.type == "AutoPanner")    return std::make_unique<AutoPanner>(s, sample_rate);
+    if (s.type == "ConvolutionReverb") return std::make_unique<ConvolutionReverb>(s, sample_rate);
+    throw std::invalid_argument("Unknown effect type: " + s.type);
+}
+
+// ============================================================
+//  Effect chain
+// ============================================================
+
+class EffectChain {
+public:
+    EffectChain() = default;
+    EffectChain(const std::vector<EffectSpec>& specs, int sample_rate) {
+        for (auto& s : specs) effects_.push_back(make_effect(s, sample_rate));
+    }
+
+    void process(float* lr, int frames) {
+        for (auto& e : effects_) e->process(lr, frames);
+    }
+
+    bool empty() const { return effects_.empty(); }
+
+private:
+    std::vector<std::unique_ptr<Effect>> effects_;
+};
+
+} // namespace dsp
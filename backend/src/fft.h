@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+// In-tree real FFT for the offline renderer (convolution, time-stretch).
+// A size-n real transform runs as a size-n/2 complex Stockham FFT using
+// radix-4 passes plus one radix-2 pass when n/2 is not a power of four,
+// followed by the usual even/odd split. Plans hold every twiddle factor and
+// are immutable, so one cached plan serves all threads.
+namespace dsp {
+
+using cpx = std::complex<float>;
+
+class FftPlan {
+public:
+    // n: power of two, >= 4
+    explicit FftPlan(int n) : n_(n), m_(n / 2) {
+        if (n < 4 || (n & (n - 1)) != 0)
+            throw std::invalid_argument("FFT size must be a power of two >= 4");
+        tw_.resize(m_);
+        for (int k = 0; k < m_; ++k)
+            tw_[k] = std::polar(1.0, -2.0 * M_PI * k / m_);
+        split_.resize(m_ + 1);
+        for (int k = 0; k <= m_; ++k)
+            split_[k] = std::polar(1.0, -2.0 * M_PI * k / n_);
+    }
+
+    int size() const { return n_; }
+    int bins() const { return m_ + 1; }
+
+    // n real samples -> n/2 + 1 bins. `work` holds n complex values.
+    void forward(const float* in, cpx* out, cpx* work) const {
+        cpx* z = work;
+        for (int k = 0; k < m_; ++k) z[k] = cpx(in[2 * k], in[2 * k + 1]);
+        complex_fft(z, work + m_);
+
+        for (int k = 0; k <= m_; ++k) {
+            cpx zk = z[k % m_];
+            cpx zc = std::conj(z[(m_ - k) % m_]);
+            cpx even = (zk + zc) * 0.5f;
+            cpx odd  = (zk - zc) * cpx(0.0f, -0.5f);
+            out[k] = even + split_[k] * odd;
+        }
+    }
+
+    // n/2 + 1 bins -> n real samples; inverse(forward(x)) == x.
+    // `work` holds n complex values.
+    void inverse(const cpx* in, float* out, cpx* work) const {
+        cpx* z = work;
+        const float scale = 1.0f / n_;
+        for (int k = 0; k < m_; ++k) {
+            cpx xc = std::conj(in[m_ - k]);
+            cpx even = (in[k] + xc);
+            cpx odd  = (in[k] - xc) * std::conj(split_[k]);
+            // Inverse via the conjugate trick: conj(FFT(conj(Z)))
+            z[k] = std::conj((even + cpx(0.0f, 1.0f) * odd) * scale);
+        }
+        complex_fft(z, work + m_);
+        for (int k = 0; k < m_; ++k) {
+            out[2 * k]     =  z[k].real();
+            out[2 * k + 1] = -z[k].imag();
+        }
+    }
+
+private:
+    // Forward complex FFT of size m_, in place in `x`, `y` is scratch
+    void complex_fft(cpx* x, cpx* y) const {
+        int n = m_, s = 1;
+        cpx* src = x;
+        cpx* dst = y;
+        while (n >= 4) {
+            const int n1 = n / 4;
+            for (int p = 0; p < n1; ++p) {
+                const cpx w1 = tw_[p * s], w2 = tw_[2 * p * s], w3 = tw_[3 * p * s];
+                for (int q = 0; q < s; ++q) {
+                    const cpx a = src[q + s * p],          b = src[q + s * (p + n1)];
+                    const cpx c = src[q + s * (p + 2 * n1)], d = src[q + s * (p + 3 * n1)];
+                    const cpx apc = a + c, amc = a - c, bpd = b + d;
+                    const cpx jbmd(-(b - d).imag(), (b - d).real());
+                    dst[q + s * (4 * p)]     = apc + bpd;
+                    dst[q + s * (4 * p + 1)] = w1 * (amc - jbmd);
+                    dst[q + s * (4 * p + 2)] = w2 * (apc - bpd);
+                    dst[q + s * (4 * p + 3)] = w3 * (amc + jbmd);
+                }
+            }
+            std::swap(src, dst);
+            n = n1;
+            s *= 4;
+        }
+        if (n == 2) {
+            for (int q = 0; q < s; ++q) {
+                const cpx a = src[q], b = src[q + s];
+                src[q]     = a + b;
+                src[q + s] = a - b;
+            }
+        }
+        if (src != x) std::copy(src, src + m_, x);
+    }
+
+    int n_, m_;
+    std::vector<cpx> tw_;      // exp(-2 pi i k / m), k < m
+    std::vector<cpx> split_;   // exp(-2 pi i k / n), k <= m
+};
+
+// Shared plan for size n, built once per process
+inline std::shared_ptr<const FftPlan> fft_plan(int n) {
+    static std::mutex mutex;
+    static std::map<int, std::shared_ptr<const FftPlan>> plans;
+    std::lock_guard lock(mutex);
+    auto& plan = plans[n];
+    if (!plan) plan = std::make_shared<const FftPlan>(n);
+    return plan;
+}
+
+} // namespace dsp
@@ -0,0 +1,296 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// FLAC decoder for library one-shots: the whole stream, any block size,
+// 4-32 bits, all fixed and LPC subframes, the three stereo decorrelation
+// modes. Decodes straight to interleaved stereo float (mono duplicated,
+// channels past the second dropped). Frame CRCs aren't checked; a stream
+// that runs out of bits mid-frame is rejected rather than read past.
+namespace flac {
+
+struct StreamInfo {
+    int     sample_rate = 0;
+    int     channels = 0;
+    int     bits = 0;
+    int64_t frames = 0;   // 0 when the encoder didn't know
+};
+
+namespace detail {
+
+// MSB-first bit reader bounded to [in, end); reads past the end throw
+class BitReader {
+public:
+    BitReader(const uint8_t* in, const uint8_t* end) : in_(in), end_(end) {}
+
+    uint32_t get(int n) {   // n <= 32
+        if (n == 0) return 0;
+        refill(n);
+        fill_ -= n;
+        return (uint32_t)(acc_ >> fill_) & (uint32_t)((1ull << n) - 1);
+    }
+
+    int32_t get_signed(int n) {   // n <= 32
+        if (n == 0) return 0;
+        const uint32_t v = get(n);
+        return n == 32 ? (int32_t)v : (int32_t)(v << (32 - n)) >> (32 - n);
+    }
+
+    uint32_t unary() {   // zeros, then a one
+        uint32_t q = 0;
+        for (;;) {
+            refill(1);
+            const uint64_t window = acc_ << (64 - fill_);
+            if (window) {
+                const int zeros = __builtin_clzll(window);
+                q += zeros;
+                fill_ -= zeros + 1;
+                return q;
+            }
+            q += fill_;
+            fill_ = 0;
+        }
+    }
+
+    int32_t rice(int k) {
+        const uint32_t u = unary() << k | get(k);
+        return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+    }
+
+    void align() { fill_ -= fill_ & 7; }
+
+    // Next unread byte; only meaningful when aligned
+    const uint8_t* position() const { return in_ - fill_ / 8; }
+
+private:
+    void refill(int need) {
+        while (fill_ <= 56) {
+            if (in_ == end_) {
+                if (fill_ < need) throw std::runtime_error("FLAC stream truncated");
+                return;
+            }
+            acc_ = acc_ << 8 | *in_++;
+            fill_ += 8;
+        }
+    }
+
+    const uint8_t* in_;
+    const uint8_t* end_;
+    uint64_t acc_ = 0;
+    int      fill_ = 0;
+};
+
+inline void decode_residual(BitReader& r, int block, int order, int32_t* y) {
+    const int method = (int)r.get(2);
+    if (method > 1) throw std::runtime_error("Unsupported FLAC residual coding");
+    const int param_bits = method == 0 ? 4 : 5;
+    const uint32_t escape = (1u << param_bits) - 1;
+    const int partition_order = (int)r.get(4);
+    const int partitions = 1 << partition_order;
+    if ((block >> partition_order) < order || (block & (partitions - 1)))
+        throw std::runtime_error("Invalid FLAC residual partitioning");
+
+    int i = order;
+    for (int p = 0; p < partitions; ++p) {
+        const int end = (p + 1) * (block >> partition_order);
+        const uint32_t k = r.get(param_bits);
+        if (k == escape) {
+            const int bits = (int)r.get(5);
+            for (; i < end; ++i) y[i] = r.get_signed(bits);
+        } else {
+            for (; i < end; ++i) y[i] = r.rice((int)k);
+        }
+    }
+}
+
+// Replaces the residuals in y[order..block) by the signal
+inline void restore_fixed(int order, int block, int32_t* y) {
+    for (int i = order; i < block; ++i) {
+        switch (order) {
+            case 1: y[i] += y[i - 1]; break;
+            case 2: y[i] += 2 * y[i - 1] - y[i - 2]; break;
+            case 3: y[i] += 3 * y[i - 1] - 3 * y[i - 2] + y[i - 3]; break;
+            case 4: y[i] += 4 * y[i - 1] - 6 * y[i - 2] + 4 * y[i - 3] - y[i - 4]; break;
+            default: break;
+        }
+    }
+}
+
+inline void restore_lpc(const int32_t* coefs, int order, int shift, int block, int32_t* y) {
+    for (int i = order; i < block; ++i) {
+        int64_t sum = 0;
+        for (int j = 0; j < order; ++j) sum += (int64_t)coefs[j] * y[i - 1 - j];
+        y[i] += (int32_t)(sum >> shift);
+    }
+}
+
+inline void decode_subframe(BitReader& r, int block, int bits, int32_t* y) {
+    if (r.get(1)) throw std::runtime_error("Invalid FLAC subframe");
+    const int type = (int)r.get(6);
+    int wasted = 0;
+    if (r.get(1)) wasted = (int)r.unary() + 1;
+    bits -= wasted;
+    if (bits < 1 || bits > 32) throw std::runtime_error("Invalid FLAC sample size");
+
+    if (type == 0) {   // constant
+        std::fill(y, y + block, r.get_signed(bits));
+    } else if (type == 1) {   // verbatim
+        for (int i = 0; i < block; ++i) y[i] = r.get_signed(bits);
+    } else if (type >= 8 && type <= 12) {   // fixed
+        const int order = type - 8;
+        if (order > block) throw std::runtime_error("Invalid FLAC predictor order");
+        for (int i = 0; i < order; ++i) y[i] = r.get_signed(bits);
+        decode_residual(r, block, order, y);
+        restore_fixed(order, block, y);
+    } else if (type >= 32) {   // LPC
+        const int order = type - 31;
+        if (order > block) throw std::runtime_error("Invalid FLAC predictor order");
+        for (int i = 0; i < order; ++i) y[i] = r.get_signed(bits);
+        const int precision = (int)r.get(4) + 1;
+        if (precision == 16) throw std::runtime_error("Invalid FLAC coefficient precision");
+        const int shift = r.get_signed(5);
+        if (shift < 0) throw std::runtime_error("Invalid FLAC coefficient shift");
+        int32_t coefs[32];
+        for (int i = 0; i < order; ++i) coefs[i] = r.get_signed(precision);
+        decode_residual(r, block, order, y);
+        restore_lpc(coefs, order, shift, block, y);
+    } else {
+        throw std::runtime_error("Reserved FLAC subframe type");
+    }
+    if (wasted)
+        for (int i = 0; i < block; ++i) y[i] = (int32_t)((uint32_t)y[i] << wasted);
+}
+
+// Frame number or sample number, UTF-8 style; only its length matters here
+inline void skip_coded_number(BitReader& r) {
+    const uint32_t lead = r.get(8);
+    int extra = 0;
+    while (extra < 7 && (lead & (0x80u >> extra))) ++extra;
+    if (extra == 1 || extra == 7) throw std::runtime_error("Invalid FLAC frame number");
+    for (int i = 1; i < extra; ++i) r.get(8);
+}
+
+} // namespace detail
+
+// Reads the STREAMINFO block; returns the offset of the first frame
+inline size_t read_stream_info(const uint8_t* in, size_t size, StreamInfo& info) {
+    size_t at = 0;
+    // ID3v2 tag some taggers put in front
+    if (size >= 10 && std::memcmp(in, "ID3", 3) == 0)
+        at = 10 + ((size_t)(in[6] & 0x7F) << 21 | (size_t)(in[7] & 0x7F) << 14 |
+                   (size_t)(in[8] & 0x7F) << 7 | (size_t)(in[9] & 0x7F));
+    if (at + 4 > size || std::memcmp(in + at, "fLaC", 4) != 0)
+        throw std::runtime_error("Not a FLAC stream");
+    at += 4;
+
+    bool seen = false, last = false;
+    while (!last) {
+        if (at + 4 > size) throw std::runtime_error("FLAC metadata truncated");
+        last = in[at] & 0x80;
+        const int type = in[at] & 0x7F;
+        const size_t length = (size_t)in[at + 1] << 16 | (size_t)in[at + 2] << 8 | in[at + 3];
+        at += 4;
+        if (at + length > size) throw std::runtime_error("FLAC metadata truncated");
+        if (type == 0 && length >= 34) {
+            detail::BitReader r(in + at + 10, in + at + 18);
+            info.sample_rate = (int)r.get(20);
+            info.channels    = (int)r.get(3) + 1;
+            info.bits        = (int)r.get(5) + 1;
+            const int64_t frames_hi = r.get(4);   // read in stream order
+            const int64_t frames_lo = r.get(32);
+            info.frames      = frames_hi << 32 | frames_lo;
+            seen = true;
+        }
+        at += length;
+    }
+    if (!seen || info.sample_rate <= 0) throw std::runtime_error("FLAC stream has no STREAMINFO");
+    return at;
+}
+
+// Decodes a whole stream to interleaved stereo float in `lr`
+inline StreamInfo decode(const uint8_t* in, size_t size, std::vector<float>& lr) {
+    StreamInfo info;
+    size_t at = read_stream_info(in, size, info);
+    lr.clear();
+    if (info.frames > 0) lr.reserve((size_t)info.frames * 2);
+
+    static constexpr int BLOCK_SIZES[16] = {0, 192, 576, 1152, 2304, 4608, -1, -2,
+                                            256, 512, 1024, 2048, 4096, 8192, 16384, 32768};
+    static constexpr int SAMPLE_SIZES[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+
+    std::vector<int32_t> channel[2];
+    std::vector<int32_t> skipped;
+    int64_t decoded = 0;
+    detail::BitReader r(in + at, in + size);
+    while (info.frames == 0 || decoded < info.frames) {
+        // Stream end: nothing but padding or a trailing tag left
+        const uint8_t* frame = r.position();
+        if (in + size - frame < 2 || frame[0] != 0xFF || (frame[1] & 0xFE) != 0xF8) break;
+
+        r.get(16);
+        const int block_code = (int)r.get(4);
+        const int rate_code  = (int)r.get(4);
+        const int assignment = (int)r.get(4);
+        const int size_code  = (int)r.get(3);
+        r.get(1);
+        detail::skip_coded_number(r);
+
+        int block = BLOCK_SIZES[block_code];
+        if (block == -1) block = (int)r.get(8) + 1;
+        else if (block == -2) block = (int)r.get(16) + 1;
+        if (block == 0) throw std::runtime_error("Reserved FLAC block size");
+        if (rate_code == 12) r.get(8);
+        else if (rate_code == 13 || rate_code == 14) r.get(16);
+        else if (rate_code == 15) throw std::runtime_error("Invalid FLAC sample rate");
+        r.get(8);   // header CRC
+
+        const int bits = size_code == 0 ? info.bits : SAMPLE_SIZES[size_code];
+        if (bits == 0) throw std::runtime_error("Reserved FLAC sample size");
+        const int channels = assignment < 8 ? assignment + 1 : 2;
+        if (assignment > 10) throw std::runtime_error("Reserved FLAC channel assignment");
+
+        for (auto& c : channel) c.resize(block);
+        skipped.resize(block);
+        for (int c = 0; c < channels; ++c) {
+            // The side channel carries one more bit
+            const bool side = (assignment == 8 && c == 1) || (assignment == 9 && c == 0) ||
+                              (assignment == 10 && c == 1);
+            detail::decode_subframe(r, block, bits + side, c < 2 ? channel[c].data() : skipped.data());
+        }
+        r.align();
+        r.get(16);   // frame CRC
+
+        int32_t* a = channel[0].data();
+        int32_t* b = channel[1].data();
+        if (assignment == 8) {
+            for (int i = 0; i < block; ++i) b[i] = a[i] - b[i];
+        } else if (assignment == 9) {
+            for (int i = 0; i < block; ++i) a[i] += b[i];
+        } else if (assignment == 10) {
+            for (int i = 0; i < block; ++i) {
+                const int64_t mid = (int64_t)a[i] * 2 + (b[i] & 1);
+                a[i] = (int32_t)((mid + b[i]) >> 1);
+                b[i] = (int32_t)((mid - b[i]) >> 1);
+            }
+        }
+
+        int emit = block;
+        if (info.frames > 0) emit = (int)std::min<int64_t>(block, info.frames - decoded);
+        const float scale = 1.0f / (float)(1ull << (bits - 1));
+        const int32_t* right = channels > 1 ? b : a;
+        for (int i = 0; i < emit; ++i) {
+            lr.push_back(a[i] * scale);
+            lr.push_back(right[i] * scale);
+        }
+        decoded += emit;
+    }
+    if (info.frames == 0) info.frames = decoded;
+    else if (decoded < info.frames) throw std::runtime_error("FLAC stream truncated");
+    return info;
+}
+
+} // namespace flac
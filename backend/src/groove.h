@@ -0,0 +1,156 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "../deps/json.hpp"
+#include "midi_writer.h"
+#include "models.h"
+
+using json = nlohmann::json;
+
+// Groove and humanize for composed note streams. The patterns place every
+// hit on the grid; a genre's template then delays and accents hits by
+// where they fall in the beat (16ths, or triplet 8ths for 12/8 genres),
+// and humanizing adds seeded jitter on top. It runs once, when the notes
+// are composed, so the MIDI export and the renderer get the same
+// performance and the mix loop does no extra work.
+//
+// Hits only ever move later, by less than a 16th, and a hit's offsets
+// depend only on the hit itself and where it falls in a HUMANIZE_BARS
+// cycle. So bar n comes out the same in a beat of any length, never
+// reaches back into bar n - 1, and the composition still repeats (after
+// the cycle).
+namespace groove {
+
+constexpr int HUMANIZE_BARS = 4;   // jitter repeats after this many bars
+
+struct Template {
+    std::array<int8_t, 4> delay;            // ticks, by 16th within the beat
+    std::array<int8_t, 4> accent;           // velocity offset, by 16th
+    std::array<int8_t, 3> triplet_delay;    // ... by triplet 8th (12/8 genres)
+    std::array<int8_t, 3> triplet_accent;
+    bool                  compound;         // downbeats take the triplet entries
+    uint8_t               timing_jitter;    // most random delay, ticks
+    uint8_t               velocity_jitter;  // most random velocity change either way
+};
+
+constexpr int GENRE_COUNT = (int)Genre::NDOMBOLO + 1;
+
+// By Genre. Afro templates lean on laid-back upbeat 16ths (and, in 12/8,
+// a late third triplet); the electronic ones stay close to the grid.
+constexpr std::array<Template, GENRE_COUNT> TEMPLATES = {{
+    {{0, 20, 0, 20},   {6, -8, 2, -8},   {0, 0, 0},  {0, 0, 0},  false,  6, 6},   // hip-hop
+    {{0, 0, 0, 0},     {4, -4, 0, -4},   {0, 0, 0},  {0, 0, 0},  false,  3, 5},   // trap
+    {{0, 24, 4, 24},   {4, -10, 0, -10}, {0, 0, 0},  {0, 0, 0},  false, 10, 8},   // lo-fi
+    {{0, 0, 0, 0},     {2, -2, 0, -2},   {0, 0, 0},  {0, 0, 0},  false,  0, 3},   // edm
+    {{0, 8, 0, 8},     {4, -6, 2, -6},   {0, 0, 0},  {0, 0, 0},  false,  3, 5},   // house
+    {{0, 10, 0, 10},   {4, -6, 0, -6},   {0, 0, 0},  {0, 0, 0},  false,  3, 5},   // drill
+    {{0, 16, 2, 16},   {4, -8, 2, -8},   {0, 0, 0},  {0, 0, 0},  false,  6, 6},   // r&b
+    {{0, 12, 36, 16},  {2, -10, 4, -8},  {0, 0, 0},  {0, 0, 0},  false, 10, 8},   // jazz
+    {{0, 0, 0, 0},     {0, 0, 0, 0},     {0, 0, 0},  {0, 0, 0},  false,  8, 4},   // ambient
+    {{0, 14, 2, 16},   {6, -6, 2, -4},   {0, 0, 0},  {0, 0, 0},  false,  6, 6},   // afrobeats
+    {{0, 18, 4, 20},   {4, -6, 2, -4},   {0, 0, 0},  {0, 0, 0},  false,  6, 6},   // amapiano
+    {{0, 12, 2, 14},   {5, -6, 2, -5},   {0, 0, 0},  {0, 0, 0},  false,  6, 6},   // afro-fusion
+    {{0, 10, 0, 10},   {4, -4, 2, -4},   {0, 6, 12}, {6, -6, 0}, true,   6, 6},   // highlife
+    {{0, 12, 4, 12},   {5, -5, 2, -5},   {0, 0, 0},  {0, 0, 0},  false,  7, 7},   // juju
+    {{0, 10, 6, 14},   {6, -6, 3, -6},   {0, 0, 0},  {0, 0, 0},  false,  8, 8},   // fuji
+    {{0, 10, 2, 12},   {6, -6, 2, -5},   {0, 0, 0},  {0, 0, 0},  false,  7, 6},   // afrobeat
+    {{0, 6, 0, 6},     {4, -4, 2, -4},   {0, 0, 0},  {0, 0, 0},  false,  4, 5},   // soukous
+    {{0, 10, 0, 10},   {4, -5, 2, -5},   {0, 0, 0},  {0, 0, 0},  false,  5, 5},   // makossa
+    {{0, 10, 0, 12},   {4, -6, 2, -6},   {0, 0, 0},  {0, 0, 0},  false,  4, 5},   // afro house
+    {{0, 6, 0, 8},     {6, -6, 0, -4},   {0, 0, 0},  {0, 0, 0},  false,  3, 5},   // gqom
+    {{0, 4, 0, 4},     {4, -4, 2, -4},   {0, 0, 0},  {0, 0, 0},  false,  3, 5},   // kuduro
+    {{0, 8, 0, 8},     {4, -4, 2, -4},   {0, 4, 10}, {6, -4, 2}, true,   6, 7},   // mbalax
+    {{0, 16, 2, 18},   {4, -6, 2, -6},   {0, 0, 0},  {0, 0, 0},  false,  5, 5},   // kwaito
+    {{0, 8, 0, 8},     {4, -4, 2, -4},   {0, 0, 0},  {0, 0, 0},  false,  5, 5},   // ndombolo
+}};
+
+// How much of the genre's groove a render gets
+struct Feel {
+    static constexpr float MAX = 2.0f;
+
+    float    amount   = 1.0f;   // template: 0 on the grid, 2 twice the genre's swing
+    float    humanize = 1.0f;   // jitter, same scale
+    uint32_t seed     = 0;
+
+    bool rigid() const { return amount == 0.0f && humanize == 0.0f; }
+};
+
+// Even at Feel::MAX nothing moves by a 16th or more
+constexpr bool templates_fit() {
+    for (auto& t : TEMPLATES) {
+        for (int d : t.delay)
+            if ((d + t.timing_jitter) * Feel::MAX >= midi::SIXTEENTH) return false;
+        for (int d : t.triplet_delay)
+            if ((d + t.timing_jitter) * Feel::MAX >= midi::SIXTEENTH) return false;
+    }
+    return true;
+}
+static_assert(templates_fit(), "groove delays stay under a 16th");
+
+inline const Template& template_for(Genre genre) { return TEMPLATES[(int)genre]; }
+
+namespace detail {
+
+inline uint64_t mix64(uint64_t x) {   // splitmix64 finalizer
+    x ^= x >> 30; x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27; x *= 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Uniform in [0, 1) for one hit and purpose
+inline float unit(uint32_t seed, uint32_t cycle_tick, uint32_t voice, uint32_t salt) {
+    uint64_t h = mix64(((uint64_t)seed << 32 | cycle_tick) ^ mix64((uint64_t)voice << 8 | salt));
+    return (float)(h >> 40) * (1.0f / (1 << 24));
+}
+
+} // namespace detail
+
+// Move and accent `notes` (composed for `genre`, ticks from bar 0) in place.
+// A chord's notes share their timing; drums each get their own.
+inline void apply(std::vector<midi::Note>& notes, Genre genre, const Feel& feel) {
+    if (feel.rigid()) return;
+    const Template& t = template_for(genre);
+    constexpr uint32_t CYCLE = HUMANIZE_BARS * midi::WHOLE;
+
+    for (auto& n : notes) {
+        const uint32_t in_beat = n.tick % midi::QUARTER;
+        int delay = 0, accent = 0;
+        if (in_beat % midi::TRIPLET8 == 0 && (t.compound || in_beat != 0)) {
+            delay  = t.triplet_delay[in_beat / midi::TRIPLET8];
+            accent = t.triplet_accent[in_beat / midi::TRIPLET8];
+        } else if (in_beat % midi::SIXTEENTH == 0) {
+            delay  = t.delay[in_beat / midi::SIXTEENTH];
+            accent = t.accent[in_beat / midi::SIXTEENTH];
+        }
+
+        const uint32_t cycle_tick = n.tick % CYCLE;
+        const uint32_t voice = n.channel == midi::DRUM_CHANNEL ? n.channel << 8 | n.pitch : n.channel << 8;
+        const float jitter = detail::unit(feel.seed, cycle_tick, voice, 0) * t.timing_jitter;
+        const float wobble = (detail::unit(feel.seed, cycle_tick, n.channel << 8 | n.pitch, 1) * 2.0f - 1.0f) *
+                             t.velocity_jitter;
+
+        n.tick += (uint32_t)std::lround(delay * feel.amount + jitter * feel.humanize);
+        n.velocity = (uint8_t)std::clamp(
+            n.velocity + (int)std::lround(accent * feel.amount + wobble * feel.humanize), 1, 127);
+    }
+}
+
+// {"amount": 1.0, "humanize": 1.0, "seed": 0}, each optional; 0 and 0 plays
+// the patterns straight
+inline Feel feel_from_json(const json& j) {
+    Feel feel;
+    if (!j.is_object()) return feel;
+    feel.amount   = std::clamp(j.value("amount", feel.amount), 0.0f, Feel::MAX);
+    feel.humanize = std::clamp(j.value("humanize", feel.humanize), 0.0f, Feel::MAX);
+    feel.seed     = (uint32_t)j.value("seed", (int64_t)feel.seed);
+    return feel;
+}
+
+inline json feel_to_json(const Feel& feel) {
+    return {{"amount", feel.amount}, {"humanize", feel.humanize}, {"seed", feel.seed}};
+}
+
+} // namespace groove
@@ -0,0 +1,173 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "beat_renderer.h"
+
+namespace fs = std::filesystem;
+
+// Seamless N-bar loops. The composition repeats every few bars (a four-bar
+// progression, the groove's four-bar humanize cycle), so only one
+// repeating unit is mixed, with the tails that ring past its end; a loop
+// shorter than that is its own unit, bars [0, N) as in its MIDI file.
+// Copies of the unit are overlap-added around a loop buffer of exactly N
+// bars, the last one's tails wrapping into the start. The master chain
+// then runs over the loop until its own tail has wrapped too, so the file
+// plays back click-free on repeat.
+namespace renderer {
+
+constexpr int    MAX_LOOP_BARS = 64;
+constexpr double LOOP_TAIL_SECONDS = 3.0;   // allowance for insert and master chain tails
+
+// Loop length in frames: N bars at the tempo, rounded once
+inline int64_t loop_frames(int bars, int bpm, int sample_rate) {
+    return std::llround(bars * 4 * 60.0 / bpm * sample_rate);
+}
+
+// Bars the loop mixes once and repeats: the composition's period when the
+// loop is a multiple of it, else the whole loop
+inline int loop_unit_bars(const RenderRequest& req) {
+    const int period = melody::composition_period(req.genre, req.mood, req.feel);
+    return req.loop_bars % period == 0 ? period : req.loop_bars;
+}
+
+// Bars [0, bars) of the composition: what a loop plays and its MIDI file holds
+inline std::vector<midi::Note> loop_notes(const RenderRequest& req, int bars) {
+    return melody::compose_bars(req.genre, req.mood, req.key, bars, req.feel);
+}
+
+// Voices of a unit's notes, from frame 0. They're compiled after a copy of
+// the same notes, so glides and round-robin pick up from the previous pass
+// as they do on repeat; the copy is dropped.
+inline std::vector<Voice> compile_loop_voices(const std::vector<midi::Note>& unit_notes, int unit_bars,
+                                              const SampleBank& bank, const mixer::MixerSettings& mix,
+                                              int bpm, int sample_rate, int64_t tail_frames) {
+    const uint32_t unit_ticks = (uint32_t)unit_bars * midi::WHOLE;
+    const int64_t unit_start = (int64_t)(unit_bars * (4 * 60.0 / bpm * sample_rate));
+    std::vector<midi::Note> notes;
+    notes.reserve(unit_notes.size() * 2);
+    notes.insert(notes.end(), unit_notes.begin(), unit_notes.end());
+    for (auto n : unit_notes) {
+        n.tick += unit_ticks;
+        notes.push_back(n);
+    }
+    auto voices = compile_voices(std::move(notes), bank, mix, bpm, sample_rate,
+                                 unit_start * 2 + tail_frames);
+    std::erase_if(voices, [&](const Voice& v) { return v.frame_offset < unit_start; });
+    uint32_t synth_voices = 0;
+    for (auto& v : voices) {
+        v.frame_offset -= unit_start;
+        if (v.model != synth::NONE) v.synth_slot = synth_voices++;
+    }
+    return voices;
+}
+
+inline std::string render_loop(const SampleBank& bank, const fs::path& output_dir,
+                               const RenderRequest& req) {
+    if (!bank.loaded) {
+        throw std::runtime_error("Sample bank not loaded");
+    }
+    if (req.loop_bars < 1 || req.loop_bars > MAX_LOOP_BARS)
+        throw std::invalid_argument("loop_bars must be between 1 and 64");
+
+    const QualityProfile& quality = quality_profile(req.quality);
+    const int sample_rate = quality.sample_rate;
+    mixer::MixerSettings mix = req.mixer;
+    if (!quality.effects)
+        for (auto& bus : mix.buses) bus.effects.clear();
+    const bool inserts = std::any_of(mix.buses.begin(), mix.buses.end(),
+                                     [](const mixer::BusSettings& b) { return !b.effects.empty(); });
+
+    const auto started = std::chrono::steady_clock::now();
+    const long faults_before = thread_page_faults();
+    const uint64_t allocations_before = BufferPool::thread_allocations();
+
+    // 1. Repeating unit: bars [0, unit_bars), the bars the MIDI export has
+    const int unit_bars = loop_unit_bars(req);
+    const int copies = req.loop_bars / unit_bars;
+    const double bar_frames = 4 * 60.0 / req.bpm * sample_rate;
+    const int64_t total = loop_frames(req.loop_bars, req.bpm, sample_rate);
+    const int64_t tail_frames = (int64_t)(LOOP_TAIL_SECONDS * sample_rate);
+
+    const auto unit_notes = loop_notes(req, unit_bars);
+    auto voices = compile_loop_voices(unit_notes, unit_bars, bank, mix, req.bpm, sample_rate, tail_frames);
+    int64_t unit_end = (int64_t)(unit_bars * bar_frames);
+    for (auto& v : voices) unit_end = std::max(unit_end, v.frame_offset + v.length);
+    if (inserts) unit_end += tail_frames;
+
+    // The next copies' triggers keep ducking this one's tails, as on repeat
+    std::vector<std::vector<SidechainTrigger>> sidechain_triggers;
+    for (auto& sc : mix.sidechains) {
+        auto unit = compile_sidechain(unit_notes, sc, req.bpm, sample_rate);
+        std::vector<SidechainTrigger> cyclic;
+        for (int c = 0; (int64_t)std::llround(c * unit_bars * bar_frames) < unit_end; ++c)
+            for (auto t : unit) {
+                t.frame += std::llround(c * unit_bars * bar_frames);
+                cyclic.push_back(t);
+            }
+        sidechain_triggers.push_back(std::move(cyclic));
+    }
+
+    // 2. Mix the unit and its tails, without the master chain
+    dsp::DenormalGuard denormal_guard;
+    static const std::vector<dsp::EffectSpec> no_effects;
+    MixEngine engine(bank, voices, mix, no_effects, sample_rate,
+                     std::move(sidechain_triggers), quality.hermite);
+    auto unit_lease = render_buffer_pool().acquire((size_t)unit_end * 2);
+    float* unit = unit_lease.data();
+    while (engine.position() < unit_end) {
+        checkpoint(req.cancel.get());
+        int n = (int)std::min<int64_t>(BLOCK_FRAMES, unit_end - engine.position());
+        engine.render_block(unit + engine.position() * 2, n);
+    }
+
+    // 3. Overlap-add the copies around the loop
+    auto loop_lease = render_buffer_pool().acquire((size_t)total * 2);
+    float* loop = loop_lease.data();
+    for (int c = 0; c < copies; ++c) {
+        int64_t at = std::llround(c * unit_bars * bar_frames) % total;
+        for (int64_t i = 0; i < unit_end;) {
+            int64_t n = std::min(unit_end - i, total - at);
+            for (int64_t k = 0; k < n * 2; ++k) loop[at * 2 + k] += unit[i * 2 + k];
+            i += n;
+            at = 0;
+        }
+    }
+
+    // 4. Master chain in steady state: run it over the loop (on a copy)
+    //    until its tail has had time to wrap, then over the loop itself
+    if (quality.effects && !req.effects.empty()) {
+        dsp::EffectChain master(req.effects, sample_rate);
+        auto scratch_lease = render_buffer_pool().acquire((size_t)total * 2);
+        float* scratch = scratch_lease.data();
+        const int64_t warmup = (tail_frames + total - 1) / total;
+        for (int64_t pass = 0; pass <= warmup; ++pass) {
+            float* buf = pass < warmup ? scratch : loop;
+            if (pass < warmup) std::copy(loop, loop + total * 2, scratch);
+            for (int64_t f = 0; f < total; f += BLOCK_FRAMES) {
+                checkpoint(req.cancel.get());
+                master.process(buf + f * 2, (int)std::min<int64_t>(BLOCK_FRAMES, total - f));
+            }
+        }
+    }
+
+    std::string beat_id = "offline_" + random_hex_id(12);
+    write_normalized(output_dir / (beat_id + ".wav"), loop, total, sample_rate, quality);
+
+    render_metrics().record({
+        beat_id,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count(),
+        total / (double)sample_rate,
+        thread_page_faults() - faults_before,
+        BufferPool::thread_allocations() - allocations_before,
+        (unit_lease.capacity() + loop_lease.capacity()) * sizeof(float),
+    });
+    return beat_id;
+}
+
+} // namespace renderer
@@ -6,10 +6,19 @@
 #include "utils.h"
 #include "midi_writer.h"
 #include "sample_library.h"
+#include "sample_ingest.h"
 #include "beat_renderer.h"
-
+#include "cancellation.h"
+#include "midi_reader.h"
+#include "render_session.h"
+#include "loop_renderer.h"
+#include "progressive_render.h"
+#include "percussion_synth.h"
+
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <chrono>
 
@@ -24,9 +33,19 @@ static fs::path g_history_file;
 // Plugin cache (VST3 filesystem scan only — no pedalboard dependency)
 static json g_plugins = json::array();
 
-// Offline renderer sample bank (loaded on first use)
-static renderer::SampleBank g_sample_bank;
+// Offline renderer sample bank (loaded on first use). Replaced as a whole
+// when the library changes, so in-flight renders keep the bank they started with.
+static std::shared_ptr<renderer::SampleBank> g_sample_bank;
 static std::mutex g_sample_bank_mutex;
+// SAMPLE_STORAGE=compressed in .env holds the bank as codec blocks
+static renderer::SampleStorage g_sample_storage = renderer::SampleStorage::FLOAT;
+
+// Deadlines for heavy requests (RENDER_DEADLINE_SECONDS and
+// GENERATE_DEADLINE_SECONDS in .env; 0 for none). Renders stop at the next
+// block past them; generation can't stop mid upstream call, but stops
+// before the next one and drops what arrives too late.
+static double g_render_deadline_seconds = 600.0;
+static double g_generate_deadline_seconds = 300.0;
 
 // --- History persistence ---
 
@@ -65,6 +84,110 @@ static GenerateRequest parse_gen_request(const json& j) {
     return req;
 }
 
+// --- Parse offline RenderRequest from JSON ---
+
+static renderer::RenderRequest parse_render_request(const json& j) {
+    renderer::RenderRequest req;
+    if (j.contains("genre"))    req.genre = genre_from_str(j["genre"].get<std::string>());
+    if (j.contains("mood"))     req.mood = mood_from_str(j["mood"].get<std::string>());
+    if (j.contains("key"))      req.key = key_from_str(j["key"].get<std::string>());
+    if (j.contains("bpm"))      req.bpm = j["bpm"].get<int>();
+    if (j.contains("duration")) req.duration = j["duration"].get<double>();
+    req.mixer = mixer::mixer_from_json(j);
+    if (j.contains("effects")) req.effects = dsp::effect_chain_from_json(j["effects"]);
+    if (j.contains("quality")) req.quality = renderer::quality_from_str(j["quality"].get<std::string>());
+    if (j.contains("output_mode"))
+        req.output = renderer::output_mode_from_str(j["output_mode"].get<std::string>());
+    if (j.contains("loop_bars")) req.loop_bars = j["loop_bars"].get<int>();
+    if (j.contains("groove"))   req.feel = groove::feel_from_json(j["groove"]);
+    return req;
+}
+
+// --- MIDI upload limit ---
+
+static constexpr size_t MAX_MIDI_UPLOAD_BYTES = 4 * 1024 * 1024;
+
+// --- MIDI import channels: "bass_channel" / "log_drum_channel", 1-16 as DAWs number them ---
+
+static midi::ImportChannels parse_import_channels(const json& j) {
+    auto channel = [&](const char* name) {
+        if (!j.contains(name) || j[name].is_null()) return -1;
+        int ch = j[name].get<int>();
+        if (ch < 1 || ch > 16) throw std::invalid_argument(std::string(name) + " must be between 1 and 16");
+        return ch - 1;
+    };
+    midi::ImportChannels channels;
+    channels.bass = channel("bass_channel");
+    channels.log_drum = channel("log_drum_channel");
+    return channels;
+}
+
+// --- Sample import limit (per file) ---
+
+static constexpr size_t MAX_SAMPLE_UPLOAD_BYTES = 32 * 1024 * 1024;
+
+// --- Built-in percussion kit ---
+
+// Zones and alternates per synthesized entry; they cost next to nothing
+static constexpr int SYNTH_VELOCITY_LAYERS = 3;
+static constexpr int SYNTH_ROUND_ROBIN = 2;
+static constexpr int SYNTH_SAMPLE_RATE = 44100;
+
+// Synthesize library entries (`names`, or all) with the percussion synth,
+// skipping entries already on disk unless `replace`. Layers are written as
+// WAV, ingested from memory and recorded in the manifest. Returns the
+// number of entries written.
+static int synthesize_samples(const std::vector<std::string>& names, bool replace) {
+    auto dir = samples::library_dir(g_cfg.output_dir);
+    fs::create_directories(dir);
+    auto manifest = samples::load_manifest(g_cfg.output_dir);
+    int written = 0;
+
+    for (auto& s : samples::get_all_percussion_samples()) {
+        if (!names.empty() && std::find(names.begin(), names.end(), s.name) == names.end()) continue;
+        if (!replace && manifest.contains(s.name) &&
+            samples::entry_available(dir, manifest[s.name])) continue;
+
+        json layers = json::array();
+        for (int v = 0; v < SYNTH_VELOCITY_LAYERS; ++v) {
+            for (int rr = 0; rr < SYNTH_ROUND_ROBIN; ++rr) {
+                auto file = samples::synth_layer_file_name(s.name, v, rr, SYNTH_VELOCITY_LAYERS,
+                                                           SYNTH_ROUND_ROBIN);
+                renderer::PcmSample pcm;
+                pcm.data = percussion::synthesize(s, v, SYNTH_VELOCITY_LAYERS, rr, SYNTH_SAMPLE_RATE);
+                pcm.sample_rate = SYNTH_SAMPLE_RATE;
+                pcm.num_frames = (int)(pcm.data.size() / 2);
+                renderer::write_wav16(dir / file, pcm.data.data(), pcm.num_frames, SYNTH_SAMPLE_RATE);
+
+                auto layer = samples::velocity_zone(file, v, SYNTH_VELOCITY_LAYERS);
+                layer.synthesized = true;
+                layer.format = "wav";
+                renderer::analyze_sample(pcm, layer);
+                layers.push_back(samples::layer_to_json(layer));
+            }
+        }
+        manifest[s.name] = layers;
+        written++;
+    }
+    if (written > 0) samples::save_manifest(g_cfg.output_dir, manifest);
+    return written;
+}
+
+// --- Offline sample bank, loaded on first use; null if it can't be ---
+
+static std::shared_ptr<renderer::SampleBank> acquire_sample_bank() {
+    std::lock_guard lock(g_sample_bank_mutex);
+    if (!g_sample_bank) {
+        // Entries not generated yet (all of them on a fresh install) come
+        // from the built-in kit; generating them later upgrades them
+        if (!samples::is_library_complete(g_cfg.output_dir)) synthesize_samples({}, false);
+        auto fresh = std::make_shared<renderer::SampleBank>();
+        if (!fresh->load(g_cfg.output_dir, g_sample_storage)) return nullptr;
+        g_sample_bank = fresh;
+    }
+    return g_sample_bank;
+}
+
 // --- ISO timestamp ---
 
 static std::string utc_now_iso() {
@@ -89,6 +212,16 @@ static void serve_file(const httplib::Request&, httplib::Response& res,
     res.set_header("Content-Disposition", "attachment; filename=\"" + filename + "\"");
 }
 
+// --- Rendered audio for a beat: the MP3 if there is one, else the WAV; empty if neither ---
+
+static fs::path beat_audio_path(const std::string& beat_id) {
+    for (const char* ext : {".mp3", ".wav"}) {
+        auto path = g_cfg.output_dir / (beat_id + ext);
+        if (fs::exists(path)) return path;
+    }
+    return {};
+}
+
 // --- JSON error response ---
 
 static void error_response(httplib::Response& res, int code, const std::string& detail) {
@@ -97,6 +230,21 @@ static void error_response(httplib::Response& res, int code, const std::string&
     res.set_content(j.dump(), "application/json");
 }
 
+// --- Cancellation: the client hanging up, or the request's deadline ---
+
+static std::shared_ptr<renderer::CancelToken> request_token(const httplib::Request& req, double deadline_seconds) {
+    auto token = std::make_shared<renderer::CancelToken>();
+    token->set_timeout(deadline_seconds);
+    if (req.is_connection_closed) token->set_probe(req.is_connection_closed);
+    return token;
+}
+
+// Remove what a generation left behind once nobody is waiting for it
+static void discard_outputs(const std::string& id) {
+    std::error_code ec;
+    for (auto ext : {".mp3", ".wav", ".mid"}) fs::remove(g_cfg.output_dir / (id + ext), ec);
+}
+
 // --- VST3 filesystem scan (no pedalboard needed) ---
 
 static json scan_vst3_plugins(const std::vector<std::string>& extra_dirs = {}) {
@@ -160,7 +308,11 @@ int main(int argc, char* argv[]) {
     auto env = load_env(env_path.string());
     g_cfg.api_key = env["ELEVENLABS_API_KEY"];
     g_cfg.output_dir = base_dir.parent_path() / "output";
+    if (env["SAMPLE_STORAGE"] == "compressed") g_sample_storage = renderer::SampleStorage::COMPRESSED;
+    if (!env["RENDER_DEADLINE_SECONDS"].empty()) g_render_deadline_seconds = std::atof(env["RENDER_DEADLINE_SECONDS"].c_str());
+    if (!env["GENERATE_DEADLINE_SECONDS"].empty()) g_generate_deadline_seconds = std::atof(env["GENERATE_DEADLINE_SECONDS"].c_str());
     fs::create_directories(g_cfg.output_dir);
+    fs::remove_all(renderer::render_cache_dir(g_cfg.output_dir));   // stores of a previous run
 
     g_history_file = g_cfg.output_dir / "history.json";
     load_history();
@@ -191,6 +343,37 @@ int main(int argc, char* argv[]) {
         res.set_content(j.dump(), "application/json");
     });
 
+    // --- GET /api/metrics ---
+    // Offline renderer: per-render page faults / pool allocations and the
+    // render buffer pool's state
+    svr.Get("/api/metrics", [](const httplib::Request&, httplib::Response& res) {
+        auto pool = renderer::render_buffer_pool().stats();
+        std::shared_ptr<renderer::SampleBank> bank;
+        {
+            std::lock_guard lock(g_sample_bank_mutex);
+            bank = g_sample_bank;
+        }
+        json j = {
+            {"render", renderer::render_metrics().to_json()},
+            {"buffer_pool", {
+                {"allocations", pool.allocations},
+                {"reuses", pool.reuses},
+                {"thread_local_hits", pool.thread_local_hits},
+                {"frees", pool.frees},
+                {"idle_bytes", pool.idle_bytes},
+                {"leased_bytes", pool.leased_bytes},
+                {"max_idle_bytes", pool.max_idle_bytes},
+            }},
+            {"sample_bank", {
+                {"loaded", bank != nullptr},
+                {"storage", g_sample_storage == renderer::SampleStorage::COMPRESSED ? "compressed" : "float"},
+                {"zones", bank ? bank->zones().size() : 0},
+                {"memory_bytes", bank ? bank->memory_bytes() : 0},
+            }},
+        };
+        res.set_content(j.dump(), "application/json");
+    });
+
     // --- GET /api/presets ---
     svr.Get("/api/presets", [](const httplib::Request&, httplib::Response& res) {
         json genres = json::array();
@@ -253,12 +436,20 @@ int main(int argc, char* argv[]) {
         try {
             auto j = json::parse(req.body);
             auto gen_req = parse_gen_request(j);
+            auto cancel = request_token(req, g_generate_deadline_seconds);
 
             std::string beat_id = generate_beat(g_cfg, gen_req);
+            if (cancel->cancelled()) {
+                discard_outputs(beat_id);
+                error_response(res, 504, std::string("Generation abandoned: ") + cancel->reason());
+                return;
+            }
 
-            // Generate MIDI
+            // MIDI with the drums, bassline and chords (log drum included) of the request
             auto midi_path = g_cfg.output_dir / (beat_id + ".mid");
-            midi::write_drum_midi(midi_path.string(), gen_req.bpm, gen_req.duration, gen_req.genre);
+            midi::write_midi(midi_path.string(), gen_req.bpm,
+                             melody::compose_beat(gen_req.genre, gen_req.mood, gen_req.key,
+                                                  gen_req.bpm, gen_req.duration));
 
             json response = {
                 {"id", beat_id},
@@ -288,11 +479,9 @@ int main(int argc, char* argv[]) {
         auto beat_id = req.matches[1].str();
         if (!valid_beat_id(beat_id)) { error_response(res, 400, "Invalid beat ID"); return; }
 
-        auto mp3 = g_cfg.output_dir / (beat_id + ".mp3");
-        if (fs::exists(mp3)) { serve_file(req, res, mp3.string(), beat_id + ".mp3"); return; }
-        auto wav = g_cfg.output_dir / (beat_id + ".wav");
-        if (fs::exists(wav)) { serve_file(req, res, wav.string(), beat_id + ".wav"); return; }
-        error_response(res, 404, "Beat not found");
+        auto path = beat_audio_path(beat_id);
+        if (path.empty()) { error_response(res, 404, "Beat not found"); return; }
+        serve_file(req, res, path.string(), path.filename().string());
     });
 
     // --- GET /api/export/midi/:beat_id ---
@@ -376,16 +565,27 @@ int main(int argc, char* argv[]) {
             auto j = json::parse(req.body);
             int seed = j.contains("seed") && !j["seed"].is_null() ? j["seed"].get<int>() : -1;
             auto plan_json = j["composition_plan"].dump();
+            auto cancel = request_token(req, g_generate_deadline_seconds);
 
             auto beat_id = generate_from_plan(g_cfg, plan_json, seed);
+            if (cancel->cancelled()) {
+                discard_outputs(beat_id);
+                error_response(res, 504, std::string("Generation abandoned: ") + cancel->reason());
+                return;
+            }
 
-            // Generate MIDI
+            // MIDI with the drums, bassline and chords (log drum included) of the request
             auto midi_path = g_cfg.output_dir / (beat_id + ".mid");
             int plan_bpm = 120;
             Genre plan_genre = Genre::AFROBEATS;
+            Mood plan_mood = Mood::CHILL;
+            MusicalKey plan_key = MusicalKey::C_MINOR;
             if (j.contains("bpm")) plan_bpm = j["bpm"].get<int>();
             if (j.contains("genre")) plan_genre = genre_from_str(j["genre"].get<std::string>());
-            midi::write_drum_midi(midi_path.string(), plan_bpm, 120, plan_genre);
+            if (j.contains("mood")) plan_mood = mood_from_str(j["mood"].get<std::string>());
+            if (j.contains("key")) plan_key = key_from_str(j["key"].get<std::string>());
+            midi::write_midi(midi_path.string(), plan_bpm,
+                             melody::compose_beat(plan_genre, plan_mood, plan_key, plan_bpm, 120));
 
             json response = {
                 {"id", beat_id},
@@ -417,8 +617,14 @@ int main(int argc, char* argv[]) {
             double duration = j.value("duration", 2.0);
             bool loop = j.value("loop", false);
             double pi = j.value("prompt_influence", 0.5);
+            auto cancel = request_token(req, g_generate_deadline_seconds);
 
             auto sfx_id = generate_sound_effect(g_cfg, text, duration, loop, pi);
+            if (cancel->cancelled()) {
+                discard_outputs(sfx_id);
+                error_response(res, 504, std::string("SFX generation abandoned: ") + cancel->reason());
+                return;
+            }
             json response = {{"id", sfx_id}, {"audio_url", "/api/export/audio/" + sfx_id}};
             res.set_content(response.dump(), "application/json");
         } catch (const std::exception& e) {
@@ -436,11 +642,19 @@ int main(int argc, char* argv[]) {
         json missing_arr = json::array();
         for (auto& m : missing) missing_arr.push_back(m);
 
+        // Entries from the built-in kit, which generating would upgrade
+        json synthesized = json::array();
+        auto manifest = samples::load_manifest(g_cfg.output_dir);
+        for (auto& s : lib)
+            if (manifest.contains(s.name) && samples::entry_synthesized(manifest[s.name]))
+                synthesized.push_back(s.name);
+
         json j = {
             {"complete", missing.empty()},
             {"total", total},
             {"available", available},
             {"missing", missing_arr},
+            {"synthesized", synthesized},
         };
         res.set_content(j.dump(), "application/json");
     });
@@ -448,8 +662,10 @@ int main(int argc, char* argv[]) {
     // --- POST /api/samples/generate ---
     svr.Post("/api/samples/generate", [](const httplib::Request& req, httplib::Response& res) {
         try {
-            // Optional: only generate specific samples
+            // Optional: only generate specific samples, and how many velocity
+            // zones / round-robin alternates to generate per sample
             std::vector<std::string> only;
+            int velocity_layers = 1, round_robin = 1;
             if (!req.body.empty()) {
                 try {
                     auto j = json::parse(req.body);
@@ -457,6 +673,8 @@ int main(int argc, char* argv[]) {
                         for (auto& name : j["only"])
                             only.push_back(name.get<std::string>());
                     }
+                    velocity_layers = std::clamp(j.value("velocity_layers", 1), 1, 3);
+                    round_robin     = std::clamp(j.value("round_robin", 1), 1, 4);
                 } catch (...) {}
             }
 
@@ -464,10 +682,21 @@ int main(int argc, char* argv[]) {
             auto dir = samples::library_dir(g_cfg.output_dir);
             fs::create_directories(dir);
 
-            auto manifest = samples::load_manifest(g_cfg.output_dir);
+            // Layers on disk when the run started, to reuse their ingest
+            json manifest;
+            {
+                std::lock_guard lock(g_sample_bank_mutex);
+                manifest = samples::load_manifest(g_cfg.output_dir);
+            }
             int generated = 0;
             json errors = json::array();
 
+            // Abandoned or out of time: no further upstream calls. Files
+            // already generated stay in the library directory, and the next
+            // run picks them up instead of generating them again.
+            auto cancel = request_token(req, g_generate_deadline_seconds);
+            bool stopped = false;
+
             for (auto& s : lib) {
                 // Filter by "only" list if provided
                 if (!only.empty() &&
@@ -475,29 +704,90 @@ int main(int argc, char* argv[]) {
                     continue;
                 }
 
-                // Skip if already exists
-                if (manifest.contains(s.name) &&
-                    fs::exists(dir / manifest[s.name].get<std::string>())) {
-                    continue;
+                std::vector<samples::SampleLayer> previous;
+                if (manifest.contains(s.name)) previous = samples::manifest_layers(manifest[s.name]);
+
+                json layers = json::array();
+                for (int v = 0; v < velocity_layers; ++v) {
+                    for (int rr = 0; rr < round_robin; ++rr) {
+                        auto file = samples::layer_file_name(s.name, v, rr, velocity_layers, round_robin);
+                        auto dst = dir / file;
+
+                        // Skip if already exists
+                        if (!fs::exists(dst)) {
+                            if (cancel->cancelled()) { stopped = true; break; }
+                            try {
+                                auto prompt = samples::velocity_zone_prompt(s.prompt, v, velocity_layers);
+                                auto sfx_id = generate_sound_effect(g_cfg, prompt,
+                                                                     s.duration, false, 0.8);
+                                // Move the generated file to sample library
+                                auto src = g_cfg.output_dir / (sfx_id + ".mp3");
+                                if (!fs::exists(src)) continue;
+                                fs::rename(src, dst);
+                                generated++;
+                            } catch (const std::exception& e) {
+                                errors.push_back({{"sample", s.name}, {"error", e.what()}});
+                                continue;
+                            }
+                        }
+                        // Trim silence and level-match once, at ingest
+                        auto layer = samples::velocity_zone(file, v, velocity_layers);
+                        layer.format = "mp3";
+                        auto prev = std::find_if(previous.begin(), previous.end(),
+                            [&](const samples::SampleLayer& p) { return p.file == file; });
+                        try {
+                            if (prev != previous.end() && prev->ingested) {
+                                layer.ingested   = true;
+                                layer.trim_start = prev->trim_start;
+                                layer.trim_end   = prev->trim_end;
+                                layer.gain       = prev->gain;
+                            } else {
+                                layer = renderer::ingest_layer(dst, layer);
+                            }
+                        } catch (const std::exception& e) {
+                            errors.push_back({{"sample", s.name}, {"error", e.what()}});
+                            continue;
+                        }
+                        layers.push_back(samples::layer_to_json(layer));
+                    }
+                    if (stopped) break;
                 }
 
-                try {
-                    auto sfx_id = generate_sound_effect(g_cfg, s.prompt,
-                                                         s.duration, false, 0.8);
-                    // Move the generated file to sample library
-                    auto src = g_cfg.output_dir / (sfx_id + ".mp3");
-                    auto dst = dir / (s.name + ".mp3");
-                    if (fs::exists(src)) {
-                        fs::rename(src, dst);
-                        manifest[s.name] = s.name + ".mp3";
-                        samples::save_manifest(g_cfg.output_dir, manifest);
-                        generated++;
+                if (stopped) break;   // this entry's layers are incomplete
+                if (layers.empty()) continue;
+
+                // Merge into the entry as the manifest has it now, under the
+                // bank mutex so the built-in kit's synthesis can't interleave:
+                // layers with the same file are replaced, other generated
+                // layers kept, and the built-in kit's superseded
+                {
+                    std::lock_guard lock(g_sample_bank_mutex);
+                    auto current = samples::load_manifest(g_cfg.output_dir);
+                    json merged = json::array();
+                    if (current.contains(s.name)) {
+                        for (auto& p : samples::manifest_layers(current[s.name])) {
+                            bool replaced = std::any_of(layers.begin(), layers.end(),
+                                                        [&](const json& l) { return l["file"] == p.file; });
+                            if (p.synthesized) {
+                                std::error_code ec;
+                                if (!replaced) fs::remove(dir / p.file, ec);
+                            } else if (!replaced) {
+                                merged.push_back(samples::layer_to_json(p));
+                            }
+                        }
                     }
-                } catch (const std::exception& e) {
-                    errors.push_back({{"sample", s.name}, {"error", e.what()}});
+                    for (auto& l : layers) merged.push_back(l);
+                    current[s.name] = merged;
+                    samples::save_manifest(g_cfg.output_dir, current);
                 }
             }
 
+            // Pick up new layers on the next render
+            if (generated > 0) {
+                std::lock_guard lock(g_sample_bank_mutex);
+                g_sample_bank.reset();
+            }
+
             json response = {
                 {"generated", generated},
                 {"total", (int)lib.size()},
@@ -505,51 +795,209 @@ int main(int argc, char* argv[]) {
                 {"complete", samples::is_library_complete(g_cfg.output_dir)},
                 {"errors", errors},
             };
+            if (stopped) response["stopped"] = cancel->reason();
             res.set_content(response.dump(), "application/json");
         } catch (const std::exception& e) {
             error_response(res, 503, std::string("Sample generation failed: ") + e.what());
         }
     });
 
-    // --- POST /api/render-offline ---
-    svr.Post("/api/render-offline", [](const httplib::Request& req, httplib::Response& res) {
+    // --- POST /api/samples/synthesize ---
+    // Builds library entries with the built-in percussion synth, offline.
+    // Body (optional): {"only": [...names], "replace": false}; without
+    // "replace" only entries missing from the library are made.
+    svr.Post("/api/samples/synthesize", [](const httplib::Request& req, httplib::Response& res) {
         try {
-            auto j = json::parse(req.body);
-
-            Genre genre = Genre::AFROBEATS;
-            int bpm = 120;
-            double duration = 30.0;
-
-            if (j.contains("genre"))    genre = genre_from_str(j["genre"].get<std::string>());
-            if (j.contains("bpm"))      bpm = j["bpm"].get<int>();
-            if (j.contains("duration")) duration = j["duration"].get<double>();
+            std::vector<std::string> only;
+            bool replace = false;
+            if (!req.body.empty()) {
+                auto j = json::parse(req.body);
+                if (j.contains("only"))
+                    for (auto& name : j["only"]) only.push_back(name.get<std::string>());
+                replace = j.value("replace", false);
+            }
 
-            // Load sample bank if not already loaded
+            const auto started = std::chrono::steady_clock::now();
+            int synthesized;
             {
                 std::lock_guard lock(g_sample_bank_mutex);
-                if (!g_sample_bank.loaded) {
-                    if (!g_sample_bank.load(g_cfg.output_dir)) {
-                        error_response(res, 400,
-                            "Sample library not available. Generate samples first via POST /api/samples/generate");
-                        return;
+                synthesized = synthesize_samples(only, replace);
+                if (synthesized > 0) g_sample_bank.reset();
+            }
+
+            json response = {
+                {"synthesized", synthesized},
+                {"seconds", std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count()},
+                {"total", (int)samples::get_all_percussion_samples().size()},
+                {"available", samples::count_available(g_cfg.output_dir)},
+                {"complete", samples::is_library_complete(g_cfg.output_dir)},
+            };
+            res.set_content(response.dump(), "application/json");
+        } catch (const json::exception& e) {
+            error_response(res, 400, std::string("Invalid request: ") + e.what());
+        } catch (const std::exception& e) {
+            error_response(res, 503, std::string("Sample synthesis failed: ") + e.what());
+        }
+    });
+
+    // --- POST /api/samples/import ---
+    // Replaces library entries with the user's own one-shots (WAV, AIFF,
+    // FLAC or MP3), kept as uploaded. Multipart: each file part is named
+    // after the entry it fills ("kick", "snare", ...); several parts for one
+    // entry become its round-robin alternates. Files generated earlier stay
+    // on disk, so generating the entry again brings them back for free.
+    svr.Post("/api/samples/import", [](const httplib::Request& req, httplib::Response& res) {
+        try {
+            // Validate every part before touching the library
+            std::vector<std::pair<std::string, std::vector<const httplib::MultipartFormData*>>> entries;
+            for (auto& [name, upload] : req.files) {
+                auto& lib = samples::get_all_percussion_samples();
+                if (std::none_of(lib.begin(), lib.end(), [&](const samples::PercussionSample& s) { return s.name == name; })) {
+                    error_response(res, 400, "Unknown sample: " + name);
+                    return;
+                }
+                if (upload.content.empty()) { error_response(res, 400, "Empty file for " + name); return; }
+                if (upload.content.size() > MAX_SAMPLE_UPLOAD_BYTES) {
+                    error_response(res, 413, "Sample file too large: " + upload.filename);
+                    return;
+                }
+                if (renderer::audio_format_for(upload.filename).empty()) {
+                    error_response(res, 400, "Unsupported audio format: " + upload.filename);
+                    return;
+                }
+                if (entries.empty() || entries.back().first != name) entries.push_back({name, {}});
+                entries.back().second.push_back(&upload);
+            }
+            if (entries.empty()) { error_response(res, 400, "No sample files uploaded"); return; }
+
+            auto dir = samples::library_dir(g_cfg.output_dir);
+            fs::create_directories(dir);
+            json imported = json::array(), errors = json::array();
+
+            std::lock_guard lock(g_sample_bank_mutex);
+            auto manifest = samples::load_manifest(g_cfg.output_dir);
+            for (auto& [name, uploads] : entries) {
+                json layers = json::array();
+                std::vector<fs::path> written;
+                try {
+                    for (int rr = 0; rr < (int)uploads.size(); ++rr) {
+                        auto ext = fs::path(uploads[rr]->filename).extension().string();
+                        for (auto& ch : ext) ch = (char)std::tolower((unsigned char)ch);
+                        auto file = samples::layer_file_name(name + "_import", 0, rr, 1, (int)uploads.size(), ext);
+                        written.push_back(dir / file);
+                        {
+                            std::ofstream f(dir / file, std::ios::binary);
+                            f.write(uploads[rr]->content.data(), (std::streamsize)uploads[rr]->content.size());
+                            if (!f) throw std::runtime_error("Cannot write " + file);
+                        }
+
+                        samples::SampleLayer layer{file};
+                        layer.format = renderer::audio_format_for(file);
+                        layers.push_back(samples::layer_to_json(renderer::ingest_layer(dir / file, layer)));
+                    }
+                } catch (const std::exception& e) {
+                    std::error_code ec;
+                    for (auto& f : written) fs::remove(f, ec);
+                    errors.push_back({{"sample", name}, {"error", e.what()}});
+                    continue;
+                }
+
+                // Superseded built-in and imported layers go; generated ones stay
+                if (manifest.contains(name)) {
+                    for (auto& p : samples::manifest_layers(manifest[name])) {
+                        bool kept = std::any_of(layers.begin(), layers.end(),
+                                                [&](const json& l) { return l["file"] == p.file; });
+                        bool generated = !p.synthesized && p.file.find("_import") == std::string::npos;
+                        std::error_code ec;
+                        if (!kept && !generated) fs::remove(dir / p.file, ec);
                     }
                 }
+                manifest[name] = layers;
+                imported.push_back(name);
+            }
+            if (!imported.empty()) {
+                samples::save_manifest(g_cfg.output_dir, manifest);
+                g_sample_bank.reset();
+            }
+
+            json response = {
+                {"imported", imported},
+                {"errors", errors},
+                {"available", samples::count_available(g_cfg.output_dir)},
+                {"complete", samples::is_library_complete(g_cfg.output_dir)},
+            };
+            res.set_content(response.dump(), "application/json");
+        } catch (const std::exception& e) {
+            error_response(res, 503, std::string("Sample import failed: ") + e.what());
+        }
+    });
+
+    // --- POST /api/render-offline ---
+    svr.Post("/api/render-offline", [](const httplib::Request& req, httplib::Response& res) {
+        try {
+            auto j = json::parse(req.body);
+
+            auto render_req = parse_render_request(j);
+            render_req.cancel = request_token(req, g_render_deadline_seconds);
+            Genre genre = render_req.genre;
+            int bpm = render_req.bpm;
+            double duration = render_req.duration;
+
+            auto bank = acquire_sample_bank();
+            if (!bank) {
+                error_response(res, 400,
+                    "Sample library not available. Build it via POST /api/samples/synthesize or /api/samples/generate");
+                return;
             }
 
-            // Render beat to WAV
-            auto beat_id = renderer::render_beat(g_sample_bank, g_cfg.output_dir,
-                                                  genre, bpm, duration);
+            // Render beat to WAV. With "resumable": true the render keeps its
+            // stems in the session cache, so a later render of the same beat
+            // at another duration or mix only does what changed; without it
+            // nothing is stored. Loops are N bars long whatever the duration.
+            // Progressive renders return once the first bars are written and
+            // finish in the background.
+            const int loop_bars = render_req.loop_bars;
+            const bool progressive = loop_bars == 0 && j.value("progressive", false);
+            const bool resumable = j.value("resumable", false);
+            std::string beat_id;
+            std::shared_ptr<renderer::RenderJob> job;
+            if (loop_bars > 0) {
+                beat_id = renderer::render_loop(*bank, g_cfg.output_dir, render_req);
+                duration = loop_bars * 4 * 60.0 / bpm;
+            } else if (progressive) {
+                job = renderer::render_beat_progressive(bank, g_cfg.output_dir, render_req,
+                                                        g_render_deadline_seconds);
+                beat_id = job->id();
+            } else if (resumable) {
+                beat_id = renderer::render_beat_resumable(bank, g_cfg.output_dir, render_req);
+            } else {
+                beat_id = renderer::render_beat(*bank, g_cfg.output_dir, render_req);
+            }
 
-            // Generate MIDI file
+            // MIDI file with the same drums, bassline and chords as the render
             auto midi_path = g_cfg.output_dir / (beat_id + ".mid");
-            midi::write_drum_midi(midi_path.string(), bpm, duration, genre);
+            midi::write_midi(midi_path.string(), bpm,
+                             loop_bars > 0
+                                 ? renderer::loop_notes(render_req, loop_bars)
+                                 : melody::compose_beat(genre, render_req.mood, render_req.key, bpm, duration,
+                                                        render_req.feel),
+                             "Crescent Offline Render");
 
             json response = {
                 {"id", beat_id},
                 {"audio_url", "/api/export/audio/" + beat_id},
                 {"midi_url", "/api/export/midi/" + beat_id},
+                {"quality", renderer::quality_to_str(render_req.quality)},
                 {"offline", true},
             };
+            if (loop_bars > 0) {
+                response["loop_bars"] = loop_bars;
+                response["duration"] = duration;
+            }
+            if (job) {
+                response["render"] = job->to_json();
+                response["status_url"] = "/api/render-status/" + beat_id;
+            }
 
             // Add to history
             {
@@ -557,7 +1005,12 @@ int main(int argc, char* argv[]) {
                 g_history.insert(g_history.begin(), json{
                     {"id", beat_id},
                     {"params", {{"genre", genre_to_str(genre)}, {"bpm", bpm},
-                                {"duration", duration}, {"offline", true}}},
+                                {"mood", mood_to_str(render_req.mood)},
+                                {"key", key_to_str(render_req.key)},
+                                {"duration", duration}, {"offline", true},
+                                {"quality", renderer::quality_to_str(render_req.quality)},
+                                {"loop_bars", loop_bars},
+                                {"groove", groove::feel_to_json(render_req.feel)}}},
                     {"created_at", utc_now_iso()},
                 });
                 if (g_history.size() > 50) g_history.erase(g_history.end() - 1);
@@ -565,11 +1018,221 @@ int main(int argc, char* argv[]) {
             }
 
             res.set_content(response.dump(), "application/json");
+        } catch (const renderer::Cancelled& e) {
+            error_response(res, 504, std::string("Offline render stopped: ") + e.what());
+        } catch (const std::invalid_argument& e) {
+            error_response(res, 400, e.what());
         } catch (const std::exception& e) {
             error_response(res, 503, std::string("Offline render failed: ") + e.what());
         }
     });
 
+    // --- GET /api/render-status/:id ---
+    // State of a progressive render. With ?wait=<seconds> (up to 30) the
+    // request is held until the full render settles or the wait runs out.
+    svr.Get(R"(/api/render-status/(\w[\w-]*))", [](const httplib::Request& req, httplib::Response& res) {
+        auto job = renderer::render_jobs().find(req.matches[1].str());
+        if (!job) {
+            error_response(res, 404, "Render job not found");
+            return;
+        }
+        if (req.has_param("wait")) {
+            double wait = 0.0;
+            try {
+                wait = std::clamp(std::stod(req.get_param_value("wait")), 0.0, 30.0);
+            } catch (const std::exception&) {
+                error_response(res, 400, "wait must be a number of seconds");
+                return;
+            }
+            job->wait(std::chrono::milliseconds((int64_t)(wait * 1000)));
+        }
+        res.set_content(job->to_json().dump(), "application/json");
+    });
+
+    // --- POST /api/render-status/:id/cancel ---
+    // Stops a progressive render's background pass; the preview stays
+    svr.Post(R"(/api/render-status/(\w[\w-]*)/cancel)", [](const httplib::Request& req, httplib::Response& res) {
+        auto job = renderer::render_jobs().find(req.matches[1].str());
+        if (!job) {
+            error_response(res, 404, "Render job not found");
+            return;
+        }
+        job->cancel();
+        job->wait(std::chrono::milliseconds(1000));
+        res.set_content(job->to_json().dump(), "application/json");
+    });
+
+    // --- POST /api/render-midi ---
+    // Renders an uploaded Standard MIDI File against the sample bank. Send the
+    // file as the raw body, or multipart with a "midi" file part and an
+    // optional "options" part holding render-offline's mixer / sidechain /
+    // effects JSON. Tempo and length come from the file. Channel 10 plays
+    // drums and every other channel the chord voice; "bass_channel" and
+    // "log_drum_channel" (1-16) in the options send one to the 808 or log
+    // drum. This server's own exports are recognized by their track name and
+    // play back on the channels they were written with.
+    svr.Post("/api/render-midi", [](const httplib::Request& req, httplib::Response& res) {
+        try {
+            // The file is read where httplib holds it, never copied
+            std::string_view data = req.body;
+            json options = json::object();
+            if (auto upload = req.files.find("midi"); upload != req.files.end()) {
+                data = upload->second.content;
+                if (auto part = req.files.find("options"); part != req.files.end())
+                    options = json::parse(part->second.content);
+            }
+            if (data.empty()) { error_response(res, 400, "No MIDI file uploaded"); return; }
+            if (data.size() > MAX_MIDI_UPLOAD_BYTES) { error_response(res, 413, "MIDI file too large"); return; }
+
+            auto imported = midi::read_midi(data, parse_import_channels(options));
+            if (imported.notes.empty()) { error_response(res, 400, "MIDI file contains no notes"); return; }
+
+            auto render_req = parse_render_request(options);
+            render_req.cancel = request_token(req, g_render_deadline_seconds);
+            render_req.bpm = imported.bpm;
+            render_req.duration = imported.duration_seconds + 1.0;   // let the last hits ring out
+
+            auto bank = acquire_sample_bank();
+            if (!bank) {
+                error_response(res, 400,
+                    "Sample library not available. Build it via POST /api/samples/synthesize or /api/samples/generate");
+                return;
+            }
+
+            auto beat_id = renderer::render_notes(*bank, g_cfg.output_dir, imported.notes, render_req);
+
+            // Keep the upload alongside the render so it exports like any other beat
+            {
+                std::ofstream f(g_cfg.output_dir / (beat_id + ".mid"), std::ios::binary);
+                f.write(data.data(), (std::streamsize)data.size());
+            }
+
+            json response = {
+                {"id", beat_id},
+                {"audio_url", "/api/export/audio/" + beat_id},
+                {"midi_url", "/api/export/midi/" + beat_id},
+                {"bpm", imported.bpm},
+                {"duration", render_req.duration},
+                {"notes", imported.notes.size()},
+                {"quality", renderer::quality_to_str(render_req.quality)},
+                {"offline", true},
+            };
+
+            {
+                std::lock_guard lock(g_history_mutex);
+                g_history.insert(g_history.begin(), json{
+                    {"id", beat_id},
+                    {"params", {{"bpm", imported.bpm}, {"duration", render_req.duration},
+                                {"source", "midi"}, {"offline", true},
+                                {"quality", renderer::quality_to_str(render_req.quality)}}},
+                    {"created_at", utc_now_iso()},
+                });
+                if (g_history.size() > 50) g_history.erase(g_history.end() - 1);
+                save_history();
+            }
+
+            res.set_content(response.dump(), "application/json");
+        } catch (const renderer::Cancelled& e) {
+            error_response(res, 504, std::string("MIDI render stopped: ") + e.what());
+        } catch (const std::invalid_argument& e) {
+            error_response(res, 400, e.what());
+        } catch (const json::exception& e) {
+            error_response(res, 400, std::string("Invalid options: ") + e.what());
+        } catch (const std::exception& e) {
+            error_response(res, 503, std::string("MIDI render failed: ") + e.what());
+        }
+    });
+
+    // --- POST /api/effects/apply ---
+    // Runs an EffectRack chain over a beat or one of its stems server-side
+    svr.Post("/api/effects/apply", [](const httplib::Request& req, httplib::Response& res) {
+        try {
+            auto j = json::parse(req.body);
+            auto beat_id = j.value("beat_id", std::string());
+            auto stem = j.value("stem", std::string());
+            if (!valid_beat_id(beat_id)) { error_response(res, 400, "Invalid beat ID"); return; }
+            if (!stem.empty() && !valid_stem_name(stem)) { error_response(res, 400, "Invalid stem name"); return; }
+
+            auto chain = dsp::effect_chain_from_json(j.value("effects", json::array()));
+
+            auto src = stem.empty() ? beat_audio_path(beat_id)
+                                    : g_cfg.output_dir / (beat_id + "_stems") / stem;
+            if (src.empty() || !fs::exists(src)) { error_response(res, 404, "Audio not found"); return; }
+
+            auto cancel = request_token(req, g_render_deadline_seconds);
+            auto pcm = renderer::decode_audio_file(src.string());
+            {
+                dsp::DenormalGuard denormal_guard;
+                dsp::EffectChain fx(chain, pcm.sample_rate);
+                for (int at = 0; at < pcm.num_frames; at += renderer::BLOCK_FRAMES) {
+                    cancel->check();
+                    int frames = std::min(renderer::BLOCK_FRAMES, pcm.num_frames - at);
+                    fx.process(pcm.data.data() + at * 2, frames);
+                }
+            }
+
+            std::string fx_id = "fx_" + random_hex_id(12);
+            renderer::write_wav16(g_cfg.output_dir / (fx_id + ".wav"), pcm.data.data(),
+                                  pcm.num_frames, pcm.sample_rate);
+
+            json response = {{"id", fx_id}, {"audio_url", "/api/export/audio/" + fx_id}};
+            res.set_content(response.dump(), "application/json");
+        } catch (const renderer::Cancelled& e) {
+            error_response(res, 504, std::string("Effect processing stopped: ") + e.what());
+        } catch (const std::invalid_argument& e) {
+            error_response(res, 400, e.what());
+        } catch (const std::exception& e) {
+            error_response(res, 503, std::string("Effect processing failed: ") + e.what());
+        }
+    });
+
+    // --- POST /api/stretch/:beat_id ---
+    // Conform a beat (or one of its stems) to a tempo and/or transpose it:
+    //   {"source_bpm": 100, "target_bpm": 112} or {"tempo": 1.12}, "semitones": -2
+    svr.Post(R"(/api/stretch/(\w[\w-]*))", [](const httplib::Request& req, httplib::Response& res) {
+        auto beat_id = req.matches[1].str();
+        if (!valid_beat_id(beat_id)) { error_response(res, 400, "Invalid beat ID"); return; }
+        try {
+            auto j = req.body.empty() ? json::object() : json::parse(req.body);
+            auto stem = j.value("stem", std::string());
+            if (!stem.empty() && !valid_stem_name(stem)) { error_response(res, 400, "Invalid stem name"); return; }
+
+            double tempo = j.value("tempo", 1.0);
+            if (j.contains("source_bpm") && j.contains("target_bpm")) {
+                double source_bpm = j["source_bpm"].get<double>();
+                if (source_bpm <= 0) { error_response(res, 400, "source_bpm must be positive"); return; }
+                tempo = j["target_bpm"].get<double>() / source_bpm;
+            }
+            double semitones = j.value("semitones", 0.0);
+            if (!(tempo >= 0.25 && tempo <= 4.0)) { error_response(res, 400, "Tempo ratio must be within 0.25-4"); return; }
+            if (!(semitones >= -24 && semitones <= 24)) { error_response(res, 400, "Semitones must be within -24..24"); return; }
+
+            auto src = stem.empty() ? beat_audio_path(beat_id)
+                                    : g_cfg.output_dir / (beat_id + "_stems") / stem;
+            if (src.empty() || !fs::exists(src)) { error_response(res, 404, "Audio not found"); return; }
+
+            auto cancel = request_token(req, g_render_deadline_seconds);
+            auto pcm = renderer::decode_audio_file(src.string());
+            auto out = stretch::stretch_and_shift(pcm.data.data(), pcm.num_frames, tempo, semitones,
+                                                  cancel.get());
+            cancel->check();   // not written if nobody is waiting for it
+
+            std::string out_id = "stretch_" + random_hex_id(12);
+            renderer::write_wav16(g_cfg.output_dir / (out_id + ".wav"), out.data(),
+                                  (int)(out.size() / 2), pcm.sample_rate);
+
+            json response = {{"id", out_id}, {"audio_url", "/api/export/audio/" + out_id},
+                             {"tempo", tempo}, {"semitones", semitones}};
+            res.set_content(response.dump(), "application/json");
+        } catch (const renderer::Cancelled& e) {
+            error_response(res, 504, std::string("Stretch stopped: ") + e.what());
+        } catch (const json::exception& e) {
+            error_response(res, 400, std::string("Invalid request: ") + e.what());
+        } catch (const std::exception& e) {
+            error_response(res, 503, std::string("Stretch failed: ") + e.what());
+        }
+    });
+
     // --- POST /api/plugins/scan ---
     svr.Post("/api/plugins/scan", [](const httplib::Request& req, httplib::Response& res) {
         std::vector<std::string> extra;
@@ -607,6 +1270,7 @@ int main(int argc, char* argv[]) {
 
     svr.listen("0.0.0.0", port);
 
+    renderer::render_worker().shutdown();
     generator_cleanup();
     return 0;
 }
@@ -0,0 +1,144 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CRESCENT_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Output file created at a fixed size and mapped read/write, so the
+// renderer can fill it in place. Ranges that are finished can be released:
+// their pages leave the process (the data stays in the page cache and the
+// file) which keeps resident memory at the size of the working window.
+// POSIX only; callers check supported() and fall back to buffered output.
+namespace renderer {
+
+class MappedFile {
+public:
+    static constexpr bool supported() {
+#if defined(CRESCENT_HAVE_MMAP)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+#if defined(CRESCENT_HAVE_MMAP)
+    MappedFile(const fs::path& path, size_t size) : path_(path), size_(size) {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) throw std::runtime_error("Cannot create " + path.filename().string());
+        if (::ftruncate(fd_, (off_t)size) != 0) {
+            ::close(fd_);
+            throw std::runtime_error("Cannot size " + path.filename().string());
+        }
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd_);
+            throw std::runtime_error("Cannot map " + path.filename().string());
+        }
+        data_ = static_cast<uint8_t*>(p);
+    }
+
+    ~MappedFile() {
+        if (data_) ::munmap(data_, size_);
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    // Drop the whole pages inside [offset, offset + length) from memory
+    void release(size_t offset, size_t length) {
+        const size_t page = (size_t)::sysconf(_SC_PAGESIZE);
+        size_t begin = (offset + page - 1) / page * page;
+        size_t end = std::min(offset + length, size_) / page * page;
+        if (end > begin) ::madvise(data_ + begin, end - begin, MADV_DONTNEED);
+    }
+
+    // Unmap and cut the file to its final length
+    void finish(size_t final_size) {
+        ::munmap(data_, size_);
+        data_ = nullptr;
+        int rc = ::ftruncate(fd_, (off_t)final_size);
+        ::close(fd_);
+        fd_ = -1;
+        if (rc != 0) throw std::runtime_error("Cannot truncate " + path_.filename().string());
+    }
+#else
+    MappedFile(const fs::path&, size_t) {
+        throw std::runtime_error("Memory-mapped output is not available on this platform");
+    }
+    void release(size_t, size_t) {}
+    void finish(size_t) {}
+#endif
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    uint8_t* data() { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    fs::path path_;
+    uint8_t* data_ = nullptr;
+    size_t   size_ = 0;
+    int      fd_ = -1;
+};
+
+// Input file mapped read-only, for decoders that pick frames straight out
+// of it. Without mmap the file is read into memory instead.
+class MappedInput {
+public:
+    explicit MappedInput(const fs::path& path) {
+#if defined(CRESCENT_HAVE_MMAP)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Cannot open " + path.filename().string());
+        size_ = (size_t)::lseek(fd, 0, SEEK_END);
+        if (size_ > 0) {
+            void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Cannot map " + path.filename().string());
+            }
+            mapped_ = static_cast<const uint8_t*>(p);
+        }
+        ::close(fd);
+        data_ = mapped_;
+#else
+        std::ifstream f(path, std::ios::binary);
+        if (!f) throw std::runtime_error("Cannot open " + path.filename().string());
+        buffer_.assign(std::istreambuf_iterator<char>(f), {});
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+#endif
+    }
+
+    ~MappedInput() {
+#if defined(CRESCENT_HAVE_MMAP)
+        if (mapped_) ::munmap(const_cast<uint8_t*>(mapped_), size_);
+#endif
+    }
+
+    MappedInput(const MappedInput&) = delete;
+    MappedInput& operator=(const MappedInput&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t*       data_ = nullptr;
+    size_t               size_ = 0;
+    const uint8_t*       mapped_ = nullptr;
+    std::vector<uint8_t> buffer_;
+};
+
+} // namespace renderer
@@ -0,0 +1,256 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+#include "groove.h"
+#include "midi_writer.h"
+#include "models.h"
+
+// Key-aware bassline and chord generator for local renders. Scale and
+// chord tables for all 24 MusicalKey values are built at compile time;
+// genre picks the progression and rhythms, mood nudges the progression
+// and the dynamics. Output is plain midi::Note streams on the pitched
+// channels, played by the renderer's synth voices.
+namespace melody {
+
+// ============================================================
+//  Compile-time key tables
+// ============================================================
+
+constexpr std::array<uint8_t, 7> MAJOR_STEPS = {0, 2, 4, 5, 7, 9, 11};
+constexpr std::array<uint8_t, 7> MINOR_STEPS = {0, 2, 3, 5, 7, 8, 10};   // natural minor
+
+constexpr int KEY_COUNT = 24;
+
+// Chord ranges: bass roots in E1..D#2, chord tones voiced in F#3..F4 so
+// successive chords move by small steps
+constexpr int BASS_LOW  = 28;
+constexpr int CHORD_LOW = 54;
+
+struct KeyTable {
+    uint8_t tonic = 0;    // pitch class
+    bool    minor = false;
+    std::array<uint8_t, 7> scale{};                   // pitch classes by degree
+    std::array<uint8_t, 7> bass{};                    // root MIDI note by degree
+    std::array<std::array<uint8_t, 4>, 7> chords{};   // diatonic 7th chord voicings
+};
+
+// MusicalKey enumerates C major, C minor, C# major, ... in that order
+constexpr KeyTable make_key_table(int key) {
+    KeyTable t;
+    t.tonic = (uint8_t)(key / 2);
+    t.minor = key % 2 == 1;
+    const auto& steps = t.minor ? MINOR_STEPS : MAJOR_STEPS;
+    for (int d = 0; d < 7; ++d) t.scale[d] = (uint8_t)((t.tonic + steps[d]) % 12);
+    for (int d = 0; d < 7; ++d) {
+        t.bass[d] = (uint8_t)(BASS_LOW + (t.scale[d] - BASS_LOW % 12 + 12) % 12);
+        // Stack thirds from the scale, each tone placed in the chord range
+        std::array<uint8_t, 4> c{};
+        for (int i = 0; i < 4; ++i) {
+            int pc = t.scale[(d + 2 * i) % 7];
+            c[i] = (uint8_t)(CHORD_LOW + (pc - CHORD_LOW % 12 + 12) % 12);
+        }
+        // Sort the voicing low to high (insertion sort; constexpr-friendly)
+        for (int i = 1; i < 4; ++i)
+            for (int j = i; j > 0 && c[j - 1] > c[j]; --j) {
+                uint8_t tmp = c[j]; c[j] = c[j - 1]; c[j - 1] = tmp;
+            }
+        t.chords[d] = c;
+    }
+    return t;
+}
+
+constexpr std::array<KeyTable, KEY_COUNT> KEY_TABLES = [] {
+    std::array<KeyTable, KEY_COUNT> tables{};
+    for (int k = 0; k < KEY_COUNT; ++k) tables[k] = make_key_table(k);
+    return tables;
+}();
+
+static_assert(KEY_TABLES[(int)MusicalKey::A_MINOR].scale[2] == 0, "A minor has C natural");
+static_assert(KEY_TABLES[(int)MusicalKey::D_MAJOR].scale[2] == 6, "D major has F#");
+static_assert(KEY_TABLES[(int)MusicalKey::C_MAJOR].chords[4][0] >= CHORD_LOW, "voicings stay in range");
+
+constexpr const KeyTable& key_table(MusicalKey key) { return KEY_TABLES[(int)key]; }
+
+// ============================================================
+//  Styles
+// ============================================================
+
+enum class Style { NONE, POP, HIGHLIFE, DEEP, LOG_DRUM, HIPHOP };
+
+inline Style style_for_genre(Genre g) {
+    switch (g) {
+        case Genre::AMAPIANO:         return Style::LOG_DRUM;
+        case Genre::AFRO_HOUSE:
+        case Genre::GQOM:
+        case Genre::KUDURO:
+        case Genre::KWAITO:
+        case Genre::HOUSE:
+        case Genre::EDM:              return Style::DEEP;
+        case Genre::HIGHLIFE:
+        case Genre::JUJU:
+        case Genre::AFROBEAT_CLASSIC:
+        case Genre::SOUKOUS:
+        case Genre::MAKOSSA:
+        case Genre::MBALAX:
+        case Genre::NDOMBOLO:         return Style::HIGHLIFE;
+        case Genre::AFROBEATS:
+        case Genre::AFRO_FUSION:
+        case Genre::RNB:              return Style::POP;
+        case Genre::FUJI:             return Style::NONE;   // percussion ensemble, no bass
+        default:                      return Style::HIPHOP;
+    }
+}
+
+// Four-bar progressions as scale degrees (0 = tonic), one chord per bar
+inline const std::array<uint8_t, 4>& progression(Style style, Mood mood) {
+    static const std::array<uint8_t, 4> pop      = {0, 5, 3, 4};   // I vi IV V
+    static const std::array<uint8_t, 4> highlife = {0, 3, 4, 3};   // I IV V IV
+    static const std::array<uint8_t, 4> deep     = {0, 3, 1, 4};   // i iv ii v
+    static const std::array<uint8_t, 4> dark     = {0, 5, 6, 4};   // i VI VII v
+    if (mood == Mood::DARK || mood == Mood::AGGRESSIVE || mood == Mood::MELANCHOLIC) return dark;
+    switch (style) {
+        case Style::HIGHLIFE: return highlife;
+        case Style::DEEP:
+        case Style::LOG_DRUM: return deep;
+        default:              return pop;
+    }
+}
+
+// One hit of a bar-long rhythm. `tone`: 0 root, 1 fifth, 2 octave, 3 third
+struct Hit {
+    int      pos;    // 16th within the bar
+    int      tone;
+    uint32_t dur;    // ticks
+    int      vel;
+};
+
+inline const std::vector<Hit>& bass_rhythm(Style style) {
+    using namespace midi;
+    static const std::vector<Hit> pop = {       // rolling Afro bassline
+        {0, 0, EIGHTH + SIXTEENTH, 105}, {3, 0, SIXTEENTH, 80}, {6, 1, EIGHTH, 90},
+        {10, 2, EIGHTH, 95}, {14, 1, SIXTEENTH, 80}};
+    static const std::vector<Hit> highlife = {  // walking root-fifth-root-third
+        {0, 0, QUARTER, 100}, {4, 1, QUARTER, 85}, {8, 0, QUARTER, 95}, {12, 3, QUARTER, 85}};
+    static const std::vector<Hit> deep = {      // offbeat house bass
+        {2, 0, EIGHTH, 100}, {6, 0, EIGHTH, 90}, {10, 0, EIGHTH, 100}, {14, 1, EIGHTH, 90}};
+    static const std::vector<Hit> log_drum = {  // amapiano log drum bounce
+        {0, 0, EIGHTH, 100}, {4, 0, EIGHTH, 85}, {8, 1, QUARTER, 95}, {14, 2, SIXTEENTH, 80}};
+    static const std::vector<Hit> hiphop = {    // long 808s
+        {0, 0, HALF + QUARTER, 105}, {10, 0, QUARTER + EIGHTH, 90}};
+    static const std::vector<Hit> none;
+    switch (style) {
+        case Style::POP:      return pop;
+        case Style::HIGHLIFE: return highlife;
+        case Style::DEEP:     return deep;
+        case Style::LOG_DRUM: return log_drum;
+        case Style::HIPHOP:   return hiphop;
+        default:              return none;
+    }
+}
+
+// Chord rhythms: `tone` unused
+inline const std::vector<Hit>& chord_rhythm(Style style) {
+    using namespace midi;
+    static const std::vector<Hit> pop = {       // offbeat guitar-style stabs
+        {2, 0, SIXTEENTH, 70}, {6, 0, SIXTEENTH, 65}, {10, 0, SIXTEENTH, 70}, {14, 0, SIXTEENTH, 65}};
+    static const std::vector<Hit> highlife = {  // bright syncopated comping
+        {0, 0, EIGHTH, 75}, {3, 0, SIXTEENTH, 60}, {6, 0, EIGHTH, 70},
+        {8, 0, EIGHTH, 72}, {11, 0, SIXTEENTH, 60}, {14, 0, EIGHTH, 68}};
+    static const std::vector<Hit> deep = {      // sustained jazz voicing + stabs
+        {0, 0, QUARTER + EIGHTH, 70}, {6, 0, EIGHTH, 60}, {10, 0, EIGHTH, 62}, {14, 0, SIXTEENTH, 58}};
+    static const std::vector<Hit> hiphop = {    // pad
+        {0, 0, WHOLE, 60}};
+    static const std::vector<Hit> none;
+    switch (style) {
+        case Style::POP:      return pop;
+        case Style::HIGHLIFE: return highlife;
+        case Style::DEEP:
+        case Style::LOG_DRUM: return deep;
+        case Style::HIPHOP:   return hiphop;
+        default:              return none;
+    }
+}
+
+inline int mood_velocity_offset(Mood mood) {
+    switch (mood) {
+        case Mood::ENERGETIC:
+        case Mood::AGGRESSIVE: return 10;
+        case Mood::CHILL:
+        case Mood::DREAMY:     return -10;
+        default:               return 0;
+    }
+}
+
+// ============================================================
+//  Generator
+// ============================================================
+
+inline uint8_t bass_tone(const KeyTable& k, int degree, int tone) {
+    int root = k.bass[degree];
+    switch (tone) {
+        case 1:  return (uint8_t)(root + (k.scale[(degree + 4) % 7] - k.scale[degree] + 12) % 12);
+        case 2:  return (uint8_t)(root + 12);
+        case 3:  return (uint8_t)(root + (k.scale[(degree + 2) % 7] - k.scale[degree] + 12) % 12);
+        default: return (uint8_t)root;
+    }
+}
+
+// Bassline and chords for `bars` bars starting at tick 0
+inline void add_melodic_parts(std::vector<midi::Note>& notes, Genre genre, Mood mood,
+                              MusicalKey key, int bars) {
+    const Style style = style_for_genre(genre);
+    if (style == Style::NONE) return;
+
+    const KeyTable& k = key_table(key);
+    const auto& prog = progression(style, mood);
+    const int vel_offset = mood_velocity_offset(mood);
+    const uint8_t bass_channel = style == Style::LOG_DRUM ? midi::LOG_DRUM_CHANNEL : midi::BASS_CHANNEL;
+    auto vel = [&](int v) { return (uint8_t)std::clamp(v + vel_offset, 1, 127); };
+
+    for (int bar = 0; bar < bars; ++bar) {
+        const uint32_t bar_start = bar * midi::WHOLE;
+        const int degree = prog[bar % prog.size()];
+
+        for (auto& h : bass_rhythm(style))
+            midi::add_synth_at_16th(notes, bar_start, h.pos, bass_channel,
+                                    bass_tone(k, degree, h.tone), vel(h.vel), h.dur);
+
+        for (auto& h : chord_rhythm(style))
+            for (uint8_t pitch : k.chords[degree])
+                midi::add_synth_at_16th(notes, bar_start, h.pos, midi::CHORD_CHANNEL,
+                                        pitch, vel(h.vel), h.dur);
+    }
+}
+
+// Drum pattern plus bassline and chords for `bars` bars, played with
+// `feel`. Bar n's notes don't depend on the bar count, so a longer beat
+// extends a shorter one.
+inline std::vector<midi::Note> compose_bars(Genre genre, Mood mood, MusicalKey key, int bars,
+                                            const groove::Feel& feel = {}) {
+    auto notes = midi::drum_notes(genre, bars);
+    add_melodic_parts(notes, genre, mood, key, bars);
+    groove::apply(notes, genre, feel);
+    return notes;
+}
+
+// Bars after which compose_bars repeats itself: drum patterns are one bar
+// long, bassline and chords follow the progression, humanizing repeats
+// every groove::HUMANIZE_BARS
+inline int composition_period(Genre genre, Mood mood, const groove::Feel& feel = {}) {
+    const Style style = style_for_genre(genre);
+    const int period = style == Style::NONE ? 1 : (int)progression(style, mood).size();
+    return feel.humanize > 0.0f ? std::lcm(period, groove::HUMANIZE_BARS) : period;
+}
+
+// Drum pattern plus bassline and chords for a whole render; the renderer
+// and the MIDI export both build their notes here
+inline std::vector<midi::Note> compose_beat(Genre genre, Mood mood, MusicalKey key,
+                                            int bpm, double duration_seconds,
+                                            const groove::Feel& feel = {}) {
+    return compose_bars(genre, mood, key, midi::bar_count(bpm, duration_seconds), feel);
+}
+
+} // namespace melody
@@ -0,0 +1,297 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "midi_writer.h"
+
+// Standard MIDI File reader (format 0 and 1) producing the same Note stream
+// the pattern generators do, so an exported .mid edited in a DAW renders
+// through the normal path. Track data is read in place from the caller's
+// buffer; tracks are merged on the fly in tick order, which lets tempo
+// changes on the conductor track apply to every other track. Every read is
+// bounds-checked and malformed files throw std::invalid_argument.
+namespace midi {
+
+constexpr size_t MAX_IMPORT_NOTES  = 200000;
+constexpr int    MAX_IMPORT_TRACKS = 256;
+constexpr double MAX_IMPORT_SECONDS = 600.0;
+
+// Track names write_midi gives our exports start with this
+constexpr std::string_view EXPORT_TRACK_PREFIX = "Crescent ";
+
+// Which of a file's channels (0-15) play the bass voices. Channel 9 (10 as
+// DAWs number them) is drums, as in General MIDI; every other channel plays
+// the chord voice unless it is mapped here, since DAWs put melodic parts on
+// channel 0 as readily as anywhere. Files this server exported (track name
+// starting EXPORT_TRACK_PREFIX) default to the writer's own channels.
+struct ImportChannels {
+    int bass = -1;       // 808; -1 for none
+    int log_drum = -1;   // amapiano log drum; -1 for none
+};
+
+struct ImportedMidi {
+    int    bpm = 120;                // first tempo, rounded; note ticks are at TPQ for this tempo
+    double duration_seconds = 0.0;   // end of the last note
+    std::vector<Note> notes;
+};
+
+namespace detail {
+
+inline void malformed(const char* what) {
+    throw std::invalid_argument(std::string("Malformed MIDI file: ") + what);
+}
+
+// Bounds-checked big-endian reader over a byte range it doesn't own
+class ByteReader {
+public:
+    ByteReader() = default;
+    ByteReader(const uint8_t* begin, const uint8_t* end) : p_(begin), end_(end) {}
+
+    bool   done() const { return p_ >= end_; }
+    size_t remaining() const { return (size_t)(end_ - p_); }
+
+    uint8_t u8() {
+        if (p_ >= end_) malformed("unexpected end of data");
+        return *p_++;
+    }
+    uint8_t peek() const {
+        if (p_ >= end_) malformed("unexpected end of data");
+        return *p_;
+    }
+    uint16_t be16() { uint16_t v = u8(); return (uint16_t)((v << 8) | u8()); }
+    uint32_t be32() { uint32_t v = be16(); return (v << 16) | be16(); }
+
+    // Variable-length quantity, at most 4 bytes
+    uint32_t vlq() {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) {
+            uint8_t b = u8();
+            v = (v << 7) | (b & 0x7F);
+            if (!(b & 0x80)) return v;
+        }
+        malformed("variable-length value too long");
+        return 0;
+    }
+
+    const uint8_t* take(size_t n) {
+        if (n > remaining()) malformed("chunk runs past end of data");
+        const uint8_t* at = p_;
+        p_ += n;
+        return at;
+    }
+
+private:
+    const uint8_t* p_ = nullptr;
+    const uint8_t* end_ = nullptr;
+};
+
+// One track's event cursor; `tick` is the absolute tick of the pending event
+struct TrackCursor {
+    ByteReader r;
+    uint64_t   tick = 0;
+    uint8_t    running = 0;
+    bool       ended = false;
+
+    void advance() {
+        if (r.done()) { ended = true; return; }
+        tick += r.vlq();
+    }
+};
+
+struct Event {
+    uint8_t  status = 0;     // channel status, or 0xFF meta / 0xF0 sysex
+    uint8_t  data1 = 0, data2 = 0;
+    uint8_t  meta_type = 0;
+    const uint8_t* meta = nullptr;
+    uint32_t meta_len = 0;
+};
+
+inline Event read_event(TrackCursor& c) {
+    Event e;
+    uint8_t status = c.r.peek();
+    if (status < 0x80) {
+        if (!c.running) malformed("running status without a previous status");
+        status = c.running;
+    } else {
+        c.r.u8();
+    }
+
+    if (status == 0xFF) {
+        e.status = 0xFF;
+        e.meta_type = c.r.u8();
+        e.meta_len = c.r.vlq();
+        e.meta = c.r.take(e.meta_len);
+        c.running = 0;
+        if (e.meta_type == 0x2F) c.ended = true;
+        return e;
+    }
+    if (status == 0xF0 || status == 0xF7) {
+        e.status = 0xF0;
+        c.r.take(c.r.vlq());
+        c.running = 0;
+        return e;
+    }
+    if (status >= 0xF0) malformed("system message inside a track");
+
+    c.running = status;
+    e.status = status;
+    e.data1 = c.r.u8() & 0x7F;
+    uint8_t kind = status & 0xF0;
+    if (kind != 0xC0 && kind != 0xD0) e.data2 = c.r.u8() & 0x7F;
+    return e;
+}
+
+inline uint8_t import_channel(uint8_t ch, const ImportChannels& channels) {
+    if (ch == DRUM_CHANNEL)      return DRUM_CHANNEL;
+    if (ch == channels.bass)     return BASS_CHANNEL;
+    if (ch == channels.log_drum) return LOG_DRUM_CHANNEL;
+    return CHORD_CHANNEL;
+}
+
+} // namespace detail
+
+// Parse an SMF held in `data`; nothing is copied out of it but the notes
+inline ImportedMidi read_midi(std::string_view data, const ImportChannels& channels = {}) {
+    using namespace detail;
+    ByteReader file(reinterpret_cast<const uint8_t*>(data.data()),
+                    reinterpret_cast<const uint8_t*>(data.data()) + data.size());
+
+    if (file.remaining() < 14 || data.substr(0, 4) != "MThd") malformed("missing MThd header");
+    file.take(4);
+    uint32_t header_len = file.be32();
+    if (header_len < 6) malformed("short header");
+    uint16_t format   = file.be16();
+    uint16_t ntracks  = file.be16();
+    uint16_t division = file.be16();
+    file.take(header_len - 6);
+    if (format > 1) malformed("only format 0 and 1 files are supported");
+    if (ntracks == 0 || ntracks > MAX_IMPORT_TRACKS) malformed("bad track count");
+    if (division == 0) malformed("zero time division");
+
+    // Seconds per tick: metrical (ticks per quarter, tempo-dependent) or
+    // SMPTE (frames per second * ticks per frame, fixed)
+    const bool smpte = division & 0x8000;
+    const double smpte_tick = smpte
+        ? 1.0 / ((double)(256 - (division >> 8)) * (division & 0xFF)) : 0.0;
+    if (smpte && (division & 0xFF) == 0) malformed("zero SMPTE resolution");
+    const double ppq = smpte ? 1.0 : (double)division;
+
+    std::vector<TrackCursor> tracks;
+    while (!file.done() && (int)tracks.size() < ntracks) {
+        if (file.remaining() < 8) malformed("truncated chunk header");
+        const uint8_t* id = file.take(4);
+        uint32_t len = file.be32();
+        const uint8_t* body = file.take(len);
+        if (std::string_view(reinterpret_cast<const char*>(id), 4) != "MTrk") continue;   // unknown chunk
+        TrackCursor c;
+        c.r = ByteReader(body, body + len);
+        c.advance();
+        tracks.push_back(c);
+    }
+    if (tracks.empty()) malformed("no tracks");
+
+    // Merge tracks by tick; ties keep track order so the conductor track's
+    // tempo lands before notes on the same tick
+    auto later = [&](int a, int b) {
+        return tracks[a].tick != tracks[b].tick ? tracks[a].tick > tracks[b].tick : a > b;
+    };
+    std::priority_queue<int, std::vector<int>, decltype(later)> queue(later);
+    for (int t = 0; t < (int)tracks.size(); ++t)
+        if (!tracks[t].ended) queue.push(t);
+
+    ImportedMidi out;
+    bool exported = false;   // one of our own exports
+    double us_per_quarter = 500000.0;
+    bool tempo_seen = false;
+    uint64_t segment_tick = 0;      // tick of the last tempo change
+    double   segment_seconds = 0.0;
+    auto seconds_at = [&](uint64_t tick) {
+        double per_tick = smpte ? smpte_tick : us_per_quarter / 1e6 / ppq;
+        return segment_seconds + (double)(tick - segment_tick) * per_tick;
+    };
+
+    struct Held { double start = -1.0; uint8_t velocity = 0; };
+    std::array<std::array<Held, 128>, 16> held{};
+    struct TimedNote { double start, end; uint8_t pitch, velocity, channel; };
+    std::vector<TimedNote> timed;
+
+    auto close = [&](int ch, int pitch, double at) {
+        Held& h = held[ch][pitch];
+        if (h.start < 0.0) return;
+        if (timed.size() >= MAX_IMPORT_NOTES) throw std::invalid_argument("MIDI file has too many notes");
+        timed.push_back({h.start, std::max(at, h.start), (uint8_t)pitch, h.velocity, (uint8_t)ch});
+        h.start = -1.0;
+    };
+
+    double end_seconds = 0.0;
+    while (!queue.empty()) {
+        int t = queue.top();
+        queue.pop();
+        TrackCursor& c = tracks[t];
+        const double now = seconds_at(c.tick);
+        if (now > MAX_IMPORT_SECONDS) throw std::invalid_argument("MIDI file is longer than 10 minutes");
+        Event e = read_event(c);
+
+        if (e.status == 0xFF) {
+            if (e.meta_type == 0x51 && e.meta_len == 3 && !smpte) {
+                double tempo = (e.meta[0] << 16) | (e.meta[1] << 8) | e.meta[2];
+                if (tempo <= 0) malformed("zero tempo");
+                segment_seconds = now;
+                segment_tick = c.tick;
+                us_per_quarter = tempo;
+                if (!tempo_seen) {
+                    out.bpm = std::clamp((int)std::lround(60e6 / tempo), 20, 400);
+                    tempo_seen = true;
+                }
+            } else if (e.meta_type == 0x03) {
+                exported = exported || std::string_view(reinterpret_cast<const char*>(e.meta), e.meta_len)
+                                           .starts_with(EXPORT_TRACK_PREFIX);
+            }
+        } else if (e.status != 0xF0) {
+            const int ch = e.status & 0x0F;
+            const uint8_t kind = e.status & 0xF0;
+            if (kind == 0x90 && e.data2 > 0) {
+                close(ch, e.data1, now);   // retrigger ends the held note
+                held[ch][e.data1] = {now, e.data2};
+            } else if (kind == 0x80 || kind == 0x90) {
+                close(ch, e.data1, now);
+            }
+        }
+        end_seconds = std::max(end_seconds, now);
+
+        if (!c.ended) {
+            c.advance();
+            if (!c.ended) queue.push(t);
+        }
+    }
+    for (int ch = 0; ch < 16; ++ch)
+        for (int p = 0; p < 128; ++p) close(ch, p, end_seconds);
+
+    // Our exports put the 808 and log drum on their own channels
+    ImportChannels map = channels;
+    if (exported) {
+        if (map.bass < 0)     map.bass = BASS_CHANNEL;
+        if (map.log_drum < 0) map.log_drum = LOG_DRUM_CHANNEL;
+    }
+
+    // Re-time onto the render grid at the first tempo
+    const double ticks_per_second = out.bpm * (double)TPQ / 60.0;
+    out.notes.reserve(timed.size());
+    for (auto& n : timed) {
+        uint32_t tick = (uint32_t)std::lround(n.start * ticks_per_second);
+        uint32_t dur  = std::max<uint32_t>(1, (uint32_t)std::lround((n.end - n.start) * ticks_per_second));
+        out.notes.push_back({tick, n.pitch, n.velocity, dur, import_channel(n.channel, map)});
+        out.duration_seconds = std::max(out.duration_seconds, n.end);
+    }
+    std::stable_sort(out.notes.begin(), out.notes.end(),
+                     [](const Note& a, const Note& b) { return a.tick < b.tick; });
+    return out;
+}
+
+} // namespace midi
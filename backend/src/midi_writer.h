@@ -92,11 +92,24 @@ constexpr uint8_t LO_TIMBALE  = 66;  // sakara low / bata
 //  Note and pattern helpers
 // ============================================================
 
+// MIDI channels (0-based). Percussion uses the GM drum channel; pitched
+// parts have a channel each, which also picks the renderer's synth voice.
+constexpr uint8_t BASS_CHANNEL     = 0;   // 808 sub bass
+constexpr uint8_t LOG_DRUM_CHANNEL = 1;   // amapiano log drum
+constexpr uint8_t CHORD_CHANNEL    = 2;   // chord stabs / pads
+constexpr uint8_t DRUM_CHANNEL     = 9;
+
 struct Note {
     uint32_t tick;
     uint8_t  pitch;
     uint8_t  velocity;
     uint32_t duration;
+    uint8_t  channel = DRUM_CHANNEL;
+    // Render-only sample pitch: fixed offset, plus a bend reached over the
+    // note's duration (talking drum / sakara). Not written to MIDI files,
+    // where a drum-channel bend would move every drum at once.
+    int16_t  cents = 0;
+    int16_t  bend  = 0;
 };
 
 // Ticks per quarter note
@@ -116,6 +129,21 @@ inline void add_at_16th(std::vector<Note>& notes, uint32_t bar_start,
     notes.push_back({bar_start + (uint32_t)(sixteenth_pos * SIXTEENTH), pitch, vel, dur});
 }
 
+// Drum hit whose pitch slides by `bend` cents over its duration
+inline void add_bend_at_16th(std::vector<Note>& notes, uint32_t bar_start, int sixteenth_pos,
+                             uint8_t pitch, uint8_t vel, int16_t bend,
+                             uint32_t dur = EIGHTH) {
+    notes.push_back({bar_start + (uint32_t)(sixteenth_pos * SIXTEENTH), pitch, vel, dur,
+                     DRUM_CHANNEL, 0, bend});
+}
+
+// Pitched note on a synth channel at a 16th-note position
+inline void add_synth_at_16th(std::vector<Note>& notes, uint32_t bar_start, int sixteenth_pos,
+                              uint8_t channel, uint8_t pitch, uint8_t vel,
+                              uint32_t dur = EIGHTH) {
+    notes.push_back({bar_start + (uint32_t)(sixteenth_pos * SIXTEENTH), pitch, vel, dur, channel});
+}
+
 // Add a note at a specific triplet-8th position within a bar (for 12/8)
 inline void add_at_trip8(std::vector<Note>& notes, uint32_t bar_start,
                          int trip_pos, uint8_t pitch, uint8_t vel,
@@ -164,10 +192,7 @@ inline void pattern_afrobeats(std::vector<Note>& notes, uint32_t bar) {
 
 // --- AMAPIANO: Log drum bounce ---
 inline void pattern_amapiano(std::vector<Note>& notes, uint32_t bar) {
-    // Log drum (low tom): 1, 2, 3 (pos 0, 4, 8)
-    add_at_16th(notes, bar, 0, LOW_TOM, 100);
-    add_at_16th(notes, bar, 4, LOW_TOM, 85);
-    add_at_16th(notes, bar, 8, LOW_TOM, 95);
+    // Log drum: key-aware line from melody::add_melodic_parts
     // Kick ghost: and-of-1 (pos 3), and-of-3 (pos 10)
     add_at_16th(notes, bar, 3, KICK, 70);
     add_at_16th(notes, bar, 10, KICK, 75);
@@ -244,13 +269,13 @@ inline void pattern_juju(std::vector<Note>& notes, uint32_t bar) {
     // Soft kick foundation
     add_at_16th(notes, bar, 0, KICK, 80);
     add_at_16th(notes, bar, 8, KICK, 75);
-    // Talking drum lead (bongo mapped)
-    add_at_16th(notes, bar, 2, HI_BONGO, 90);
+    // Talking drum lead (bongo mapped), bent like speech
+    add_bend_at_16th(notes, bar, 2, HI_BONGO, 90, 300);
     add_at_16th(notes, bar, 4, LO_BONGO, 85);
-    add_at_16th(notes, bar, 7, HI_BONGO, 95);
+    add_bend_at_16th(notes, bar, 7, HI_BONGO, 95, -200);
     add_at_16th(notes, bar, 9, LO_BONGO, 80);
-    add_at_16th(notes, bar, 11, HI_BONGO, 85);
-    add_at_16th(notes, bar, 14, LO_BONGO, 90);
+    add_bend_at_16th(notes, bar, 11, HI_BONGO, 85, 400);
+    add_bend_at_16th(notes, bar, 14, LO_BONGO, 90, -300);
     // Shekere constant
     for (int i = 0; i < 16; ++i)
         add_at_16th(notes, bar, i, TAMBOURINE, 50 + (i % 4 == 0 ? 15 : 0));
@@ -267,20 +292,20 @@ inline void pattern_fuji(std::vector<Note>& notes, uint32_t bar) {
     // Dundun ghost notes
     add_at_16th(notes, bar, 6, LOW_TOM, 65);
     add_at_16th(notes, bar, 14, LOW_TOM, 60);
-    // Talking drum fills
-    add_at_16th(notes, bar, 1, HI_BONGO, 85);
-    add_at_16th(notes, bar, 3, LO_BONGO, 90);
-    add_at_16th(notes, bar, 5, HI_BONGO, 80);
+    // Talking drum fills, squeezed up and released down
+    add_bend_at_16th(notes, bar, 1, HI_BONGO, 85, 300);
+    add_bend_at_16th(notes, bar, 3, LO_BONGO, 90, -200);
+    add_bend_at_16th(notes, bar, 5, HI_BONGO, 80, 200);
     add_at_16th(notes, bar, 7, LO_BONGO, 85);
-    add_at_16th(notes, bar, 9, HI_BONGO, 90);
-    add_at_16th(notes, bar, 11, LO_BONGO, 80);
-    add_at_16th(notes, bar, 13, HI_BONGO, 85);
+    add_bend_at_16th(notes, bar, 9, HI_BONGO, 90, 400);
+    add_bend_at_16th(notes, bar, 11, LO_BONGO, 80, -300);
+    add_bend_at_16th(notes, bar, 13, HI_BONGO, 85, 200);
     add_at_16th(notes, bar, 15, LO_BONGO, 75);
-    // Sakara drum (timbale mapped)
+    // Sakara drum (timbale mapped), low strokes dropping slightly
     add_at_16th(notes, bar, 0, HI_TIMBALE, 85);
-    add_at_16th(notes, bar, 4, LO_TIMBALE, 80);
+    add_bend_at_16th(notes, bar, 4, LO_TIMBALE, 80, -100);
     add_at_16th(notes, bar, 8, HI_TIMBALE, 85);
-    add_at_16th(notes, bar, 12, LO_TIMBALE, 80);
+    add_bend_at_16th(notes, bar, 12, LO_TIMBALE, 80, -150);
     // Shekere constant
     for (int i = 0; i < 16; ++i)
         add_at_16th(notes, bar, i, TAMBOURINE, 55);
@@ -571,20 +596,26 @@ inline PatternFunc get_pattern_for_genre(Genre genre) {
 //  MIDI file writer (genre-aware)
 // ============================================================
 
-inline bool write_drum_midi(const std::string& path, int bpm, double duration_seconds,
-                            Genre genre = Genre::HIPHOP) {
-    auto pattern_fn = get_pattern_for_genre(genre);
-
+inline int bar_count(int bpm, double duration_seconds) {
     double beats_per_bar = 4.0;
     double seconds_per_bar = (beats_per_bar / bpm) * 60.0;
-    int total_bars = std::max(1, (int)(duration_seconds / seconds_per_bar));
+    return std::max(1, (int)(duration_seconds / seconds_per_bar));
+}
 
+// The genre's one-bar drum pattern repeated `bars` times
+inline std::vector<Note> drum_notes(Genre genre, int bars) {
+    auto pattern_fn = get_pattern_for_genre(genre);
     std::vector<Note> notes;
-    for (int bar = 0; bar < total_bars; ++bar) {
+    for (int bar = 0; bar < bars; ++bar) {
         uint32_t bar_start = bar * WHOLE;
         pattern_fn(notes, bar_start);
     }
+    return notes;
+}
 
+// Single-track SMF with each note on its own channel
+inline bool write_midi(const std::string& path, int bpm, std::vector<Note> notes,
+                       const char* name = "Crescent Afro Percussion") {
     // Sort by tick
     std::sort(notes.begin(), notes.end(), [](const Note& a, const Note& b) {
         return a.tick < b.tick;
@@ -595,7 +626,6 @@ inline bool write_drum_midi(const std::string& path, int bpm, double duration_se
 
     // Track name
     {
-        const char* name = "Crescent Afro Percussion";
         write_var_len(track, 0);
         track.push_back(0xFF);
         track.push_back(0x03);
@@ -617,7 +647,7 @@ inline bool write_drum_midi(const std::string& path, int bpm, double duration_se
         track.push_back(us_per_beat & 0xFF);
     }
 
-    // Note events (channel 9)
+    // Note events on each note's channel
     struct Event {
         uint32_t tick;
         uint8_t  status;
@@ -626,11 +656,13 @@ inline bool write_drum_midi(const std::string& path, int bpm, double duration_se
     };
     std::vector<Event> events;
     for (auto& n : notes) {
-        events.push_back({n.tick, 0x99, n.pitch, n.velocity});
-        events.push_back({n.tick + n.duration, 0x89, n.pitch, 0});
+        events.push_back({n.tick, (uint8_t)(0x90 | n.channel), n.pitch, n.velocity});
+        events.push_back({n.tick + n.duration, (uint8_t)(0x80 | n.channel), n.pitch, 0});
     }
+    // Note-offs first on a shared tick, so repeated pitches retrigger
     std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
-        return a.tick < b.tick;
+        if (a.tick != b.tick) return a.tick < b.tick;
+        return (a.status & 0xF0) < (b.status & 0xF0);
     });
 
     uint32_t prev_tick = 0;
@@ -666,4 +698,9 @@ inline bool write_drum_midi(const std::string& path, int bpm, double duration_se
     return true;
 }
 
+inline bool write_drum_midi(const std::string& path, int bpm, double duration_seconds,
+                            Genre genre = Genre::HIPHOP) {
+    return write_midi(path, bpm, drum_notes(genre, bar_count(bpm, duration_seconds)));
+}
+
 } // namespace midi
@@ -0,0 +1,225 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../deps/json.hpp"
+#include "effects.h"
+#include "midi_writer.h"
+
+using json = nlohmann::json;
+
+// Instrument group buses for the offline renderer: every MIDI note belongs
+// to one group, and each group has gain / pan / mute / solo.
+namespace mixer {
+
+// ============================================================
+//  Instrument groups
+// ============================================================
+
+struct InstrumentGroup {
+    std::string              name;
+    std::vector<std::string> aliases;  // `instruments` values that select this group
+    std::vector<uint8_t>     notes;    // drum-channel notes
+    int                      channel = -1;  // pitched channel owned entirely, if any
+};
+
+// Names follow all_instruments() where one exists. Groups without their own
+// entry in the picker are selected by the closest family (claves with drums,
+// gankogui with agogo bells, ...).
+inline const std::vector<InstrumentGroup>& get_instrument_groups() {
+    using namespace midi;
+    static const std::vector<InstrumentGroup> groups = {
+        {"drums",        {"drums"},                   {KICK, SIDE_STICK, SNARE, CLAP, SNARE_ELEC,
+                                                       CLOSED_HH, PEDAL_HH, OPEN_HH, CRASH, RIDE, RIDE_BELL}},
+        {"claves",       {"claves", "drums"},         {CLAVES}},
+        {"dundun",       {"dundun"},                  {LOW_TOM}},
+        {"djembe",       {"djembe", "bougarabou"},    {MID_TOM, HI_TOM}},
+        {"talking drum", {"talking drum"},            {HI_BONGO, LO_BONGO}},
+        {"congas",       {"congas"},                  {MUTE_CONGA, OPEN_CONGA, LOW_CONGA}},
+        {"sakara drum",  {"sakara drum", "bata drums"}, {HI_TIMBALE, LO_TIMBALE}},
+        {"shakers",      {"shakers"},                 {MARACAS}},
+        {"shekere",      {"shekere", "shakers"},      {TAMBOURINE}},
+        {"axatse",       {"axatse", "shakers"},       {CABASA}},
+        {"cowbell",      {"cowbell"},                 {COWBELL}},
+        {"agogo bells",  {"agogo bells"},             {HI_AGOGO, LO_AGOGO}},
+        {"gankogui",     {"gankogui", "agogo bells"}, {HI_WOODBLK, LO_WOODBLK}},
+        {"808",          {"808", "bass"},             {}, BASS_CHANNEL},
+        {"log drum",     {"log drum"},                {}, LOG_DRUM_CHANNEL},
+        {"chords",       {"chord progression", "piano", "rhodes", "pad", "organ"}, {}, CHORD_CHANNEL},
+    };
+    return groups;
+}
+
+inline int group_count() { return (int)get_instrument_groups().size(); }
+
+// Group index of a MIDI note; unmapped notes ride on the drums bus
+inline int group_for_note(uint8_t note) {
+    static const std::array<uint8_t, 128> table = [] {
+        std::array<uint8_t, 128> t{};
+        auto& groups = get_instrument_groups();
+        for (int g = 0; g < (int)groups.size(); ++g)
+            for (auto n : groups[g].notes) t[n & 0x7F] = (uint8_t)g;
+        return t;
+    }();
+    return table[note & 0x7F];
+}
+
+// Group of a note on any channel; pitched channels without a group of
+// their own fall back to the drums bus as well
+inline int group_for(const midi::Note& note) {
+    if (note.channel == midi::DRUM_CHANNEL) return group_for_note(note.pitch);
+    auto& groups = get_instrument_groups();
+    for (int g = 0; g < (int)groups.size(); ++g)
+        if (groups[g].channel == note.channel) return g;
+    return 0;
+}
+
+inline int group_index(const std::string& name) {
+    auto& groups = get_instrument_groups();
+    for (int g = 0; g < (int)groups.size(); ++g)
+        if (groups[g].name == name) return g;
+    return -1;
+}
+
+// ============================================================
+//  Constant-power pan law
+// ============================================================
+
+constexpr int PAN_STEPS = 256;
+
+// Left/right gains for pan positions -1..1, scaled so center is unity
+// (hard left/right is +3 dB on the near side)
+inline const std::array<float, (PAN_STEPS + 1) * 2>& pan_table() {
+    static const std::array<float, (PAN_STEPS + 1) * 2> t = [] {
+        std::array<float, (PAN_STEPS + 1) * 2> t{};
+        for (int i = 0; i <= PAN_STEPS; ++i) {
+            double angle = (double)i / PAN_STEPS * M_PI / 2.0;
+            t[i * 2]     = (float)(std::cos(angle) * M_SQRT2);
+            t[i * 2 + 1] = (float)(std::sin(angle) * M_SQRT2);
+        }
+        return t;
+    }();
+    return t;
+}
+
+inline void pan_gains(float pan, float& left, float& right) {
+    int i = (int)std::lround((std::clamp(pan, -1.0f, 1.0f) + 1.0f) * 0.5f * PAN_STEPS);
+    left  = pan_table()[i * 2];
+    right = pan_table()[i * 2 + 1];
+}
+
+// ============================================================
+//  Mixer settings
+// ============================================================
+
+struct BusSettings {
+    float gain = 1.0f;   // linear
+    float pan  = 0.0f;   // -1 (left) .. 1 (right)
+    bool  mute = false;
+    bool  solo = false;
+    std::vector<dsp::EffectSpec> effects;   // insert chain, before gain/pan
+};
+
+// Kick-style ducking: every trigger note pulls the target buses down by
+// `depth` (scaled by velocity), ramping over `attack` and recovering over
+// `release`. Driven by note events, not by analyzing the trigger audio, so
+// a muted kick still pumps the bass.
+struct SidechainSettings {
+    std::vector<uint8_t> triggers = {midi::KICK};
+    std::vector<int>     targets;            // group indices
+    float depth   = 0.6f;    // 0..1 gain reduction at full velocity
+    float attack  = 0.005f;  // seconds to full reduction
+    float release = 0.18f;   // seconds back to within 1% of unity
+};
+
+struct MixerSettings {
+    std::vector<BusSettings> buses = std::vector<BusSettings>(group_count());
+    std::vector<SidechainSettings> sidechains;
+
+    bool any_solo() const {
+        return std::any_of(buses.begin(), buses.end(), [](const BusSettings& b) { return b.solo; });
+    }
+
+    // Audible buses: not muted, and soloed if anything is soloed
+    bool audible(int group) const {
+        const auto& b = buses[group];
+        if (b.mute || b.gain <= 0.0f) return false;
+        return !any_solo() || b.solo;
+    }
+
+    bool note_audible(const midi::Note& note) const { return audible(group_for(note)); }
+};
+
+// One `sidechain` object (or an array of them):
+//   {"triggers": [36], "targets": ["808", "log drum"],
+//    "depth": 0.6, "attack": 0.005, "release": 0.18}
+// Unknown target names are ignored, like unknown `mixer` keys
+inline SidechainSettings sidechain_from_json(const json& j) {
+    SidechainSettings sc;
+    if (j.contains("triggers") && j["triggers"].is_array()) {
+        sc.triggers.clear();
+        for (auto& t : j["triggers"])
+            if (t.is_number_integer()) sc.triggers.push_back((uint8_t)(t.get<int>() & 0x7F));
+    }
+    if (j.contains("targets") && j["targets"].is_array()) {
+        for (auto& t : j["targets"]) {
+            int g = t.is_string() ? group_index(t.get<std::string>()) : -1;
+            if (g >= 0) sc.targets.push_back(g);
+        }
+    }
+    sc.depth   = std::clamp(j.value("depth", sc.depth), 0.0f, 1.0f);
+    sc.attack  = std::clamp(j.value("attack", sc.attack), 0.0f, 0.5f);
+    sc.release = std::clamp(j.value("release", sc.release), 0.01f, 2.0f);
+    return sc;
+}
+
+// Reads the optional `instruments` list (groups not selected are muted) and
+// the `mixer` object keyed by group name, plus optional `sidechain`:
+//   "mixer": {"congas": {"gain": 0.8, "pan": -0.3, "mute": false, "solo": false,
+//                        "effects": [{"type": "EQ3", "params": {...}}]}}
+inline MixerSettings mixer_from_json(const json& j) {
+    MixerSettings m;
+    auto& groups = get_instrument_groups();
+
+    if (j.contains("instruments") && j["instruments"].is_array() && !j["instruments"].empty()) {
+        std::vector<std::string> selected;
+        for (auto& i : j["instruments"]) selected.push_back(i.get<std::string>());
+        for (int g = 0; g < (int)groups.size(); ++g) {
+            bool picked = std::any_of(groups[g].aliases.begin(), groups[g].aliases.end(),
+                [&](const std::string& a) {
+                    return std::find(selected.begin(), selected.end(), a) != selected.end();
+                });
+            if (!picked) m.buses[g].mute = true;
+        }
+    }
+
+    if (j.contains("mixer") && j["mixer"].is_object()) {
+        for (auto& [name, bus] : j["mixer"].items()) {
+            int g = group_index(name);
+            if (g < 0 || !bus.is_object()) continue;
+            auto& b = m.buses[g];
+            b.gain = std::max(0.0f, bus.value("gain", b.gain));
+            b.pan  = std::clamp(bus.value("pan", b.pan), -1.0f, 1.0f);
+            b.mute = bus.value("mute", b.mute);
+            b.solo = bus.value("solo", b.solo);
+            if (bus.contains("effects")) b.effects = dsp::effect_chain_from_json(bus["effects"]);
+        }
+    }
+
+    if (j.contains("sidechain")) {
+        const auto& sc = j["sidechain"];
+        if (sc.is_object()) m.sidechains.push_back(sidechain_from_json(sc));
+        else if (sc.is_array())
+            for (auto& e : sc)
+                if (e.is_object()) m.sidechains.push_back(sidechain_from_json(e));
+        std::erase_if(m.sidechains, [](const SidechainSettings& s) {
+            return s.targets.empty() || s.triggers.empty() || s.depth <= 0.0f;
+        });
+    }
+    return m;
+}
+
+} // namespace mixer
@@ -0,0 +1,308 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "effects.h"
+#include "sample_library.h"
+
+// Procedural percussion for the sample library, so the offline renderer
+// works on a fresh install with no network. Drums, bells and woods are
+// modal: a sum of exponentially decaying modes at the ratios of a struck
+// membrane, bar or bell, with a short noise strike and a pitch glide
+// (tension on hard hits, the squeeze of a talking drum). Cymbals add the
+// six clustered square partials of the 808 through a highpass; shakers
+// are random bead collisions ringing their shell resonances (after Cook's
+// PhISEM); claps are staggered noise bursts. Harder velocity zones strike
+// brighter, round-robin alternates detune and reseed a little. The same
+// entry, zone and alternate always come out the same.
+namespace percussion {
+
+struct Mode {
+    double ratio;    // to the body fundamental
+    double level;
+    double t60;      // seconds to -60 dB
+};
+
+struct Recipe {
+    double f0 = 0.0;                 // body fundamental, Hz (0: no body)
+    std::vector<Mode> modes;
+    double glide = 1.0;              // pitch starts at f0 * glide ...
+    double bend = 1.0;               // ... and settles at f0 * bend
+    double glide_time = 0.02;        // time constant, seconds
+
+    double strike = 0.0, strike_t60 = 0.005;            // noise excitation
+    double strike_lo = 1000.0, strike_hi = 8000.0;
+    double noise = 0.0, noise_t60 = 0.1;                // sustained noise: snares, wash, clap
+    double noise_lo = 2000.0, noise_hi = 12000.0;
+    int    bursts = 0;                                   // clap: bursts before the noise tail
+    double burst_gap = 0.011;
+
+    double metal = 0.0, metal_base = 205.3, metal_t60 = 0.1, metal_hp = 6000.0;
+
+    double shake = 0.0, shake_t60 = 0.1, collisions = 2000.0;   // per second at full energy
+    std::vector<double> shell;                                   // resonances, Hz
+};
+
+// Circular membrane (01, 11, 21, 02, 31, 12, 41, 22) and free bar mode ratios
+constexpr std::array<double, 8> MEMBRANE = {1.0, 1.594, 2.136, 2.296, 2.653, 2.918, 3.156, 3.501};
+constexpr std::array<double, 3> BAR = {1.0, 2.756, 5.404};
+
+inline Recipe recipe_for(const samples::PercussionSample& s) {
+    const auto& m = MEMBRANE;
+    Recipe r;
+    const std::string& n = s.name;
+    if (n == "kick") {
+        r.f0 = 52; r.modes = {{m[0], 1, 0.55}, {m[1], 0.18, 0.2}, {m[3], 0.08, 0.12}};
+        r.glide = 3.2; r.glide_time = 0.03;
+        r.strike = 0.35; r.strike_t60 = 0.004; r.strike_lo = 1500; r.strike_hi = 9000;
+    } else if (n == "side_stick") {
+        r.f0 = 1700; r.modes = {{BAR[0], 1, 0.07}, {BAR[1], 0.45, 0.04}, {BAR[2], 0.2, 0.025}};
+        r.strike = 0.5; r.strike_t60 = 0.002; r.strike_lo = 2000; r.strike_hi = 10000;
+    } else if (n == "snare") {
+        r.f0 = 185; r.modes = {{m[0], 1, 0.22}, {m[1], 0.6, 0.16}, {m[2], 0.4, 0.12}, {m[3], 0.3, 0.1}, {m[4], 0.2, 0.08}};
+        r.glide = 1.15; r.glide_time = 0.01;
+        r.strike = 0.4; r.strike_t60 = 0.003; r.strike_lo = 2000; r.strike_hi = 9000;
+        r.noise = 0.75; r.noise_t60 = 0.25; r.noise_lo = 1800; r.noise_hi = 10000;
+    } else if (n == "clap") {
+        r.noise = 1.0; r.noise_t60 = 0.2; r.noise_lo = 900; r.noise_hi = 4000;
+        r.bursts = 4; r.burst_gap = 0.011;
+    } else if (n == "dundun") {
+        r.f0 = 68; r.modes = {{m[0], 1, 0.9}, {m[1], 0.35, 0.5}, {m[2], 0.2, 0.35}, {m[3], 0.15, 0.3}};
+        r.glide = 1.5; r.glide_time = 0.05;
+        r.strike = 0.3; r.strike_lo = 800; r.strike_hi = 5000;
+    } else if (n == "closed_hh" || n == "open_hh") {
+        const bool open = n == "open_hh";
+        r.metal = 0.8; r.metal_base = 420; r.metal_t60 = open ? 0.7 : 0.06; r.metal_hp = open ? 7000 : 7500;
+        r.noise = open ? 0.3 : 0.35; r.noise_t60 = open ? 0.6 : 0.05; r.noise_lo = open ? 7000 : 8000; r.noise_hi = 16000;
+        r.strike = 0.2; r.strike_t60 = 0.002; r.strike_lo = 6000; r.strike_hi = 16000;
+    } else if (n == "djembe_bass") {
+        r.f0 = 75; r.modes = {{m[0], 1, 0.45}, {m[1], 0.3, 0.25}, {m[3], 0.15, 0.15}};
+        r.glide = 1.2; r.glide_time = 0.02;
+        r.strike = 0.35; r.strike_t60 = 0.004; r.strike_lo = 600; r.strike_hi = 4000;
+    } else if (n == "djembe_slap") {
+        r.f0 = 380; r.modes = {{m[0], 0.5, 0.12}, {m[1], 0.8, 0.1}, {m[2], 0.7, 0.08}, {m[4], 0.6, 0.07}, {m[6], 0.5, 0.05}, {m[7], 0.4, 0.05}};
+        r.strike = 0.8; r.strike_t60 = 0.006; r.strike_lo = 1500; r.strike_hi = 9000;
+        r.noise = 0.3; r.noise_t60 = 0.06; r.noise_lo = 2000; r.noise_hi = 8000;
+    } else if (n == "ride") {
+        r.f0 = 480; r.modes = {{1, 0.5, 2.5}, {2.32, 0.4, 2.0}, {3.97, 0.35, 1.6}, {5.21, 0.3, 1.3}, {6.95, 0.25, 1.1}};
+        r.metal = 0.45; r.metal_base = 330; r.metal_t60 = 1.4; r.metal_hp = 5000;
+        r.noise = 0.12; r.noise_t60 = 1.2; r.noise_lo = 6000; r.noise_hi = 15000;
+        r.strike = 0.25; r.strike_t60 = 0.003; r.strike_lo = 3000; r.strike_hi = 12000;
+    } else if (n == "shekere") {
+        r.shake = 1.0; r.shake_t60 = 0.3; r.collisions = 3000; r.shell = {2800, 5200, 8200};
+    } else if (n == "cowbell") {
+        r.f0 = 560; r.modes = {{1, 1, 0.35}, {1.48, 0.8, 0.3}, {3, 0.25, 0.15}, {4.44, 0.2, 0.12}};
+        r.strike = 0.2; r.strike_t60 = 0.002; r.strike_lo = 2000; r.strike_hi = 8000;
+    } else if (n == "talking_drum_high" || n == "talking_drum_low") {
+        const bool high = n == "talking_drum_high";
+        r.f0 = high ? 260 : 170; r.modes = {{m[0], 1, 0.5}, {m[1], 0.4, 0.3}, {m[2], 0.25, 0.2}, {m[3], 0.15, 0.18}};
+        r.glide = 1.08; r.bend = high ? 0.82 : 0.86; r.glide_time = 0.12;
+        r.strike = 0.3; r.strike_t60 = 0.004; r.strike_lo = 1000; r.strike_hi = 6000;
+    } else if (n == "mute_conga") {
+        r.f0 = 340; r.modes = {{m[0], 1, 0.07}, {m[1], 0.6, 0.05}, {m[2], 0.4, 0.04}};
+        r.strike = 0.6; r.strike_t60 = 0.004; r.strike_lo = 1500; r.strike_hi = 8000;
+    } else if (n == "open_conga" || n == "low_conga") {
+        const bool low = n == "low_conga";
+        const double t = low ? 0.55 : 0.5;
+        r.f0 = low ? 205 : 310; r.modes = {{m[0], 1, t}, {m[1], 0.3, t * 0.6}, {m[2], 0.2, t * 0.4}, {m[3], 0.12, t * 0.36}};
+        r.glide = 1.04; r.glide_time = 0.01;
+        r.strike = 0.35; r.strike_t60 = 0.003; r.strike_lo = 1000; r.strike_hi = 6000;
+    } else if (n == "sakara_high" || n == "sakara_low") {
+        const bool high = n == "sakara_high";
+        const double t = high ? 0.25 : 0.3;
+        r.f0 = high ? 280 : 185;
+        r.modes = {{m[0], 1, t}, {m[1], 0.6, t * 0.72}, {m[2], 0.5, t * 0.6}, {m[4], 0.35, t * 0.4}, {m[6], 0.25, t * 0.32}};
+        r.strike = 0.45; r.strike_t60 = 0.004; r.strike_lo = 1500; r.strike_hi = 7000;
+    } else if (n == "agogo_high" || n == "agogo_low") {
+        r.f0 = n == "agogo_high" ? 920 : 690; r.modes = {{1, 1, 0.6}, {2.32, 0.5, 0.45}, {4.25, 0.3, 0.3}, {6.63, 0.15, 0.2}};
+        r.strike = 0.25; r.strike_t60 = 0.0015; r.strike_lo = 3000; r.strike_hi = 12000;
+    } else if (n == "shakers") {
+        r.shake = 1.0; r.shake_t60 = 0.18; r.collisions = 3000; r.shell = {3600, 6400};
+    } else if (n == "claves") {
+        r.f0 = 2450; r.modes = {{BAR[0], 1, 0.16}, {BAR[1], 0.2, 0.07}, {BAR[2], 0.06, 0.04}};
+        r.strike = 0.15; r.strike_t60 = 0.001; r.strike_lo = 3000; r.strike_hi = 12000;
+    } else if (n == "gankogui_high" || n == "gankogui_low") {
+        r.f0 = n == "gankogui_high" ? 1150 : 820; r.modes = {{1, 1, 0.5}, {2.54, 0.4, 0.35}, {4.3, 0.25, 0.25}, {6.2, 0.12, 0.15}};
+        r.strike = 0.3; r.strike_t60 = 0.0015; r.strike_lo = 3000; r.strike_hi = 12000;
+    } else {
+        // Unknown entry: a plain drum tuned to its note
+        r.f0 = 440.0 * std::exp2((s.midi_note - 69) / 12.0);
+        r.modes = {{m[0], 1, 0.3}, {m[1], 0.4, 0.2}, {m[2], 0.2, 0.15}};
+        r.strike = 0.3;
+    }
+    return r;
+}
+
+// ============================================================
+//  Rendering
+// ============================================================
+
+namespace detail {
+
+// Per-sample gain for an exponential decay reaching -60 dB after t60 seconds
+inline float decay_step(double t60, int sample_rate) {
+    return (float)std::exp(std::log(0.001) / (std::max(t60, 1e-4) * sample_rate));
+}
+
+struct Filter {
+    dsp::BiquadCoeffs c;
+    float z1 = 0.0f, z2 = 0.0f;
+
+    float operator()(float x) {
+        float y = c.b0 * x + z1;
+        z1 = c.b1 * x - c.a1 * y + z2;
+        z2 = c.b2 * x - c.a2 * y;
+        return y;
+    }
+};
+
+// Noise band [lo, hi] into `out` under an envelope that jumps to `level`
+// at each of `bursts` onsets `gap` apart and decays with `t60`
+inline void add_noise(std::vector<float>& out, int sample_rate, std::mt19937& rng, double level,
+                      double t60, double lo, double hi, int bursts = 0, double gap = 0.0) {
+    if (level <= 0.0) return;
+    std::uniform_real_distribution<float> white(-1.0f, 1.0f);
+    Filter hp{dsp::biquad::highpass(sample_rate, lo, 0.707)}, lp{dsp::biquad::lowpass(sample_rate, hi, 0.707)};
+    const float step = decay_step(t60, sample_rate), burst_step = decay_step(0.02, sample_rate);
+    const int gap_frames = (int)(gap * sample_rate);
+    float env = 0.0f;
+    for (size_t i = 0; i < out.size(); ++i) {
+        const int b = gap_frames > 0 ? (int)i / gap_frames : bursts;
+        if (b < bursts) {
+            if ((int)i % gap_frames == 0) env = (float)level;
+            else env *= burst_step;
+        } else {
+            if (i == (size_t)bursts * gap_frames) env = (float)level;
+            else env *= step;
+        }
+        out[i] += lp(hp(white(rng))) * env;
+    }
+}
+
+} // namespace detail
+
+// Mono one-shot of `seconds` for a recipe, at velocity 0-1
+inline std::vector<float> render(const Recipe& r, double seconds, double velocity,
+                                 uint32_t seed, int sample_rate) {
+    const size_t n = (size_t)(seconds * sample_rate);
+    std::vector<float> out(n, 0.0f);
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> jitter(-1.0, 1.0);
+    const double detune = 1.0 + 0.012 * jitter(rng), stretch = 1.0 + 0.06 * jitter(rng);
+
+    // Body modes: phasors rotated per sample, the rotation updated every
+    // control block while the pitch glides. Harder hits excite upper modes
+    // more and bend the pitch further.
+    if (r.f0 > 0.0) {
+        const double glide = r.bend + (r.glide - r.bend) * (0.5 + 0.5 * velocity);
+        for (const Mode& mode : r.modes) {
+            const double level = mode.level * std::pow(velocity, 0.7 * (mode.ratio - 1.0)) *
+                                 (1.0 + 0.1 * jitter(rng));
+            float amp = (float)level;
+            const float step = detail::decay_step(mode.t60 * stretch, sample_rate);
+            float c = 1.0f, s = 0.0f;
+            for (size_t i0 = 0; i0 < n; i0 += dsp::CONTROL_FRAMES) {
+                const double t = (double)i0 / sample_rate;
+                const double hz = r.f0 * detune * mode.ratio * (r.bend + (glide - r.bend) * std::exp(-t / r.glide_time));
+                if (hz >= 0.45 * sample_rate) break;
+                const double w = 2.0 * dsp::PI * hz / sample_rate;
+                const float cr = (float)std::cos(w), sr = (float)std::sin(w);
+                const size_t i1 = std::min(n, i0 + dsp::CONTROL_FRAMES);
+                for (size_t i = i0; i < i1; ++i) {
+                    out[i] += amp * s;
+                    const float nc = c * cr - s * sr;
+                    s = s * cr + c * sr;
+                    c = nc;
+                    amp *= step;
+                }
+                const float mag = std::sqrt(c * c + s * s);
+                c /= mag;
+                s /= mag;
+            }
+        }
+    }
+
+    detail::add_noise(out, sample_rate, rng, r.strike * velocity, r.strike_t60, r.strike_lo, r.strike_hi);
+    detail::add_noise(out, sample_rate, rng, r.noise * (0.6 + 0.4 * velocity), r.noise_t60 * stretch,
+                      r.noise_lo, r.noise_hi, r.bursts, r.burst_gap);
+
+    // Cymbal metal: six square oscillators at the 808's ratios
+    if (r.metal > 0.0) {
+        static constexpr double RATIOS[] = {1.0, 1.4827, 1.8003, 2.5460, 2.6303, 3.8967};
+        double phase[6] = {};
+        for (double& p : phase) p = 0.5 + 0.5 * jitter(rng);
+        detail::Filter hp1{dsp::biquad::highpass(sample_rate, r.metal_hp, 0.707)}, hp2 = hp1;
+        const float step = detail::decay_step(r.metal_t60 * stretch, sample_rate);
+        float env = (float)(r.metal * (0.6 + 0.4 * velocity));
+        for (size_t i = 0; i < n; ++i) {
+            float sq = 0.0f;
+            for (int k = 0; k < 6; ++k) {
+                phase[k] += r.metal_base * detune * RATIOS[k] / sample_rate;
+                phase[k] -= std::floor(phase[k]);
+                sq += phase[k] < 0.5 ? 1.0f : -1.0f;
+            }
+            out[i] += hp2(hp1(sq / 6.0f)) * env;
+            env *= step;
+        }
+    }
+
+    // Shaker: collisions while the shake's energy lasts, each kicking the
+    // bead noise level, which rings the shell resonances
+    if (r.shake > 0.0) {
+        std::uniform_real_distribution<float> white(-1.0f, 1.0f), unit(0.0f, 1.0f);
+        std::vector<detail::Filter> shell;
+        for (double hz : r.shell) shell.push_back({dsp::biquad::bandpass(sample_rate, hz * detune, 4.0)});
+        const float energy_step = detail::decay_step(r.shake_t60 * stretch, sample_rate);
+        const float level_step = detail::decay_step(0.02, sample_rate);
+        const float chance = (float)(r.collisions / sample_rate);
+        float energy = (float)(r.shake * (0.5 + 0.5 * velocity)), level = 0.0f;
+        for (size_t i = 0; i < n; ++i) {
+            if (unit(rng) < chance * energy / r.shake) level += energy * unit(rng);
+            level *= level_step;
+            energy *= energy_step;
+            const float x = white(rng) * level;
+            float y = 0.0f;
+            for (auto& f : shell) y += f(x);
+            out[i] += y;
+        }
+    }
+
+    // Peak at -1 dBFS, with a short fade so the tail ends on silence
+    float peak = 0.0f;
+    for (float v : out) peak = std::max(peak, std::abs(v));
+    const float gain = peak > 0.0f ? 0.891f / peak : 0.0f;
+    const size_t fade = std::min(n, (size_t)(0.01 * sample_rate));
+    for (size_t i = 0; i < n; ++i) {
+        out[i] *= gain;
+        if (i >= n - fade) out[i] *= (float)(n - i) / fade;
+    }
+    return out;
+}
+
+// FNV-1a, so alternates are the same on every platform
+inline uint32_t seed_for(const std::string& name, int zone, int rr) {
+    uint32_t h = 2166136261u;
+    for (char ch : name + "/" + std::to_string(zone) + "/" + std::to_string(rr)) {
+        h ^= (uint8_t)ch;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Interleaved stereo one-shot for velocity zone `zone` of `zones` and
+// round-robin alternate `rr` of a library entry
+inline std::vector<float> synthesize(const samples::PercussionSample& s, int zone, int zones,
+                                     int rr, int sample_rate) {
+    const double velocity = zones == 1 ? 0.8 : 0.45 + 0.55 * zone / (zones - 1);
+    dsp::DenormalGuard denormal_guard;
+    auto mono = render(recipe_for(s), s.duration, velocity, seed_for(s.name, zone, rr), sample_rate);
+    std::vector<float> lr(mono.size() * 2);
+    for (size_t i = 0; i < mono.size(); ++i) lr[i * 2] = lr[i * 2 + 1] = mono[i];
+    return lr;
+}
+
+} // namespace percussion
@@ -0,0 +1,285 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "render_session.h"
+
+namespace fs = std::filesystem;
+
+// Progressive offline renders. The first PREVIEW_BARS bars are rendered
+// and written as the artifact straight away, so the response comes back
+// in about the same time whatever the duration. A background thread then
+// renders the full duration, carrying on from the preview's render
+// session, into a staging directory and renames it over the preview.
+// Those full renders run on a small fixed pool of worker threads.
+// Clients poll the job, or wait on it, for completion, and can cancel it.
+namespace renderer {
+
+constexpr int PREVIEW_BARS = 4;
+
+enum class JobState { PREVIEW, COMPLETE, FAILED, CANCELLED };
+
+inline std::string job_state_to_str(JobState s) {
+    switch (s) {
+        case JobState::PREVIEW:  return "preview";
+        case JobState::COMPLETE: return "complete";
+        case JobState::FAILED:   return "failed";
+        case JobState::CANCELLED: return "cancelled";
+    }
+    return "preview";
+}
+
+class RenderJob {
+public:
+    RenderJob(std::string id, double duration, double preview_seconds, double deadline_seconds = 0.0)
+        : id_(std::move(id)), duration_(duration), preview_seconds_(preview_seconds),
+          started_(std::chrono::steady_clock::now()), cancel_(std::make_shared<CancelToken>()) {
+        cancel_->set_timeout(deadline_seconds);
+    }
+
+    const std::string& id() const { return id_; }
+
+    // Checked by the full render; cancel() stops it at its next block
+    const std::shared_ptr<CancelToken>& token() const { return cancel_; }
+    void cancel() { cancel_->cancel(); }
+
+    void finish() { settle(JobState::COMPLETE, {}); }
+    void fail(std::string error) { settle(JobState::FAILED, std::move(error)); }
+    void stopped(std::string reason) { settle(JobState::CANCELLED, std::move(reason)); }
+
+    bool settled() const {
+        std::lock_guard lock(mutex_);
+        return state_ != JobState::PREVIEW;
+    }
+
+    // Waits up to `timeout` for the full render to settle; returns the state
+    JobState wait(std::chrono::milliseconds timeout) {
+        std::unique_lock lock(mutex_);
+        settled_.wait_for(lock, timeout, [&] { return state_ != JobState::PREVIEW; });
+        return state_;
+    }
+
+    json to_json() const {
+        std::lock_guard lock(mutex_);
+        json j = {
+            {"id", id_},
+            {"state", job_state_to_str(state_)},
+            {"duration", duration_},
+            {"ready_seconds", state_ == JobState::COMPLETE ? duration_ : preview_seconds_},
+        };
+        if (state_ != JobState::PREVIEW) j["render_seconds"] = render_seconds_;
+        if (state_ == JobState::FAILED || state_ == JobState::CANCELLED) j["error"] = error_;
+        return j;
+    }
+
+private:
+    void settle(JobState state, std::string error) {
+        {
+            std::lock_guard lock(mutex_);
+            state_ = state;
+            error_ = std::move(error);
+            render_seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+        }
+        settled_.notify_all();
+    }
+
+    const std::string                     id_;
+    const double                          duration_;
+    const double                          preview_seconds_;
+    const std::chrono::steady_clock::time_point started_;
+    const std::shared_ptr<CancelToken>    cancel_;
+    mutable std::mutex                    mutex_;
+    std::condition_variable               settled_;
+    JobState                              state_ = JobState::PREVIEW;
+    std::string                           error_;
+    double                                render_seconds_ = 0.0;   // until settled
+};
+
+// Recent jobs by id, for status queries. Jobs still rendering stay until
+// they settle; the oldest settled ones go past CAPACITY.
+class RenderJobs {
+public:
+    static constexpr size_t CAPACITY = 64;
+
+    void put(std::shared_ptr<RenderJob> job) {
+        std::lock_guard lock(mutex_);
+        jobs_.push_front(std::move(job));
+        for (auto it = jobs_.end(); jobs_.size() > CAPACITY && it != jobs_.begin();) {
+            --it;
+            if ((*it)->settled()) it = jobs_.erase(it);
+        }
+    }
+
+    std::shared_ptr<RenderJob> find(const std::string& id) {
+        std::lock_guard lock(mutex_);
+        for (auto& job : jobs_)
+            if (job->id() == id) return job;
+        return nullptr;
+    }
+
+private:
+    std::mutex                            mutex_;
+    std::list<std::shared_ptr<RenderJob>> jobs_;   // most recent first
+};
+
+inline RenderJobs& render_jobs() {
+    static RenderJobs jobs;
+    return jobs;
+}
+
+// Threads running the full passes of progressive renders. Jobs wait in a
+// bounded queue and run in order, so a burst of requests can't start a
+// thread each. shutdown() cancels running and queued jobs and joins the
+// threads; the server calls it before exiting.
+class RenderWorker {
+public:
+    static constexpr int    THREADS = 2;
+    static constexpr size_t MAX_QUEUED = 16;
+
+    RenderWorker() {
+        // Caches the jobs use are built first, so they're destroyed after
+        // this worker has joined its threads
+        render_jobs();
+        render_sessions();
+        render_metrics();
+        render_buffer_pool();
+        for (int i = 0; i < THREADS; ++i) threads_.emplace_back([this] { run(); });
+    }
+
+    ~RenderWorker() { shutdown(); }
+
+    RenderWorker(const RenderWorker&) = delete;
+    RenderWorker& operator=(const RenderWorker&) = delete;
+
+    bool full() const {
+        std::lock_guard lock(mutex_);
+        return stopping_ || queue_.size() >= MAX_QUEUED;
+    }
+
+    // Queues `pass` for `job`; false (nothing queued) when full or shut down
+    bool submit(std::shared_ptr<RenderJob> job, std::function<void()> pass) {
+        {
+            std::lock_guard lock(mutex_);
+            if (stopping_ || queue_.size() >= MAX_QUEUED) return false;
+            queue_.push_back({std::move(job), std::move(pass)});
+        }
+        wake_.notify_one();
+        return true;
+    }
+
+    void shutdown() {
+        std::deque<Task> dropped;
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+            for (auto& job : running_) job->cancel();
+            dropped.swap(queue_);
+        }
+        wake_.notify_all();
+        for (auto& t : threads_)
+            if (t.joinable()) t.join();
+        for (auto& task : dropped) task.job->stopped("Server shutting down");
+    }
+
+private:
+    struct Task {
+        std::shared_ptr<RenderJob> job;
+        std::function<void()>      pass;
+    };
+
+    void run() {
+        for (;;) {
+            Task task;
+            {
+                std::unique_lock lock(mutex_);
+                wake_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+                if (stopping_) return;
+                task = std::move(queue_.front());
+                queue_.pop_front();
+                running_.push_back(task.job);
+            }
+            task.pass();
+            std::lock_guard lock(mutex_);
+            std::erase(running_, task.job);
+        }
+    }
+
+    mutable std::mutex                      mutex_;
+    std::condition_variable                 wake_;
+    std::deque<Task>                        queue_;
+    std::vector<std::shared_ptr<RenderJob>> running_;
+    bool                                    stopping_ = false;
+    std::vector<std::thread>                threads_;
+};
+
+inline RenderWorker& render_worker() {
+    static RenderWorker worker;
+    return worker;
+}
+
+// Preview length: the first PREVIEW_BARS bars, or the whole render if shorter
+inline double preview_seconds(const RenderRequest& req) {
+    return std::min(req.duration, PREVIEW_BARS * 4 * 60.0 / req.bpm);
+}
+
+// Renders the preview and returns its job; the full render goes on in the
+// background, under the job's own token (the request's client is gone by
+// then) with `deadline_seconds` to finish. A render no longer than its
+// preview settles immediately.
+inline std::shared_ptr<RenderJob> render_beat_progressive(std::shared_ptr<const SampleBank> bank,
+                                                          const fs::path& output_dir,
+                                                          const RenderRequest& req,
+                                                          double deadline_seconds = 0.0) {
+    if (!(req.duration > 0.0) || req.duration > MAX_RENDER_SECONDS)
+        throw std::invalid_argument("Duration must be between 0 and 12 hours");
+    if (render_worker().full())
+        throw std::runtime_error("Too many progressive renders in progress; try again shortly");
+
+    RenderRequest preview = req;
+    preview.duration = preview_seconds(req);
+    std::string beat_id = render_beat_resumable(bank, output_dir, preview);
+
+    auto job = std::make_shared<RenderJob>(beat_id, req.duration, preview.duration, deadline_seconds);
+    render_jobs().put(job);
+    if (preview.duration >= req.duration) {
+        job->finish();
+        return job;
+    }
+
+    // Staged next to the session scratch files (same filesystem, cleared
+    // at startup) so the rename over the preview is atomic
+    RenderRequest full = req;
+    full.cancel = job->token();
+    const bool queued = render_worker().submit(job, [bank = std::move(bank), output_dir, full, job] {
+        const fs::path staging = render_cache_dir(output_dir) / "staging";
+        const std::string file = job->id() + ".wav";
+        try {
+            fs::create_directories(staging);
+            render_beat_resumable(bank, staging, full, job->id());
+            fs::rename(staging / file, output_dir / file);
+            job->finish();
+        } catch (const Cancelled& e) {
+            job->stopped(e.what());   // the preview stays the artifact
+        } catch (const std::exception& e) {
+            std::error_code ec;
+            fs::remove(staging / file, ec);
+            job->fail(e.what());
+        }
+    });
+    if (!queued) job->fail("Too many progressive renders in progress");
+    return job;
+}
+
+} // namespace renderer
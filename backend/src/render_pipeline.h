@@ -0,0 +1,165 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../deps/json.hpp"
+
+using json = nlohmann::json;
+
+// Plumbing for running the stages of a render (event compile -> mix ->
+// peak scan -> encode -> write) on threads of their own: a bounded
+// lock-free queue between neighbouring stages, a worker thread that hands
+// its exception back on join, and per-stage counters showing which stage
+// the others wait on.
+namespace renderer {
+
+// Bounded queue between exactly one producer and one consumer thread. Both
+// ends are lock-free; a producer facing a full queue or a consumer facing
+// an empty one sleeps in std::atomic::wait until the other end moves.
+// The producer close()s the queue after its last item; a consumer that
+// gives up stop()s it, and pushes fail from then on.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity)
+        : slots_(std::bit_ceil(std::clamp<size_t>(capacity, 2, size_t(1) << 30))) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer: blocks while full; false (item dropped) once stopped
+    bool push(T item) {
+        const uint32_t tail = tail_.load(std::memory_order_relaxed) & COUNT;
+        for (;;) {
+            const uint32_t head = head_.load(std::memory_order_acquire);
+            if (head & ENDED) return false;
+            if (((tail - head) & COUNT) < slots_.size()) break;
+            head_.wait(head, std::memory_order_acquire);
+        }
+        slots_[tail & (slots_.size() - 1)] = std::move(item);
+        tail_.store((tail + 1) & COUNT, std::memory_order_release);
+        tail_.notify_one();
+        return true;
+    }
+
+    // Producer: no more items
+    void close() {
+        tail_.fetch_or(ENDED, std::memory_order_release);
+        tail_.notify_one();
+    }
+
+    // Consumer: blocks while empty; false once closed and drained
+    bool pop(T& item) {
+        for (;;) {
+            if (try_pop(item)) return true;
+            const uint32_t tail = tail_.load(std::memory_order_acquire);
+            if ((tail & COUNT) != head_.load(std::memory_order_relaxed)) continue;
+            if (tail & ENDED) return false;
+            tail_.wait(tail, std::memory_order_acquire);
+        }
+    }
+
+    // Consumer: false when nothing is queued right now
+    bool try_pop(T& item) {
+        const uint32_t head = head_.load(std::memory_order_relaxed);
+        if ((tail_.load(std::memory_order_acquire) & COUNT) == head) return false;
+        item = std::move(slots_[head & (slots_.size() - 1)]);
+        head_.store((head + 1) & COUNT, std::memory_order_release);
+        head_.notify_one();
+        return true;
+    }
+
+    // Consumer: take nothing more
+    void stop() {
+        head_.fetch_or(ENDED, std::memory_order_release);
+        head_.notify_one();
+    }
+
+private:
+    // Positions count modulo 2^31 (32-bit so waits are plain futex waits);
+    // the top bit marks the end that closed or stopped
+    static constexpr uint32_t ENDED = 1u << 31;
+    static constexpr uint32_t COUNT = ENDED - 1;
+
+    std::vector<T> slots_;   // power-of-two count
+    alignas(64) std::atomic<uint32_t> head_{0};   // consumer's
+    alignas(64) std::atomic<uint32_t> tail_{0};   // producer's
+};
+
+// Thread running one stage. An exception escaping it is rethrown by
+// join(); a stage left unjoined (its caller unwinding) is joined quietly.
+class StageThread {
+public:
+    template <typename F>
+    explicit StageThread(F&& body)
+        : thread_([this, body = std::forward<F>(body)]() mutable {
+              try {
+                  body();
+              } catch (...) {
+                  error_ = std::current_exception();
+              }
+          }) {}
+
+    ~StageThread() {
+        if (thread_.joinable()) thread_.join();
+    }
+
+    StageThread(const StageThread&) = delete;
+    StageThread& operator=(const StageThread&) = delete;
+
+    void join() {
+        thread_.join();
+        if (error_) std::rethrow_exception(error_);
+    }
+
+private:
+    std::exception_ptr error_;
+    std::thread        thread_;   // last: starts once error_ exists
+};
+
+// What one stage did over a render; written only by the thread running it
+struct StageCounters {
+    const char* name;
+    uint64_t items = 0;            // blocks, windows or chunks handled
+    double   busy_seconds = 0.0;   // doing its own work
+    double   stall_seconds = 0.0;  // waiting on a neighbour's queue
+};
+
+// Adds the time from construction to destruction to `seconds`
+class StageTimer {
+public:
+    explicit StageTimer(double& seconds) : seconds_(seconds), started_(std::chrono::steady_clock::now()) {}
+    ~StageTimer() {
+        seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    double&                               seconds_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+// Stages in pipeline order with their throughput (`audio_seconds` handled
+// per busy second) and the bottleneck: the busiest stage, which sets the
+// pace of a pipeline whatever the others do
+inline json stages_to_json(const std::vector<StageCounters>& stages, double audio_seconds) {
+    json list = json::array();
+    const StageCounters* bottleneck = nullptr;
+    for (auto& s : stages) {
+        list.push_back({{"stage", s.name}, {"items", s.items},
+                        {"busy_seconds", s.busy_seconds}, {"stall_seconds", s.stall_seconds},
+                        {"realtime", s.busy_seconds > 0.0 ? audio_seconds / s.busy_seconds : 0.0}});
+        if (!bottleneck || s.busy_seconds > bottleneck->busy_seconds) bottleneck = &s;
+    }
+    return {{"stages", list}, {"bottleneck", bottleneck ? json(bottleneck->name) : json()}};
+}
+
+} // namespace renderer
@@ -0,0 +1,621 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "beat_renderer.h"
+
+namespace fs = std::filesystem;
+
+// Resumable offline renders. A session belongs to one composition (genre,
+// mood, key, tempo, groove, quality) and keeps two layers in scratch files
+// next to the renders:
+//  - stems: each instrument group's bus after its inserts, before ducking
+//    and gain/pan, mixed by engines that stay live between renders;
+//  - the master, summed from the stems with the last request's levels,
+//    sidechains and master chain.
+// A longer render mixes only the new frames of each layer, so a 120 s ->
+// 180 s extension costs 60 s of mixing. A mixer-only change re-sums the
+// stems; only a group whose inserts changed, or that just became audible,
+// is mixed again from its voices. The WAV is normalized and quantized from
+// the master store, byte-identical to a fresh render_beat.
+namespace renderer {
+
+inline fs::path render_cache_dir(const fs::path& output_dir) { return output_dir / "render_cache"; }
+
+namespace detail {
+
+// Interleaved stereo float frames in a scratch file, removed with the store
+class FrameStore {
+public:
+    explicit FrameStore(fs::path path) : path_(std::move(path)) {
+        file_.open(path_, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+        if (!file_) throw std::runtime_error("Cannot create render cache file");
+    }
+
+    ~FrameStore() {
+        file_.close();
+        std::error_code ec;
+        fs::remove(path_, ec);
+    }
+
+    FrameStore(const FrameStore&) = delete;
+    FrameStore& operator=(const FrameStore&) = delete;
+
+    void write(int64_t first, const float* src, int64_t count) {
+        file_.seekp(first * (int64_t)sizeof(float) * 2);
+        file_.write(reinterpret_cast<const char*>(src), (std::streamsize)(count * 2 * sizeof(float)));
+        if (!file_) throw std::runtime_error("Cannot write render cache file");
+    }
+
+    void read(int64_t first, float* dst, int64_t count) {
+        file_.seekg(first * (int64_t)sizeof(float) * 2);
+        file_.read(reinterpret_cast<char*>(dst), (std::streamsize)(count * 2 * sizeof(float)));
+        if (!file_) throw std::runtime_error("Cannot read render cache file");
+    }
+
+private:
+    fs::path     path_;
+    std::fstream file_;
+};
+
+// One group's bus through the session so far
+struct Stem {
+    std::string          inserts;   // normalized insert chain it was mixed with
+    FrameStore           frames;
+    std::vector<uint8_t> used;      // per block: the bus carried signal
+};
+
+// Engine mixing the voices of some groups into their stems. Groups turn up
+// one request at a time (unmuted, inserts changed), so a session may run
+// several.
+struct StemPass {
+    mixer::MixerSettings       mix;       // only its groups audible
+    std::vector<Voice>         voices;    // the engine reads these in place
+    std::unique_ptr<MixEngine> engine;
+    std::vector<Stem*>         outputs;   // by group; null once the stem is replaced
+};
+
+inline std::string inserts_signature(const RenderRequest& req, const QualityProfile& quality, int group) {
+    if (!quality.effects) return "[]";
+    return dsp::effect_chain_to_json(req.mixer.buses[group].effects).dump();
+}
+
+// What a master re-sum depends on: levels, sidechains, master chain
+inline std::string mix_signature(const RenderRequest& req, const QualityProfile& quality) {
+    json buses = json::array();
+    for (int g = 0; g < mixer::group_count(); ++g)
+        buses.push_back({req.mixer.audible(g), req.mixer.buses[g].gain, req.mixer.buses[g].pan});
+    json sidechains = json::array();
+    for (auto& sc : req.mixer.sidechains)
+        sidechains.push_back({sc.triggers, sc.targets, sc.depth, sc.attack, sc.release});
+    json master = quality.effects ? dsp::effect_chain_to_json(req.effects) : json::array();
+    return json::array({buses, sidechains, master}).dump();
+}
+
+} // namespace detail
+
+class RenderSession {
+public:
+    RenderSession(std::shared_ptr<const SampleBank> bank, const fs::path& cache_dir,
+                  const RenderRequest& req)
+        : bank_(std::move(bank)), req_(req), quality_(quality_profile(req.quality)),
+          sample_rate_(quality_.sample_rate), cache_dir_(cache_dir),
+          name_("session_" + random_hex_id(12)), stems_(mixer::group_count()) {
+        fs::create_directories(cache_dir_);
+        master_ = std::make_unique<detail::FrameStore>(cache_dir_ / (name_ + ".f32"));
+    }
+
+    RenderSession(const RenderSession&) = delete;
+    RenderSession& operator=(const RenderSession&) = delete;
+
+    std::mutex& mutex() { return mutex_; }
+
+    // Whether a render of `duration` seconds can carry on from this one.
+    // Compositions of different lengths agree up to the first bar one has
+    // and the other doesn't; the stem frames reused, and those mixed so far
+    // if mixing has to continue, must lie before it.
+    bool can_render(const SampleBank& bank, double duration) const {
+        if (&bank != bank_.get() || interrupted_) return false;
+        if (stem_frames_ == 0) return true;
+        const Plan p = plan(duration);
+        if (p.end <= stem_frames_) return agrees(bars_, p.bars, p.frames);
+        return agrees(bars_, p.mix_bars, stem_frames_);
+    }
+
+    // Seconds of already mixed stems a render of `duration` will reuse
+    double reusable_seconds(double duration) const {
+        return std::min(stem_frames_, plan(duration).frames) / (double)sample_rate_;
+    }
+
+    // Scratch file bytes held
+    size_t store_bytes() const { return store_bytes_.load(std::memory_order_relaxed); }
+
+    // Mix what `req` needs that isn't mixed yet and write its duration as a
+    // WAV; the caller holds mutex() and has checked can_render(). A render
+    // that throws (or is cancelled) leaves the session unusable. Voices are
+    // compiled as stems need them, so `stages` counts that under mix.
+    // Returns the bytes of pool buffers the render worked in.
+    size_t render(const fs::path& wav_path, const RenderRequest& req, RenderStages& stages) {
+        const Plan p = plan(req.duration);
+        CancelToken* cancel = req.cancel.get();
+        interrupted_ = true;   // until this render completes
+        buffer_bytes_ = 0;
+        dsp::DenormalGuard denormal_guard;
+        {
+            StageTimer busy(stages.mix.busy_seconds);
+            const bool stems_changed = update_stems(req, p);
+            update_master(req, p, stems_changed, stages.peak);
+        }
+
+        // The settled peak was scanned behind the master mix; only the tail
+        // is scanned per write
+        float peak;
+        if (p.frames >= peak_through_) {
+            peak = std::max(peak_, scan_peak(peak_through_, p.frames, p.frames, stages.peak, cancel));
+        } else {
+            peak = scan_peak(0, p.frames, p.frames, stages.peak, cancel);
+        }
+        const float gain = normalize_gain(peak, quality_);
+        if (req.output == OutputMode::MAPPED && MappedFile::supported())
+            write_wav_mapped(wav_path, p.frames, gain, stages, cancel);
+        else
+            write_wav(wav_path, p.frames, gain, stages, cancel);
+
+        size_t stems = std::count_if(stems_.begin(), stems_.end(), [](const auto& s) { return s != nullptr; });
+        store_bytes_.store((size_t)(stems * stem_frames_ + mixdown_->position()) * 2 * sizeof(float),
+                           std::memory_order_relaxed);
+        interrupted_ = false;
+        return buffer_bytes_;
+    }
+
+private:
+    // A stereo window fills the pool's smallest size class; multiple of BLOCK_FRAMES
+    static constexpr int64_t WINDOW_FRAMES = (int64_t)BufferPool::MIN_CLASS_FLOATS / 2;
+
+    struct Plan {
+        int64_t frames;     // written to the WAV
+        int64_t end;        // mixed through, in whole blocks like a fresh render
+        int     bars;       // composition of a fresh render
+        int     mix_bars;   // composition to mix new frames with
+    };
+
+    Plan plan(double duration) const {
+        Plan p;
+        p.frames = (int64_t)(sample_rate_ * duration);
+        p.end = (p.frames + BLOCK_FRAMES - 1) / BLOCK_FRAMES * BLOCK_FRAMES;
+        p.bars = midi::bar_count(req_.bpm, duration);
+        // A render ending on a bar line has no later bar starting inside it,
+        // so mix with every bar that starts before `end`: a longer render
+        // then finds those frames already right
+        p.mix_bars = p.bars;
+        if (bar_frame(p.bars) >= p.frames)
+            while (bar_frame(p.mix_bars) < p.end) ++p.mix_bars;
+        return p;
+    }
+
+    // Start frame of bar `bar`, by the tick -> frame conversion compile_voices uses
+    int64_t bar_frame(int bar) const {
+        return (int64_t)((double)bar * midi::WHOLE * 60.0 / (req_.bpm * midi::TPQ) * sample_rate_);
+    }
+
+    bool agrees(int bars_a, int bars_b, int64_t through) const {
+        return bars_a == bars_b || bar_frame(std::min(bars_a, bars_b)) >= through;
+    }
+
+    std::vector<std::vector<SidechainTrigger>> sidechain_triggers(const mixer::MixerSettings& mix) const {
+        std::vector<std::vector<SidechainTrigger>> triggers;
+        for (auto& sc : mix.sidechains)
+            triggers.push_back(compile_sidechain(notes_, sc, req_.bpm, sample_rate_));
+        return triggers;
+    }
+
+    // Give every group `req` hears a stem mixed with its current inserts,
+    // then mix all stems through `p.end`. Returns whether any stem was
+    // (re)started.
+    bool update_stems(const RenderRequest& req, const Plan& p) {
+        const bool extend = p.end > stem_frames_;
+        const auto notes = extend ? melody::compose_bars(req_.genre, req_.mood, req_.key, p.mix_bars, req_.feel)
+                                 : notes_;
+
+        std::vector<bool> has_notes(mixer::group_count(), false);
+        for (auto& n : notes) has_notes[mixer::group_for(n)] = true;
+        std::vector<int> fresh;
+        for (int g = 0; g < mixer::group_count(); ++g) {
+            if (!req.mixer.audible(g)) continue;
+            std::string inserts = detail::inserts_signature(req, quality_, g);
+            if (!has_notes[g] && inserts == "[]") continue;   // bus never carries anything
+            if (stems_[g] && stems_[g]->inserts == inserts) continue;
+            for (auto& pass : passes_) pass->outputs[g] = nullptr;
+            stems_[g].reset(new detail::Stem{
+                inserts, detail::FrameStore(cache_dir_ / (name_ + "_" + std::to_string(g) + ".f32")), {}});
+            fresh.push_back(g);
+        }
+        std::erase_if(passes_, [](const auto& pass) {
+            return std::all_of(pass->outputs.begin(), pass->outputs.end(), [](auto* s) { return !s; });
+        });
+
+        // New stems catch up with the others on the current composition
+        if (!fresh.empty()) {
+            auto pass = std::make_unique<detail::StemPass>();
+            pass->mix = req.mixer;
+            pass->mix.sidechains.clear();
+            pass->outputs.assign(mixer::group_count(), nullptr);
+            for (int g = 0; g < mixer::group_count(); ++g) {
+                auto& bus = pass->mix.buses[g];
+                bus.solo = false;
+                bus.mute = std::find(fresh.begin(), fresh.end(), g) == fresh.end();
+                if (bus.mute || !quality_.effects) bus.effects.clear();
+                if (!bus.mute) pass->outputs[g] = stems_[g].get();
+            }
+            pass->voices = compile_voices(notes_, *bank_, pass->mix, req_.bpm, sample_rate_, horizon_);
+            pass->engine = std::make_unique<MixEngine>(*bank_, pass->voices, pass->mix, no_effects_,
+                                                       sample_rate_, std::vector<std::vector<SidechainTrigger>>{},
+                                                       quality_.hermite);
+            run_pass(*pass, stem_frames_, req.cancel.get());
+            passes_.push_back(std::move(pass));
+        }
+
+        // Longer composition: every voice already started keeps its index,
+        // so the engines carry on. Voices are cut at frames + 1 s like a
+        // fresh render.
+        if (extend) {
+            notes_ = std::move(notes);
+            bars_ = p.mix_bars;
+            horizon_ = p.frames + sample_rate_;
+            for (auto& pass : passes_) {
+                pass->voices = compile_voices(notes_, *bank_, pass->mix, req_.bpm, sample_rate_, horizon_);
+                pass->engine->extend({});
+                run_pass(*pass, p.end, req.cancel.get());
+            }
+            stem_frames_ = p.end;
+        }
+        return !fresh.empty();
+    }
+
+    // Scratch buffer from the render pool, counted in this render's buffer bytes
+    BufferPool::Lease lease(size_t floats) {
+        auto buffer = render_buffer_pool().acquire(floats);
+        buffer_bytes_ += buffer.capacity() * sizeof(float);
+        return buffer;
+    }
+
+    void run_pass(detail::StemPass& pass, int64_t end, CancelToken* cancel) {
+        const int groups = mixer::group_count();
+        std::vector<BufferPool::Lease> windows(groups);
+        for (int g = 0; g < groups; ++g)
+            if (pass.outputs[g]) windows[g] = lease((size_t)WINDOW_FRAMES * 2);
+        std::vector<float*> dst(groups, nullptr);
+        std::vector<uint8_t> used(groups);
+
+        while (pass.engine->position() < end) {
+            const int64_t first = pass.engine->position();
+            const int64_t n = std::min(WINDOW_FRAMES, end - first);
+            for (int64_t f = 0; f < n; f += BLOCK_FRAMES) {
+                checkpoint(cancel);
+                for (int g = 0; g < groups; ++g)
+                    dst[g] = pass.outputs[g] ? windows[g].data() + f * 2 : nullptr;
+                pass.engine->render_stems_block(dst.data(), used.data(), (int)std::min<int64_t>(BLOCK_FRAMES, n - f));
+                for (int g = 0; g < groups; ++g)
+                    if (pass.outputs[g]) pass.outputs[g]->used.push_back(used[g]);
+            }
+            for (int g = 0; g < groups; ++g)
+                if (pass.outputs[g]) pass.outputs[g]->frames.write(first, windows[g].data(), n);
+        }
+    }
+
+    // Sum the stems into the master store through `p.end`, starting over
+    // when the mix settings or the stems changed. Peaks of frames at least a
+    // true-peak radius before the end are final for this and any longer
+    // render of the same mix; a PeakStage scans the new ones into peak_
+    // while the mix runs, so the frames mixed now go through one buffer.
+    void update_master(const RenderRequest& req, const Plan& p, bool stems_changed,
+                       StageCounters& peak_counters) {
+        const std::string signature = detail::mix_signature(req, quality_);
+        if (!mixdown_ || stems_changed || signature != mix_signature_) {
+            mixdown_.reset();
+            mix_signature_ = signature;
+            master_mix_ = req.mixer;
+            for (auto& bus : master_mix_.buses) bus.effects.clear();   // in the stems already
+            master_effects_ = quality_.effects ? req.effects : std::vector<dsp::EffectSpec>{};
+            mixdown_ = std::make_unique<MixEngine>(*bank_, no_voices_, master_mix_, master_effects_,
+                                                   sample_rate_, sidechain_triggers(master_mix_),
+                                                   quality_.hermite);
+            mixdown_bars_ = bars_;
+            peak_ = 0.0f;
+            peak_through_ = 0;
+        } else if (mixdown_bars_ != bars_) {
+            mixdown_->extend(sidechain_triggers(master_mix_));
+            mixdown_bars_ = bars_;
+        }
+
+        const int64_t mixed = mixdown_->position();
+        const int64_t settled = p.frames - TRUE_PEAK_RADIUS;
+        const bool scan = p.frames >= peak_through_ && settled > peak_through_;
+        if (mixed >= p.end && !scan) return;
+
+        // Buffer frame 0 is master frame `lo`. The scan's left neighbours
+        // (and, with nothing left to mix, the whole scan) come from the
+        // store, the rest from this mix.
+        const int64_t lo = scan ? std::min(mixed, std::max<int64_t>(0, peak_through_ - TRUE_PEAK_RADIUS)) : mixed;
+        const int64_t stored = std::min(mixed, p.end);
+        auto buffer = lease((size_t)(p.end - lo) * 2);
+        if (stored > lo) master_->read(lo, buffer.data(), stored - lo);
+        std::optional<PeakStage> peaks;
+        if (scan) {
+            peaks.emplace(buffer.data(), p.frames - lo, peak_through_ - lo, settled - lo,
+                          quality_.true_peak, peak_counters);
+            peaks->mixed(stored - lo);
+        }
+
+        const int groups = mixer::group_count();
+        std::vector<detail::Stem*> sources(groups, nullptr);
+        std::vector<BufferPool::Lease> windows(groups);
+        for (int g = 0; g < groups && mixed < p.end; ++g) {
+            if (!master_mix_.audible(g) || !stems_[g]) continue;
+            sources[g] = stems_[g].get();
+            windows[g] = lease((size_t)WINDOW_FRAMES * 2);
+        }
+        std::vector<const float*> src(groups, nullptr);
+        std::vector<uint8_t> used(groups);
+
+        while (mixdown_->position() < p.end) {
+            const int64_t first = mixdown_->position();
+            const int64_t n = std::min(WINDOW_FRAMES, p.end - first);
+            float* out = buffer.data() + (first - lo) * 2;
+            for (int g = 0; g < groups; ++g)
+                if (sources[g]) sources[g]->frames.read(first, windows[g].data(), n);
+            for (int64_t f = 0; f < n; f += BLOCK_FRAMES) {
+                checkpoint(req.cancel.get());
+                const size_t block = (size_t)((first + f) / BLOCK_FRAMES);
+                for (int g = 0; g < groups; ++g) {
+                    src[g] = sources[g] ? windows[g].data() + f * 2 : nullptr;
+                    used[g] = sources[g] ? sources[g]->used[block] : 0;
+                }
+                mixdown_->mix_stems_block(src.data(), used.data(), out + f * 2,
+                                          (int)std::min<int64_t>(BLOCK_FRAMES, n - f));
+            }
+            master_->write(first, out, n);
+            if (peaks) peaks->mixed(first + n - lo);
+        }
+        if (peaks) {
+            peak_ = std::max(peak_, peaks->finish());
+            peak_through_ = settled;
+        }
+    }
+
+    // Peak of master frames [begin, end) of a signal `frames` long, by
+    // window with true-peak neighbours loaded either side
+    float scan_peak(int64_t begin, int64_t end, int64_t frames, StageCounters& counters,
+                    CancelToken* cancel) {
+        float peak = 0.0f;
+        auto window = lease((size_t)(WINDOW_FRAMES + 2 * TRUE_PEAK_RADIUS) * 2);
+        for (int64_t w = begin; w < end; w += WINDOW_FRAMES) {
+            checkpoint(cancel);
+            StageTimer busy(counters.busy_seconds);
+            counters.items++;
+            const int64_t w_end = std::min(end, w + WINDOW_FRAMES);
+            const int64_t lo = std::max<int64_t>(0, w - TRUE_PEAK_RADIUS);
+            const int64_t hi = std::min(frames, w_end + TRUE_PEAK_RADIUS);
+            master_->read(lo, window.data(), hi - lo);
+            if (quality_.true_peak) {
+                peak = std::max(peak, true_peak(window.data(), hi - lo, w - lo, w_end - lo));
+            } else {
+                for (size_t i = (size_t)(w - lo) * 2; i < (size_t)(w_end - lo) * 2; ++i)
+                    peak = std::max(peak, std::abs(window.data()[i]));
+            }
+        }
+        return peak;
+    }
+
+    // Gain and quantize the first `frames` master frames into a 16-bit WAV,
+    // with the dither sequence a one-shot write_wav16 would use
+    void write_wav(const fs::path& wav_path, int64_t frames, float gain, RenderStages& stages,
+                   CancelToken* cancel) {
+        Wav16Writer out(wav_path, frames, sample_rate_, quality_.dither, &stages.encode, &stages.write);
+        auto window = lease((size_t)WINDOW_FRAMES * 2);
+        for (int64_t w = 0; w < frames; w += WINDOW_FRAMES) {
+            checkpoint(cancel);
+            const int64_t n = std::min(WINDOW_FRAMES, frames - w);
+            {
+                StageTimer busy(stages.encode.busy_seconds);
+                master_->read(w, window.data(), n);
+            }
+            out.append(window.data(), n, gain);
+        }
+        out.finish();
+    }
+
+    // write_wav quantizing straight into the mapped output file, as
+    // render_mapped does; the bytes come out the same
+    void write_wav_mapped(const fs::path& wav_path, int64_t frames, float gain, RenderStages& stages,
+                          CancelToken* cancel) {
+        const size_t header_bytes = wav16_header_bytes(frames);
+        const size_t frame_bytes = 2 * sizeof(int16_t);
+        MappedFile file(wav_path, header_bytes + (size_t)frames * frame_bytes);
+        detail::Pcm16Quantizer quantize{quality_.dither};
+        auto window = lease((size_t)WINDOW_FRAMES * 2);
+        for (int64_t w = 0; w < frames; w += WINDOW_FRAMES) {
+            checkpoint(cancel);
+            StageTimer busy(stages.encode.busy_seconds);
+            const int64_t n = std::min(WINDOW_FRAMES, frames - w);
+            master_->read(w, window.data(), n);
+            uint8_t* out = file.data() + header_bytes + (size_t)w * frame_bytes;
+            for (size_t i = 0; i < (size_t)n * 2; ++i) {
+                float x = window.data()[i];
+                if (gain != 1.0f) x *= gain;
+                detail::store_le16(out + i * 2, (uint16_t)quantize(x));
+            }
+            file.release(header_bytes + (size_t)w * frame_bytes, (size_t)n * frame_bytes);
+            stages.encode.items++;
+        }
+        StageTimer busy(stages.write.busy_seconds);
+        detail::wav16_header(file.data(), frames, sample_rate_);
+        file.finish(header_bytes + (size_t)frames * frame_bytes);
+        stages.write.items++;
+    }
+
+    std::shared_ptr<const SampleBank> bank_;
+    RenderRequest                     req_;          // composition; mix settings come per render
+    const QualityProfile&             quality_;
+    int                               sample_rate_;
+    fs::path                          cache_dir_;
+    std::string                       name_;         // scratch file prefix
+
+    // Stem layer: composition of `bars_` bars mixed through stem_frames_
+    int                                            bars_ = 0;
+    std::vector<midi::Note>                        notes_;
+    int64_t                                        horizon_ = 0;   // voices cut here
+    int64_t                                        stem_frames_ = 0;
+    std::vector<std::unique_ptr<detail::Stem>>     stems_;         // by group
+    std::vector<std::unique_ptr<detail::StemPass>> passes_;
+
+    // Master layer: stems summed with mix_signature_'s settings
+    std::string                          mix_signature_;
+    mixer::MixerSettings                 master_mix_;
+    std::vector<dsp::EffectSpec>         master_effects_;
+    const std::vector<Voice>             no_voices_;
+    const std::vector<dsp::EffectSpec>   no_effects_;
+    std::unique_ptr<MixEngine>           mixdown_;
+    int                                  mixdown_bars_ = 0;
+    std::unique_ptr<detail::FrameStore>  master_;
+    float                                peak_ = 0.0f;   // of master frames [0, peak_through_)
+    int64_t                              peak_through_ = 0;
+
+    std::atomic<size_t> store_bytes_{0};
+    size_t              buffer_bytes_ = 0;   // leased by the current render
+    bool                interrupted_ = false;   // a render threw partway; under mutex_
+    std::mutex          mutex_;
+};
+
+// Most recently used sessions by composition. Each keeps mix engines and
+// scratch files, so only a few are kept, within a disk budget.
+class RenderSessionCache {
+public:
+    static constexpr size_t CAPACITY = 4;
+    static constexpr size_t MAX_STORE_BYTES = size_t(4) << 30;
+
+    std::shared_ptr<RenderSession> find(const std::string& key) {
+        std::lock_guard lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->first != key) continue;
+            entries_.splice(entries_.begin(), entries_, it);
+            return entries_.front().second;
+        }
+        return nullptr;
+    }
+
+    void put(const std::string& key, std::shared_ptr<RenderSession> session) {
+        std::lock_guard lock(mutex_);
+        entries_.remove_if([&](const auto& e) { return e.first == key; });
+        entries_.emplace_front(key, std::move(session));
+        if (entries_.size() > CAPACITY) entries_.pop_back();
+    }
+
+    // Drop a session that can't be carried on from
+    void remove(const std::shared_ptr<RenderSession>& session) {
+        std::lock_guard lock(mutex_);
+        entries_.remove_if([&](const auto& e) { return e.second == session; });
+    }
+
+    // Drop least recently used sessions past the disk budget; the most
+    // recent one always stays
+    void trim() {
+        std::lock_guard lock(mutex_);
+        size_t total = 0;
+        for (auto& e : entries_) total += e.second->store_bytes();
+        while (entries_.size() > 1 && total > MAX_STORE_BYTES) {
+            total -= entries_.back().second->store_bytes();
+            entries_.pop_back();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::list<std::pair<std::string, std::shared_ptr<RenderSession>>> entries_;   // most recent first
+};
+
+inline RenderSessionCache& render_sessions() {
+    static RenderSessionCache cache;
+    return cache;
+}
+
+// render_beat through the session cache, for callers that expect to render
+// the beat again: each session holds full-length float stores on disk.
+// Renders past LONG_RENDER_SECONDS don't keep stores and go straight to
+// render_beat's mapped output; the output mode of shorter ones only changes
+// how the WAV is written, so sessions are shared between modes.
+inline std::string render_beat_resumable(std::shared_ptr<const SampleBank> bank,
+                                         const fs::path& output_dir, const RenderRequest& req,
+                                         const std::string& id = {}) {
+    if (!bank->loaded) {
+        throw std::runtime_error("Sample bank not loaded");
+    }
+    if (!(req.duration > 0.0) || req.duration > MAX_RENDER_SECONDS)
+        throw std::invalid_argument("Duration must be between 0 and 12 hours");
+    if (req.duration > LONG_RENDER_SECONDS) return render_beat(*bank, output_dir, req, id);
+
+    const auto started = std::chrono::steady_clock::now();
+    const long faults_before = thread_page_faults();
+    const uint64_t allocations_before = BufferPool::thread_allocations();
+
+    const std::string key = std::string(genre_to_str(req.genre)) + "/" + mood_to_str(req.mood) + "/" +
+                            key_to_str(req.key) + "/" + std::to_string(req.bpm) + "/" +
+                            quality_to_str(req.quality) + "/" + groove::feel_to_json(req.feel).dump();
+    std::unique_lock<std::mutex> lock;
+    auto session = render_sessions().find(key);
+    if (session) {
+        lock = std::unique_lock(session->mutex());
+        if (!session->can_render(*bank, req.duration)) {
+            lock.unlock();
+            session.reset();
+        }
+    }
+    if (!session) {
+        session = std::make_shared<RenderSession>(bank, render_cache_dir(output_dir), req);
+        lock = std::unique_lock(session->mutex());
+        render_sessions().put(key, session);
+    }
+
+    std::string beat_id = id.empty() ? "offline_" + random_hex_id(12) : id;
+    const double reused = session->reusable_seconds(req.duration);
+    RenderStages stages;
+    size_t buffer_bytes = 0;
+    try {
+        buffer_bytes = session->render(output_dir / (beat_id + ".wav"), req, stages);
+    } catch (...) {
+        // Stopped partway: the session's stores no longer match its engines
+        lock.unlock();
+        render_sessions().remove(session);
+        std::error_code ec;
+        fs::remove(output_dir / (beat_id + ".wav"), ec);
+        throw;
+    }
+    lock.unlock();
+    render_sessions().trim();
+
+    const int sample_rate = quality_profile(req.quality).sample_rate;
+    RenderStats stats;
+    stats.id = beat_id;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    stats.audio_seconds = (int64_t)(sample_rate * req.duration) / (double)sample_rate;
+    stats.page_faults = thread_page_faults() - faults_before;
+    stats.allocations = BufferPool::thread_allocations() - allocations_before;
+    stats.buffer_bytes = buffer_bytes;
+    stats.reused_seconds = reused;
+    stats.stages = stages.list();
+    render_metrics().record(std::move(stats));
+    return beat_id;
+}
+
+} // namespace renderer
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "../deps/json.hpp"
+#include "audio_decode.h"
+#include "sample_codec.h"
+#include "sample_ingest.h"
+#include "sample_library.h"
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+namespace renderer {
+
+// ============================================================
+//  Sample zones: one playable region of the bank arena
+// ============================================================
+
+struct SampleZone {
+    uint32_t offset      = 0;   // first float (compressed: byte) of the zone in the arena
+    uint32_t num_frames  = 0;
+    int      sample_rate = 44100;
+    uint8_t  vel_lo      = 0;
+    uint8_t  vel_hi      = 127;
+};
+
+// Slice of the zone table belonging to one MIDI note. Zones are ordered by
+// velocity range; alternates sharing a range keep their round-robin order.
+struct NoteZones {
+    uint16_t first = 0;
+    uint16_t count = 0;
+};
+
+// Per-render round-robin cursors, one per MIDI note
+using RoundRobinState = std::array<uint16_t, 128>;
+
+// How the bank holds sample frames: float PCM, or codec blocks the mix
+// decodes just ahead of each voice (about a quarter of the memory)
+enum class SampleStorage { FLOAT, COMPRESSED };
+
+// ============================================================
+//  Sample Bank: all layers of all notes in one contiguous arena
+// ============================================================
+
+class SampleBank {
+public:
+    bool loaded = false;
+
+    bool load(const fs::path& output_dir, SampleStorage storage = SampleStorage::FLOAT) {
+        auto manifest = samples::load_manifest(output_dir);
+        auto dir = samples::library_dir(output_dir);
+
+        // Ingested layers with a decoder that writes into memory are
+        // decoded straight into their arena slot once the arena is sized;
+        // the rest are decoded (and, compressed, encoded) up front
+        struct Layer {
+            uint8_t              midi_note;
+            samples::SampleLayer layer;
+            fs::path             file;
+            const AudioDecoder*  direct = nullptr;
+            PcmSample            pcm;
+            std::vector<uint8_t> packed;   // compressed storage: pcm.data is released
+        };
+        std::vector<Layer> layers;
+        size_t total_floats = 0, total_bytes = 0;
+
+        for (auto& s : samples::get_all_percussion_samples()) {
+            if (!manifest.contains(s.name)) continue;
+            for (auto& layer : samples::manifest_layers(manifest[s.name])) {
+                auto file = dir / layer.file;
+                if (!fs::exists(file)) continue;
+                Layer l{s.midi_note, layer, file, nullptr, {}, {}};
+                if (storage == SampleStorage::FLOAT) l.direct = direct_decoder(file, layer);
+                if (l.direct) {
+                    total_floats += (size_t)(layer.trim_end - layer.trim_start) * 2;
+                    layers.push_back(std::move(l));
+                    continue;
+                }
+                try {
+                    // Libraries from before ingest existed are analyzed here,
+                    // in memory, so they get the shorter voices too
+                    l.pcm = load_layer(file, l.layer);
+                    // Encoded as decoded, so the float PCM of the whole
+                    // library is never resident at once
+                    if (storage == SampleStorage::COMPRESSED) {
+                        l.packed = codec::encode(l.pcm.data.data(), l.pcm.num_frames);
+                        total_bytes += l.packed.size();
+                        std::vector<float>().swap(l.pcm.data);
+                    }
+                    total_floats += l.pcm.data.size();
+                    layers.push_back(std::move(l));
+                } catch (...) {
+                    // Skip samples that fail to decode
+                }
+            }
+        }
+
+        // Group by note, then by velocity range; stable so round-robin
+        // alternates stay in manifest order
+        std::stable_sort(layers.begin(), layers.end(),
+                         [](const Layer& a, const Layer& b) {
+            if (a.midi_note != b.midi_note) return a.midi_note < b.midi_note;
+            return a.layer.vel_lo < b.layer.vel_lo;
+        });
+
+        storage_ = storage;
+        arena_.clear();
+        arena_.shrink_to_fit();
+        arena_.reserve(total_floats);
+        packed_.clear();
+        packed_.shrink_to_fit();
+        packed_.reserve(total_bytes);
+        zones_.clear();
+        index_.fill({});
+
+        for (auto& l : layers) {
+            SampleZone z;
+            z.offset = (uint32_t)(storage == SampleStorage::COMPRESSED ? packed_.size() : arena_.size());
+            z.vel_lo = l.layer.vel_lo;
+            z.vel_hi = l.layer.vel_hi;
+            if (l.direct) {
+                DecodedRange got;
+                arena_.resize(z.offset + (size_t)(l.layer.trim_end - l.layer.trim_start) * 2);
+                try {
+                    got = load_layer_into(*l.direct, l.file, l.layer, arena_.data() + z.offset);
+                } catch (...) {
+                    got.frames = 0;
+                }
+                arena_.resize(z.offset + (size_t)got.frames * 2);
+                z.num_frames  = (uint32_t)got.frames;
+                z.sample_rate = got.sample_rate;
+                if (got.frames == 0) {
+                    // File shorter than its manifest range: decode it whole
+                    try {
+                        l.pcm = load_layer(l.file, l.layer);
+                    } catch (...) {
+                        continue;   // skip samples that fail to decode
+                    }
+                    l.direct = nullptr;
+                }
+            }
+            if (!l.direct) {
+                z.num_frames  = (uint32_t)l.pcm.num_frames;
+                z.sample_rate = l.pcm.sample_rate;
+                arena_.insert(arena_.end(), l.pcm.data.begin(), l.pcm.data.end());
+                packed_.insert(packed_.end(), l.packed.begin(), l.packed.end());
+            }
+
+            auto& slot = index_[l.midi_note & 0x7F];
+            if (slot.count == 0) slot.first = (uint16_t)zones_.size();
+            slot.count++;
+            zones_.push_back(z);
+        }
+
+        loaded = !zones_.empty();
+        return loaded;
+    }
+
+    // Pick the zone for a hit. Among the zones whose velocity range covers
+    // `velocity`, alternates are cycled with the caller's round-robin cursor.
+    // Falls back to the nearest range when no zone covers the velocity.
+    const SampleZone* select(uint8_t midi_note, uint8_t velocity,
+                             RoundRobinState& rr) const {
+        const auto& slot = index_[midi_note & 0x7F];
+        if (slot.count == 0) return nullptr;
+
+        int lo = -1, matches = 0;
+        for (int i = slot.first; i < slot.first + slot.count; ++i) {
+            if (velocity < zones_[i].vel_lo || velocity > zones_[i].vel_hi) continue;
+            if (lo < 0) lo = i;
+            matches++;
+        }
+        if (matches == 0) {
+            // Velocity gap in the layer map: use the closest zone
+            int best = slot.first, best_dist = 256;
+            for (int i = slot.first; i < slot.first + slot.count; ++i) {
+                int dist = velocity < zones_[i].vel_lo ? zones_[i].vel_lo - velocity
+                                                       : velocity - zones_[i].vel_hi;
+                if (dist < best_dist) { best = i; best_dist = dist; }
+            }
+            return &zones_[best];
+        }
+
+        uint16_t& cursor = rr[midi_note & 0x7F];
+        const SampleZone* z = &zones_[lo + cursor % matches];
+        cursor++;
+        return z;
+    }
+
+    bool compressed() const { return storage_ == SampleStorage::COMPRESSED; }
+
+    // Interleaved stereo frames of a zone (float storage)
+    const float* frames(const SampleZone& z) const { return arena_.data() + z.offset; }
+
+    // Decode `count` codec blocks of a zone from block `first` into
+    // interleaved stereo, count * codec::BLOCK_FRAMES frames (compressed storage)
+    void decode(const SampleZone& z, int64_t first, int64_t count, float* lr) const {
+        codec::decode(packed_.data() + z.offset, first, count, lr);
+    }
+
+    // Bytes of sample frames held
+    size_t memory_bytes() const { return arena_.size() * sizeof(float) + packed_.size(); }
+
+    const std::vector<SampleZone>& zones() const { return zones_; }
+
+    // Number of notes with at least one zone
+    size_t size() const {
+        size_t n = 0;
+        for (auto& slot : index_) if (slot.count) n++;
+        return n;
+    }
+
+private:
+    SampleStorage            storage_ = SampleStorage::FLOAT;
+    std::vector<float>       arena_;   // interleaved stereo, all zones back to back
+    std::vector<uint8_t>     packed_;  // compressed storage: codec blocks, all zones back to back
+    std::vector<SampleZone>  zones_;
+    std::array<NoteZones, 128> index_{};
+};
+
+} // namespace renderer
@@ -0,0 +1,267 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Block-compressed in-memory sample storage, lossless at 16 bits. Frames
+// are coded in blocks of BLOCK_FRAMES as left and side (right - left),
+// each channel predicted by a fixed polynomial of order 0-3 chosen per
+// block and its residuals Rice coded. Percussion is mostly decaying tail
+// and near-mono, so a zone comes to roughly a quarter of its float size.
+// A zone starts with a table of block offsets, so any block decodes on
+// its own. Zones peaking above full scale are scaled down into 16 bits
+// and back up on decode.
+namespace codec {
+
+constexpr int     BLOCK_FRAMES = 256;
+constexpr uint8_t ALL_ZERO = 31;   // Rice parameter marking an all-zero residual run
+// Slack after a zone's last block. The reader loads a 64-bit word at a
+// time from up to 7 bytes past the last byte it has used, so it can touch
+// 15 bytes beyond the end of the coded bits.
+constexpr size_t  READ_PAD = 16;
+
+inline int64_t block_count(int64_t frames) { return (frames + BLOCK_FRAMES - 1) / BLOCK_FRAMES; }
+
+namespace detail {
+
+inline int32_t predict(int order, const int32_t* y, int k) {
+    switch (std::min(order, k)) {
+        case 0:  return 0;
+        case 1:  return y[k - 1];
+        case 2:  return 2 * y[k - 1] - y[k - 2];
+        default: return 3 * y[k - 1] - 3 * y[k - 2] + y[k - 3];
+    }
+}
+
+inline uint32_t zigzag(int32_t r) { return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31); }
+inline int32_t unzigzag(uint32_t u) { return (int32_t)(u >> 1) ^ -(int32_t)(u & 1); }
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+    void put(uint64_t bits, int n) {   // n <= 32
+        acc_ |= bits << fill_;
+        fill_ += n;
+        while (fill_ >= 8) {
+            out_.push_back((uint8_t)acc_);
+            acc_ >>= 8;
+            fill_ -= 8;
+        }
+    }
+
+    void unary(uint32_t q) {   // q ones, then a zero
+        for (; q >= 32; q -= 32) put(0xFFFFFFFFu, 32);
+        put((1ull << q) - 1, (int)q + 1);
+    }
+
+    void flush() {
+        if (fill_ > 0) out_.push_back((uint8_t)acc_);
+        acc_ = 0;
+        fill_ = 0;
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+    uint64_t acc_ = 0;
+    int      fill_ = 0;
+};
+
+class BitReader {
+public:
+    explicit BitReader(const uint8_t* in) : in_(in) {}
+
+    uint32_t get(int n) {   // n <= 32
+        refill();
+        uint32_t v = (uint32_t)(acc_ & ((1ull << n) - 1));
+        acc_ >>= n;
+        fill_ -= n;
+        return v;
+    }
+
+    uint32_t unary() {
+        uint32_t q = 0;
+        for (;;) {
+            refill();
+            int ones = std::countr_one(acc_);
+            if (ones < fill_) {
+                acc_ >>= ones + 1;
+                fill_ -= ones + 1;
+                return q + ones;
+            }
+            q += fill_;
+            acc_ >>= fill_;
+            fill_ = 0;
+        }
+    }
+
+    // Rice-coded value with parameter k (0 < k <= 24): unary quotient,
+    // then k low bits, from one refill when the quotient is short
+    uint32_t rice(int k) {
+        refill();
+        int ones = std::countr_one(acc_);
+        if (ones + 1 + k > fill_) {
+            const uint32_t q = unary();
+            return q << k | get(k);
+        }
+        acc_ >>= ones + 1;
+        const uint32_t low = (uint32_t)(acc_ & ((1ull << k) - 1));
+        acc_ >>= k;
+        fill_ -= ones + 1 + k;
+        return (uint32_t)ones << k | low;
+    }
+
+    // Bytes consumed, rounded up to the byte the last bit came from
+    const uint8_t* end() const { return in_ - fill_ / 8; }
+
+private:
+    // Tops the accumulator up to 56+ bits with one 64-bit load. Bits past
+    // fill_ are the stream's next bits already, so OR-ing them again on the
+    // next refill leaves them unchanged. The load may run READ_PAD - 1
+    // bytes past the last coded byte; encode() leaves that much slack.
+    void refill() {
+        uint64_t word;
+        std::memcpy(&word, in_, sizeof(word));
+        acc_ |= word << fill_;
+        const int bytes = (63 - fill_) >> 3;
+        in_ += bytes;
+        fill_ += bytes * 8;
+    }
+
+    const uint8_t* in_;
+    uint64_t acc_ = 0;
+    int      fill_ = 0;
+};
+
+// Channel of one block: first sample, order | Rice parameter, residuals
+inline void encode_channel(const int32_t* x, int n, std::vector<uint8_t>& out) {
+    int32_t first = x[0];
+    uint8_t bytes[4];
+    std::memcpy(bytes, &first, 4);
+    out.insert(out.end(), bytes, bytes + 4);
+
+    // Order with the smallest residual sum, then the Rice parameter
+    // that codes it in the fewest bits
+    int best_order = 0;
+    uint64_t best_sum = UINT64_MAX;
+    for (int order = 0; order <= 3; ++order) {
+        uint64_t sum = 0;
+        for (int k = 1; k < n; ++k) sum += zigzag(x[k] - predict(order, x, k));
+        if (sum < best_sum) { best_sum = sum; best_order = order; }
+    }
+    if (best_sum == 0 || n == 1) {
+        out.push_back((uint8_t)(best_order << 5 | ALL_ZERO));
+        return;
+    }
+    int best_k = 0;
+    uint64_t best_bits = UINT64_MAX;
+    for (int k = 0; k < 24; ++k) {
+        uint64_t bits = 0;
+        for (int i = 1; i < n; ++i) bits += (zigzag(x[i] - predict(best_order, x, i)) >> k) + 1 + k;
+        if (bits < best_bits) { best_bits = bits; best_k = k; }
+        else break;   // cost is convex in k
+    }
+    out.push_back((uint8_t)(best_order << 5 | best_k));
+
+    BitWriter w(out);
+    for (int i = 1; i < n; ++i) {
+        uint32_t u = zigzag(x[i] - predict(best_order, x, i));
+        w.unary(u >> best_k);
+        if (best_k) w.put(u & ((1u << best_k) - 1), best_k);
+    }
+    w.flush();
+}
+
+// Residuals r(i) (i = 1..n-1) added to the order's prediction, warm-up
+// samples predicted at the orders they have history for
+template <int ORDER, class Residual>
+inline void reconstruct(int n, int32_t* y, Residual&& r) {
+    for (int i = 1; i < std::min(n, ORDER); ++i) y[i] = predict(ORDER, y, i) + r();
+    for (int i = std::max(1, ORDER); i < n; ++i) {
+        int32_t p;
+        if constexpr (ORDER == 0) p = 0;
+        else if constexpr (ORDER == 1) p = y[i - 1];
+        else if constexpr (ORDER == 2) p = 2 * y[i - 1] - y[i - 2];
+        else p = 3 * y[i - 1] - 3 * y[i - 2] + y[i - 3];
+        y[i] = p + r();
+    }
+}
+
+template <class Residual>
+inline void reconstruct(int order, int n, int32_t* y, Residual&& r) {
+    switch (order) {
+        case 0:  reconstruct<0>(n, y, r); break;
+        case 1:  reconstruct<1>(n, y, r); break;
+        case 2:  reconstruct<2>(n, y, r); break;
+        default: reconstruct<3>(n, y, r); break;
+    }
+}
+
+inline const uint8_t* decode_channel(const uint8_t* in, int n, int32_t* y) {
+    std::memcpy(&y[0], in, 4);
+    const int order = in[4] >> 5, k = in[4] & 0x1F;
+    in += 5;
+    if (k == ALL_ZERO) {
+        reconstruct(order, n, y, [] { return 0; });
+        return in;
+    }
+    BitReader r(in);
+    if (k == 0) reconstruct(order, n, y, [&] { return unzigzag(r.unary()); });
+    else        reconstruct(order, n, y, [&] { return unzigzag(r.rice(k)); });
+    return r.end();
+}
+
+} // namespace detail
+
+// Encode interleaved stereo float frames; the last block is padded with
+// silence. Layout: the float step of one 16-bit unit, block_count(frames)
+// uint32 block offsets from the start of the zone, then the blocks.
+inline std::vector<uint8_t> encode(const float* lr, int64_t frames) {
+    float peak = 1.0f;
+    for (int64_t i = 0; i < frames * 2; ++i) peak = std::max(peak, std::abs(lr[i]));
+    const float step = peak / 32767.0f;
+
+    const int64_t blocks = block_count(frames);
+    std::vector<uint8_t> out(sizeof(float) + (size_t)blocks * sizeof(uint32_t));
+    std::memcpy(out.data(), &step, sizeof(float));
+    int32_t left[BLOCK_FRAMES], side[BLOCK_FRAMES];
+    auto q = [&](float v) { return std::clamp((int32_t)std::lrint(v / step), -32767, 32767); };
+    for (int64_t b = 0; b < blocks; ++b) {
+        for (int k = 0; k < BLOCK_FRAMES; ++k) {
+            const int64_t f = b * BLOCK_FRAMES + k;
+            left[k] = f < frames ? q(lr[f * 2]) : 0;
+            side[k] = f < frames ? q(lr[f * 2 + 1]) - left[k] : 0;
+        }
+        const uint32_t offset = (uint32_t)out.size();
+        std::memcpy(out.data() + sizeof(float) + b * sizeof(uint32_t), &offset, sizeof(uint32_t));
+        detail::encode_channel(left, BLOCK_FRAMES, out);
+        detail::encode_channel(side, BLOCK_FRAMES, out);
+    }
+    // The reader fetches whole 64-bit words ahead of the bit it's on
+    out.resize(out.size() + READ_PAD);
+    return out;
+}
+
+// Decode `count` blocks starting at block `first` of an encoded zone into
+// interleaved stereo (count * BLOCK_FRAMES frames)
+inline void decode(const uint8_t* zone, int64_t first, int64_t count, float* lr) {
+    float scale;
+    std::memcpy(&scale, zone, sizeof(float));
+    int32_t left[BLOCK_FRAMES], side[BLOCK_FRAMES];
+    for (int64_t b = 0; b < count; ++b) {
+        uint32_t offset;
+        std::memcpy(&offset, zone + sizeof(float) + (first + b) * sizeof(uint32_t), sizeof(uint32_t));
+        const uint8_t* in = detail::decode_channel(zone + offset, BLOCK_FRAMES, left);
+        detail::decode_channel(in, BLOCK_FRAMES, side);
+        float* dst = lr + b * BLOCK_FRAMES * 2;
+        for (int k = 0; k < BLOCK_FRAMES; ++k) {
+            dst[k * 2]     = left[k] * scale;
+            dst[k * 2 + 1] = (left[k] + side[k]) * scale;
+        }
+    }
+}
+
+} // namespace codec
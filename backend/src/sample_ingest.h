@@ -0,0 +1,147 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "audio_decode.h"
+#include "sample_library.h"
+
+namespace fs = std::filesystem;
+
+// Ingest preprocessing for library one-shots: trims leading/trailing
+// silence, aligns the transient to frame 0 and computes a level-matching
+// gain. Runs once when a sample is added; the results are stored in the
+// manifest layer and applied when the bank packs its arena.
+namespace renderer {
+
+struct IngestOptions {
+    float onset_db       = -20.0f;  // transient: first frame within this of the peak
+    float silence_db     = -60.0f;  // tail: last frame within this of the peak
+    float target_peak_db = -1.0f;   // normalized peak level
+    int   preroll_frames = 16;      // kept ahead of the transient, faded in
+    int   fade_frames    = 256;     // fade-out over the trimmed tail
+    float max_gain       = 8.0f;    // don't lift near-silent files into noise
+};
+
+inline float frame_level(const PcmSample& pcm, int i) {
+    return std::max(std::abs(pcm.data[i * 2]), std::abs(pcm.data[i * 2 + 1]));
+}
+
+// Fill the ingest fields of `layer` from a decoded sample
+inline void analyze_sample(const PcmSample& pcm, samples::SampleLayer& layer,
+                           const IngestOptions& opt = {}) {
+    layer.ingested   = true;
+    layer.trim_start = 0;
+    layer.trim_end   = (uint32_t)pcm.num_frames;
+    layer.gain       = 1.0f;
+
+    float peak = 0.0f;
+    for (int i = 0; i < pcm.num_frames; ++i) peak = std::max(peak, frame_level(pcm, i));
+    if (peak <= 0.0f) return;
+
+    float onset_level   = peak * std::pow(10.0f, opt.onset_db / 20.0f);
+    float silence_level = peak * std::pow(10.0f, opt.silence_db / 20.0f);
+
+    int onset = 0;
+    while (onset < pcm.num_frames && frame_level(pcm, onset) < onset_level) onset++;
+
+    int last = pcm.num_frames - 1;
+    while (last > onset && frame_level(pcm, last) < silence_level) last--;
+
+    layer.trim_start = (uint32_t)std::max(0, onset - opt.preroll_frames);
+    layer.trim_end   = (uint32_t)std::min(pcm.num_frames, last + 1);
+    layer.gain = std::min(opt.max_gain,
+                          std::pow(10.0f, opt.target_peak_db / 20.0f) / peak);
+}
+
+// Gain and edge fades over a sample already cut to its ingested range.
+// The pre-transient frames (when the start was trimmed) get a linear
+// fade-in, the tail a linear fade-out, so trimmed edges never click.
+inline void shape_ingested(float* lr, int frames, const samples::SampleLayer& layer, bool trimmed_start,
+                           const IngestOptions& opt = {}) {
+    int fade_in  = std::min(opt.preroll_frames, frames / 4);
+    int fade_out = std::min(opt.fade_frames, frames / 4);
+    for (int i = 0; i < frames; ++i) {
+        float g = layer.gain;
+        if (trimmed_start && i < fade_in) g *= (float)i / fade_in;
+        if (i >= frames - fade_out)       g *= (float)(frames - i) / fade_out;
+        lr[i * 2]     *= g;
+        lr[i * 2 + 1] *= g;
+    }
+}
+
+inline void shape_ingested(PcmSample& pcm, const samples::SampleLayer& layer, bool trimmed_start,
+                           const IngestOptions& opt = {}) {
+    shape_ingested(pcm.data.data(), pcm.num_frames, layer, trimmed_start, opt);
+}
+
+// Cut a decoded sample down to its ingested range and apply the gain
+inline void apply_ingest(PcmSample& pcm, const samples::SampleLayer& layer,
+                         const IngestOptions& opt = {}) {
+    if (!layer.ingested) return;
+    int start = (int)std::min<uint32_t>(layer.trim_start, (uint32_t)pcm.num_frames);
+    int end   = (int)std::min<uint32_t>(layer.trim_end, (uint32_t)pcm.num_frames);
+    if (end <= start) return;
+
+    int frames = end - start;
+    if (start > 0) {
+        std::copy(pcm.data.begin() + start * 2, pcm.data.begin() + end * 2, pcm.data.begin());
+    }
+    pcm.data.resize(frames * 2);
+    pcm.data.shrink_to_fit();
+    pcm.num_frames = frames;
+    shape_ingested(pcm, layer, start > 0, opt);
+}
+
+// Decode a library layer ready to play: its ingested range only, gain and
+// fades applied. Layers in random-access formats read just that range out
+// of the file; a layer never analyzed is analyzed here, in memory.
+inline PcmSample load_layer(const fs::path& file, samples::SampleLayer& layer,
+                            const IngestOptions& opt = {}) {
+    if (layer.ingested && layer.trim_end > layer.trim_start) {
+        auto decoder = find_decoder(layer.format.empty() ? audio_format_for(file.string()) : layer.format);
+        if (decoder && decoder->random_access) {
+            auto pcm = decoder->decode(file.string(), {layer.trim_start, layer.trim_end - layer.trim_start});
+            if (pcm.num_frames > 0) {
+                shape_ingested(pcm, layer, layer.trim_start > 0, opt);
+                return pcm;
+            }
+        }
+    }
+    auto pcm = decode_audio_file(file.string(), layer.format);
+    if (!layer.ingested) analyze_sample(pcm, layer, opt);
+    apply_ingest(pcm, layer, opt);
+    return pcm;
+}
+
+// Decoder that can write an ingested layer's range straight into the
+// caller's memory; null for layers never analyzed and for decoders
+// without decode_into, which go through load_layer
+inline const AudioDecoder* direct_decoder(const fs::path& file, const samples::SampleLayer& layer) {
+    if (!layer.ingested || layer.trim_end <= layer.trim_start) return nullptr;
+    const std::string f = layer.format.empty() ? audio_format_for(file.string()) : layer.format;
+    const AudioDecoder* decoder = find_decoder(f.empty() ? "mp3" : f);
+    return decoder && decoder->decode_into ? decoder : nullptr;
+}
+
+// load_layer into `lr`, which has room for the layer's ingested range
+// (trim_end - trim_start frames); 0 frames when the file ends before it
+inline DecodedRange load_layer_into(const AudioDecoder& decoder, const fs::path& file,
+                                    const samples::SampleLayer& layer, float* lr,
+                                    const IngestOptions& opt = {}) {
+    auto got = decoder.decode_into(file.string(), {layer.trim_start, layer.trim_end - layer.trim_start}, lr);
+    shape_ingested(lr, (int)got.frames, layer, layer.trim_start > 0, opt);
+    return got;
+}
+
+// Decode a freshly added library file and record its ingest results
+inline samples::SampleLayer ingest_layer(const fs::path& file, samples::SampleLayer layer,
+                                         const IngestOptions& opt = {}) {
+    auto pcm = decode_audio_file(file.string(), layer.format);
+    analyze_sample(pcm, layer, opt);
+    return layer;
+}
+
+} // namespace renderer
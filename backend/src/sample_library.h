@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <cstdint>
 #include <filesystem>
 #include <string>
@@ -77,12 +78,127 @@ inline void save_manifest(const fs::path& output_dir, const json& manifest) {
     write_file(manifest_path(output_dir).string(), manifest.dump(2));
 }
 
+// ============================================================
+//  Velocity layers and round-robin alternates
+// ============================================================
+
+// One playable file of a library entry. A note may have several layers:
+// disjoint velocity zones, and within a zone any number of round-robin
+// alternates (listed in playback order).
+struct SampleLayer {
+    std::string file;
+    uint8_t     vel_lo = 0;
+    uint8_t     vel_hi = 127;
+
+    // Ingest results (see sample_ingest.h): playable frame range after
+    // silence trimming / transient alignment, and the level-matching gain
+    bool        ingested   = false;
+    uint32_t    trim_start = 0;
+    uint32_t    trim_end   = 0;
+    float       gain       = 1.0f;
+
+    // Made by the built-in percussion synth rather than generated remotely
+    bool        synthesized = false;
+
+    // Decoder format ("mp3", "wav", "aiff", "flac"); empty in manifests from
+    // before formats were recorded, where the file extension decides
+    std::string format = {};
+};
+
+inline SampleLayer layer_from_json(const json& l) {
+    SampleLayer layer{l["file"].get<std::string>()};
+    layer.vel_lo = (uint8_t)std::clamp(l.value("vel_lo", 0), 0, 127);
+    layer.vel_hi = (uint8_t)std::clamp(l.value("vel_hi", 127), 0, 127);
+    if (l.contains("trim_end")) {
+        layer.ingested   = true;
+        layer.trim_start = l.value("trim_start", 0u);
+        layer.trim_end   = l.value("trim_end", 0u);
+        layer.gain       = l.value("gain", 1.0f);
+    }
+    layer.synthesized = l.value("synthesized", false);
+    layer.format = l.value("format", std::string());
+    return layer;
+}
+
+// Manifest entries are either a single file name (one full-range layer,
+// not yet ingested) or an array of layers:
+//   "shakers": [{"file": "shakers_v0_rr0.mp3", "format": "mp3", "vel_lo": 0, "vel_hi": 63,
+//                "trim_start": 112, "trim_end": 9840, "gain": 1.8}, ...]
+inline std::vector<SampleLayer> manifest_layers(const json& entry) {
+    std::vector<SampleLayer> layers;
+    if (entry.is_string()) {
+        layers.push_back({entry.get<std::string>()});
+    } else if (entry.is_object() && entry.contains("file")) {
+        layers.push_back(layer_from_json(entry));
+    } else if (entry.is_array()) {
+        for (auto& l : entry) {
+            if (!l.is_object() || !l.contains("file")) continue;
+            layers.push_back(layer_from_json(l));
+        }
+    }
+    return layers;
+}
+
+inline json layer_to_json(const SampleLayer& layer) {
+    json j = {{"file", layer.file}, {"vel_lo", layer.vel_lo}, {"vel_hi", layer.vel_hi}};
+    if (layer.ingested) {
+        j["trim_start"] = layer.trim_start;
+        j["trim_end"]   = layer.trim_end;
+        j["gain"]       = layer.gain;
+    }
+    if (layer.synthesized) j["synthesized"] = true;
+    if (!layer.format.empty()) j["format"] = layer.format;
+    return j;
+}
+
+// Velocity zone i of n, splitting 0..127 evenly
+inline SampleLayer velocity_zone(const std::string& file, int zone, int zones) {
+    SampleLayer layer{file};
+    layer.vel_lo = (uint8_t)(zone * 128 / zones);
+    layer.vel_hi = (uint8_t)((zone + 1) * 128 / zones - 1);
+    return layer;
+}
+
+// File name for a generated layer; the single-layer case keeps the legacy name
+inline std::string layer_file_name(const std::string& name, int zone, int rr,
+                                   int zones, int round_robin, const std::string& ext = ".mp3") {
+    if (zones == 1 && round_robin == 1) return name + ext;
+    return name + "_v" + std::to_string(zone) + "_rr" + std::to_string(rr) + ext;
+}
+
+// File name for a synthesized layer, kept apart from generated ones
+inline std::string synth_layer_file_name(const std::string& name, int zone, int rr,
+                                         int zones, int round_robin) {
+    return layer_file_name(name + "_synth", zone, rr, zones, round_robin, ".wav");
+}
+
+// Prompt for a velocity zone: soft and hard playing at the extremes
+inline std::string velocity_zone_prompt(const std::string& prompt, int zone, int zones) {
+    if (zones == 1) return prompt;
+    if (zone == 0) return "Softly played, gentle. " + prompt;
+    if (zone == zones - 1) return "Hard accented, loud. " + prompt;
+    return prompt;
+}
+
+// An entry is available if at least one of its layers is on disk
+inline bool entry_available(const fs::path& dir, const json& entry) {
+    for (auto& layer : manifest_layers(entry))
+        if (fs::exists(dir / layer.file)) return true;
+    return false;
+}
+
+// An entry made entirely by the percussion synth (a candidate for upgrading)
+inline bool entry_synthesized(const json& entry) {
+    auto layers = manifest_layers(entry);
+    return !layers.empty() && std::all_of(layers.begin(), layers.end(),
+                                          [](const SampleLayer& l) { return l.synthesized; });
+}
+
 // Check if a specific sample exists in the library
 inline bool sample_exists(const fs::path& output_dir, const std::string& name) {
     auto manifest = load_manifest(output_dir);
     if (!manifest.contains(name)) return false;
-    auto file = library_dir(output_dir) / manifest[name].get<std::string>();
-    return fs::exists(file);
+    return entry_available(library_dir(output_dir), manifest[name]);
 }
 
 // Check if entire library is complete
@@ -91,7 +207,7 @@ inline bool is_library_complete(const fs::path& output_dir) {
     auto dir = library_dir(output_dir);
     for (auto& s : get_all_percussion_samples()) {
         if (!manifest.contains(s.name)) return false;
-        if (!fs::exists(dir / manifest[s.name].get<std::string>())) return false;
+        if (!entry_available(dir, manifest[s.name])) return false;
     }
     return true;
 }
@@ -102,8 +218,7 @@ inline std::vector<std::string> get_missing_samples(const fs::path& output_dir)
     auto dir = library_dir(output_dir);
     std::vector<std::string> missing;
     for (auto& s : get_all_percussion_samples()) {
-        if (!manifest.contains(s.name) ||
-            !fs::exists(dir / manifest[s.name].get<std::string>())) {
+        if (!manifest.contains(s.name) || !entry_available(dir, manifest[s.name])) {
             missing.push_back(s.name);
         }
     }
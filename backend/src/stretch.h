@@ -0,0 +1,241 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include "cancellation.h"
+#include "fft.h"
+
+// Time-stretch and pitch-shift for decoded audio.
+//
+// Stretching is a phase vocoder with identity phase locking (bins around a
+// spectral peak keep their phase offset to the peak, which avoids most of
+// the "phasiness" of a plain vocoder). Stereo stays coherent: the phase
+// advance is measured on the mid channel and the same rotation is applied
+// to left and right. Pitch shifting stretches by the pitch factor and then
+// resamples with a windowed-sinc kernel. Windows and FFT plans are built
+// once and shared.
+namespace stretch {
+
+using dsp::cpx;
+
+constexpr int FFT_SIZE = 2048;
+constexpr int SYNTH_HOP = FFT_SIZE / 4;
+
+inline double semitones_to_ratio(double semitones) { return std::exp2(semitones / 12.0); }
+
+// ============================================================
+//  Windows
+// ============================================================
+
+// Periodic Hann window of size n, cached per size
+inline const std::vector<float>& hann_window(int n) {
+    static std::mutex mutex;
+    static std::map<int, std::unique_ptr<const std::vector<float>>> windows;
+    std::lock_guard lock(mutex);
+    auto& w = windows[n];
+    if (!w) {
+        auto v = std::make_unique<std::vector<float>>(n);
+        for (int i = 0; i < n; ++i) (*v)[i] = (float)(0.5 - 0.5 * std::cos(2.0 * M_PI * i / n));
+        w = std::move(v);
+    }
+    return *w;
+}
+
+// ============================================================
+//  Interpolation
+// ============================================================
+
+// 4-point Catmull-Rom read of interleaved stereo at a fractional frame;
+// frames outside [0, frames) read as silence
+inline void hermite_frame(const float* lr, int frames, double pos, float& l, float& r) {
+    int i = (int)std::floor(pos);
+    float t = (float)(pos - i);
+    float xl[4], xr[4];
+    for (int k = 0; k < 4; ++k) {
+        int f = i - 1 + k;
+        bool in = f >= 0 && f < frames;
+        xl[k] = in ? lr[f * 2]     : 0.0f;
+        xr[k] = in ? lr[f * 2 + 1] : 0.0f;
+    }
+    auto cr = [t](const float* x) {
+        float a = -0.5f * x[0] + 1.5f * x[1] - 1.5f * x[2] + 0.5f * x[3];
+        float b = x[0] - 2.5f * x[1] + 2.0f * x[2] - 0.5f * x[3];
+        float c = -0.5f * x[0] + 0.5f * x[2];
+        return ((a * t + b) * t + c) * t + x[1];
+    };
+    l = cr(xl);
+    r = cr(xr);
+}
+
+// Polyphase windowed-sinc resampler; `ratio` = input frames per output
+// frame. The cutoff follows the ratio, so pitching up doesn't alias.
+class Resampler {
+public:
+    static constexpr int TAPS = 32;
+    static constexpr int PHASES = 256;
+
+    explicit Resampler(double ratio) : ratio_(ratio), kernel_((PHASES + 1) * TAPS) {
+        if (!(ratio > 0.0)) throw std::invalid_argument("Resample ratio must be positive");
+        const double cutoff = 0.97 * std::min(1.0, 1.0 / ratio);
+        for (int p = 0; p <= PHASES; ++p) {
+            double frac = (double)p / PHASES;
+            double sum = 0.0;
+            for (int t = 0; t < TAPS; ++t) {
+                double x = t - (TAPS / 2 - 1) - frac;   // distance from the read point
+                double s = x == 0.0 ? 1.0 : std::sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+                double w = 0.42 + 0.5 * std::cos(M_PI * x / (TAPS / 2)) + 0.08 * std::cos(2 * M_PI * x / (TAPS / 2));
+                kernel_[p * TAPS + t] = (float)(s * w);
+                sum += s * w;
+            }
+            for (int t = 0; t < TAPS; ++t) kernel_[p * TAPS + t] /= (float)sum;   // unity DC gain
+        }
+    }
+
+    // Interleaved stereo in, interleaved stereo out
+    std::vector<float> process(const float* lr, int frames) const {
+        int out_frames = (int)std::floor(frames / ratio_);
+        std::vector<float> out((size_t)out_frames * 2);
+        for (int o = 0; o < out_frames; ++o) {
+            double pos = o * ratio_;
+            int i = (int)pos;
+            int p = (int)std::lround((pos - i) * PHASES);
+            const float* k = kernel_.data() + p * TAPS;
+            float l = 0.0f, r = 0.0f;
+            int first = i - (TAPS / 2 - 1);
+            for (int t = 0; t < TAPS; ++t) {
+                int f = first + t;
+                if (f < 0 || f >= frames) continue;
+                l += lr[f * 2] * k[t];
+                r += lr[f * 2 + 1] * k[t];
+            }
+            out[o * 2]     = l;
+            out[o * 2 + 1] = r;
+        }
+        return out;
+    }
+
+private:
+    double ratio_;
+    std::vector<float> kernel_;
+};
+
+// ============================================================
+//  Phase vocoder
+// ============================================================
+
+inline float princarg(float phase) {
+    return phase - 2.0f * (float)M_PI * std::floor((phase + (float)M_PI) / (2.0f * (float)M_PI));
+}
+
+// Stretch interleaved stereo so the output lasts `ratio` times as long.
+// `cancel` is checked once per analysis frame.
+inline std::vector<float> time_stretch(const float* lr, int frames, double ratio,
+                                       renderer::CancelToken* cancel = nullptr) {
+    if (!(ratio > 0.0)) throw std::invalid_argument("Stretch ratio must be positive");
+    const int n = FFT_SIZE, bins = n / 2 + 1;
+    const double analysis_hop = SYNTH_HOP / ratio;
+    const int out_frames = (int)std::ceil(frames * ratio);
+    const auto plan = dsp::fft_plan(n);
+    const auto& window = hann_window(n);
+    // Hann^2 at 75% overlap sums to 1.5
+    const float ola_gain = 1.0f / 1.5f;
+
+    std::vector<float> out((size_t)(out_frames + n) * 2, 0.0f);
+    std::vector<float> frame_m(n), frame_l(n), frame_r(n), time(n);
+    std::vector<cpx> spec_m(bins), spec_l(bins), spec_r(bins), work(n);
+    std::vector<float> mag(bins), phase(bins), prev_phase(bins, 0.0f), synth_phase(bins, 0.0f);
+    std::vector<int> peaks, peak_of(bins);
+    peaks.reserve(bins / 2);
+    std::vector<cpx> rotation(bins);
+
+    int prev_pos = 0;
+    for (int m = 0; m * SYNTH_HOP < out_frames + SYNTH_HOP; ++m) {
+        renderer::checkpoint(cancel);
+        const int pos = (int)std::lround(m * analysis_hop) - n / 2;   // frame centered on the read point
+        for (int i = 0; i < n; ++i) {
+            int f = pos + i;
+            float l = 0.0f, r = 0.0f;
+            if (f >= 0 && f < frames) { l = lr[f * 2]; r = lr[f * 2 + 1]; }
+            frame_l[i] = l * window[i];
+            frame_r[i] = r * window[i];
+            frame_m[i] = (l + r) * 0.5f * window[i];
+        }
+        plan->forward(frame_m.data(), spec_m.data(), work.data());
+        plan->forward(frame_l.data(), spec_l.data(), work.data());
+        plan->forward(frame_r.data(), spec_r.data(), work.data());
+
+        for (int k = 0; k < bins; ++k) {
+            mag[k] = std::abs(spec_m[k]);
+            phase[k] = std::arg(spec_m[k]);
+        }
+
+        if (m == 0) {
+            std::copy(phase.begin(), phase.end(), synth_phase.begin());
+        } else {
+            const float hop_a = (float)(pos - prev_pos);
+            // Peaks: local maxima over +-2 bins; every bin follows the
+            // peak in its region of influence
+            peaks.clear();
+            for (int k = 2; k < bins - 2; ++k)
+                if (mag[k] > mag[k - 1] && mag[k] >= mag[k + 1] && mag[k] > mag[k - 2] && mag[k] >= mag[k + 2])
+                    peaks.push_back(k);
+            if (peaks.empty()) peaks.push_back(0);
+            for (int k = 0, p = 0; k < bins; ++k) {
+                while (p + 1 < (int)peaks.size() &&
+                       std::abs(peaks[p + 1] - k) < std::abs(peaks[p] - k)) ++p;
+                peak_of[k] = peaks[p];
+            }
+
+            for (int pk : peaks) {
+                float omega = 2.0f * (float)M_PI * pk / n;
+                float dev = princarg(phase[pk] - prev_phase[pk] - omega * hop_a);
+                float inst = omega + (hop_a > 0.0f ? dev / hop_a : 0.0f);
+                synth_phase[pk] = princarg(synth_phase[pk] + inst * SYNTH_HOP);
+            }
+            for (int k = 0; k < bins; ++k) {
+                int pk = peak_of[k];
+                if (pk != k) synth_phase[k] = princarg(synth_phase[pk] + phase[k] - phase[pk]);
+            }
+        }
+        for (int k = 0; k < bins; ++k) rotation[k] = std::polar(1.0f, synth_phase[k] - phase[k]);
+        std::copy(phase.begin(), phase.end(), prev_phase.begin());
+        prev_pos = pos;
+
+        // Same rotation on both channels keeps the stereo image
+        for (int ch = 0; ch < 2; ++ch) {
+            auto& spec = ch == 0 ? spec_l : spec_r;
+            for (int k = 0; k < bins; ++k) spec[k] *= rotation[k];
+            plan->inverse(spec.data(), time.data(), work.data());
+            const int at = m * SYNTH_HOP - n / 2;
+            for (int i = 0; i < n; ++i) {
+                int o = at + i;
+                if (o < 0 || o >= out_frames) continue;
+                out[(size_t)o * 2 + ch] += time[i] * window[i] * ola_gain;
+            }
+        }
+    }
+    out.resize((size_t)out_frames * 2);
+    return out;
+}
+
+// Tempo and pitch in one pass: `tempo` > 1 plays faster (shorter output),
+// `semitones` transposes without changing the length
+inline std::vector<float> stretch_and_shift(const float* lr, int frames, double tempo,
+                                            double semitones, renderer::CancelToken* cancel = nullptr) {
+    if (!(tempo > 0.0)) throw std::invalid_argument("Tempo ratio must be positive");
+    const double pitch = semitones_to_ratio(semitones);
+    const double stretch_ratio = pitch / tempo;
+    if (std::abs(stretch_ratio - 1.0) < 1e-6 && std::abs(pitch - 1.0) < 1e-6)
+        return std::vector<float>(lr, lr + (size_t)frames * 2);
+
+    auto stretched = time_stretch(lr, frames, stretch_ratio, cancel);
+    if (std::abs(pitch - 1.0) < 1e-6) return stretched;
+    renderer::checkpoint(cancel);
+    return Resampler(pitch).process(stretched.data(), (int)(stretched.size() / 2));
+}
+
+} // namespace stretch
@@ -0,0 +1,204 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include "effects.h"
+
+// Built-in synth voices for the offline renderer: a sine 808 with a pitch
+// drop, an amapiano log drum (hollow harmonic wavetable, gliding between
+// notes, driven into soft clipping) and an electric-piano chord voice.
+// Everything is derived from precomputed single-cycle tables, so the voices
+// cost no sample memory and render identically on every run.
+namespace synth {
+
+enum Model : uint8_t {
+    NONE     = 0,   // bank sample
+    BASS_808 = 1,
+    LOG_DRUM = 2,
+    KEYS     = 3,
+};
+
+// ============================================================
+//  Wavetables
+// ============================================================
+
+constexpr int TABLE_SIZE = 2048;
+
+struct Wavetable {
+    std::array<float, TABLE_SIZE + 1> t{};   // one cycle plus a guard point
+
+    // phase in cycles [0, 1)
+    float lookup(double phase) const {
+        double p = phase * TABLE_SIZE;
+        int i = (int)p;
+        float frac = (float)(p - i);
+        return t[i] + (t[i + 1] - t[i]) * frac;
+    }
+};
+
+// Sum of harmonics (multiple, amplitude), normalized to a peak of 1
+inline Wavetable make_wavetable(std::initializer_list<std::pair<int, float>> partials) {
+    Wavetable w;
+    for (int i = 0; i <= TABLE_SIZE; ++i) {
+        double v = 0.0;
+        for (auto [h, a] : partials) v += a * std::sin(2.0 * dsp::PI * h * i / TABLE_SIZE);
+        w.t[i] = (float)v;
+    }
+    float peak = 0.0f;
+    for (float v : w.t) peak = std::max(peak, std::abs(v));
+    for (float& v : w.t) v /= peak;
+    return w;
+}
+
+inline const Wavetable& sine_table() {
+    static const Wavetable w = make_wavetable({{1, 1.0f}});
+    return w;
+}
+
+// Strong 2nd and odd upper partials: the hollow "knock" of a log drum
+inline const Wavetable& log_drum_table() {
+    static const Wavetable w = make_wavetable({{1, 1.0f}, {2, 0.45f}, {3, 0.22f}, {5, 0.1f}});
+    return w;
+}
+
+// Bell-like upper partials over a round fundamental, Rhodes-ish
+inline const Wavetable& keys_table() {
+    static const Wavetable w = make_wavetable({{1, 1.0f}, {2, 0.35f}, {3, 0.12f}, {4, 0.08f}, {7, 0.03f}});
+    return w;
+}
+
+// ============================================================
+//  Voice models
+// ============================================================
+
+struct ModelParams {
+    const Wavetable* table;
+    float attack;          // seconds
+    float decay;           // amplitude time constant, seconds
+    float release;         // linear fade after the note ends, seconds
+    float punch;           // semitones above the note at onset
+    float punch_time;      // punch time constant, seconds
+    float glide_time;      // glide-from-previous-note time constant, seconds
+    float drive;           // soft-clip drive, 1 = clean
+    float level;           // output gain, so stacked chord tones sit under the bass
+};
+
+inline const ModelParams& model_params(Model m) {
+    static const ModelParams bass_808 = {&sine_table(),     0.002f, 0.9f,  0.06f, 7.0f,  0.030f, 0.0f,  1.4f, 1.0f};
+    static const ModelParams log_drum = {&log_drum_table(), 0.001f, 0.28f, 0.04f, 12.0f, 0.010f, 0.05f, 2.5f, 0.9f};
+    static const ModelParams keys     = {&keys_table(),     0.004f, 0.7f,  0.12f, 0.0f,  0.010f, 0.0f,  1.0f, 0.22f};
+    if (m == LOG_DRUM) return log_drum;
+    if (m == KEYS)     return keys;
+    return bass_808;
+}
+
+inline float note_hz(float pitch) { return 440.0f * std::exp2((pitch - 69.0f) / 12.0f); }
+
+// Frames a voice sounds for: the held note plus its release
+inline int voice_frames(Model m, int hold_frames, int sample_rate) {
+    return hold_frames + (int)(model_params(m).release * sample_rate);
+}
+
+// ============================================================
+//  Rendering
+// ============================================================
+
+// Oscillator phase carried across blocks; everything else is a function of
+// the time since onset
+struct VoiceState {
+    double phase = 0.0;
+};
+
+// Rational tanh approximation, normalized so drive only shapes
+inline float soft_clip(float x) {
+    x = std::clamp(x, -3.0f, 3.0f);
+    return x * (27.0f + x * x) / (27.0f + 9.0f * x * x);
+}
+
+struct VoiceNote {
+    Model model;
+    float pitch;        // MIDI note number
+    float glide_from;   // MIDI note the pitch slides from (== pitch: no glide)
+    int   hold;         // frames before release
+    float amplitude;
+};
+
+// Mono samples [t0, t0 + frames) of a voice (t measured from its onset)
+// into `out`. Pitch and amplitude envelopes are evaluated once per
+// dsp::CONTROL_FRAMES and interpolated; the drive stage runs four frames
+// at a time.
+inline void render_voice(const VoiceNote& v, int t0, int frames, int sample_rate,
+                         VoiceState& st, float* out) {
+    const ModelParams& p = model_params(v.model);
+    const float fs = (float)sample_rate;
+    const int attack  = std::max(1, (int)(p.attack * fs));
+    const int release = std::max(1, (int)(p.release * fs));
+
+    auto pitch_at = [&](int t) {
+        float sec = t / fs;
+        float pitch = v.pitch;
+        if (p.punch > 0.0f) pitch += p.punch * std::exp(-sec / p.punch_time);
+        if (p.glide_time > 0.0f) pitch += (v.glide_from - v.pitch) * std::exp(-sec / p.glide_time);
+        return pitch;
+    };
+    auto amp_at = [&](int t) {
+        float a = std::exp(-(t / fs) / p.decay);
+        if (t < attack) a *= (float)t / attack;
+        if (t > v.hold) a *= std::max(0.0f, 1.0f - (float)(t - v.hold) / release);
+        return a * v.amplitude * p.level;
+    };
+
+    for (int done = 0; done < frames; done += dsp::CONTROL_FRAMES) {
+        const int n = std::min(dsp::CONTROL_FRAMES, frames - done);
+        const int t = t0 + done;
+        const double inc = note_hz(pitch_at(t)) / fs;
+        const float a0 = amp_at(t), a1 = amp_at(t + n);
+        const float da = (a1 - a0) / n;
+        double phase = st.phase;
+        for (int i = 0; i < n; ++i) {
+            out[done + i] = p.table->lookup(phase) * (a0 + da * i);
+            phase += inc;
+            if (phase >= 1.0) phase -= 1.0;
+        }
+        st.phase = phase;
+    }
+
+    if (p.drive > 1.0f) {
+        const float gain = 1.0f / soft_clip(p.drive);
+        int i = 0;
+#if defined(CRESCENT_DSP_SSE)
+        const __m128 drive = _mm_set1_ps(p.drive), norm = _mm_set1_ps(gain);
+        const __m128 lo = _mm_set1_ps(-3.0f), hi = _mm_set1_ps(3.0f);
+        const __m128 c27 = _mm_set1_ps(27.0f), c9 = _mm_set1_ps(9.0f);
+        for (; i + 4 <= frames; i += 4) {
+            __m128 x = _mm_mul_ps(_mm_loadu_ps(out + i), drive);
+            x = _mm_min_ps(_mm_max_ps(x, lo), hi);
+            __m128 x2 = _mm_mul_ps(x, x);
+            __m128 num = _mm_mul_ps(x, _mm_add_ps(c27, x2));
+            __m128 den = _mm_add_ps(c27, _mm_mul_ps(c9, x2));
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_div_ps(num, den), norm));
+        }
+#endif
+        for (; i < frames; ++i) out[i] = soft_clip(out[i] * p.drive) * gain;
+    }
+}
+
+// Center a mono voice onto an interleaved stereo bus
+inline void add_mono(float* lr, const float* mono, int frames) {
+    int i = 0;
+#if defined(CRESCENT_DSP_SSE)
+    for (; i + 4 <= frames; i += 4) {
+        __m128 m = _mm_loadu_ps(mono + i);
+        float* d = lr + i * 2;
+        _mm_storeu_ps(d,     _mm_add_ps(_mm_loadu_ps(d),     _mm_unpacklo_ps(m, m)));
+        _mm_storeu_ps(d + 4, _mm_add_ps(_mm_loadu_ps(d + 4), _mm_unpackhi_ps(m, m)));
+    }
+#endif
+    for (; i < frames; ++i) {
+        lr[i * 2]     += mono[i];
+        lr[i * 2 + 1] += mono[i];
+    }
+}
+
+} // namespace synth
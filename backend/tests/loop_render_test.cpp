@@ -0,0 +1,63 @@
+// Loops play the bars their MIDI file holds: for a 2-bar loop, which is
+// shorter than the composition's period, every voice compiled for the
+// loop starts where a note of the loop's MIDI notes does, with its pitch.
+// Exits non-zero on a mismatch.
+//
+//   g++ -std=c++20 -O2 loop_render_test.cpp -o loop_render_test -lpthread
+//   ./loop_render_test
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "../src/loop_renderer.h"
+
+int main() {
+    using namespace renderer;
+    const int bpm = 112, sample_rate = 44100, bars = 2;
+    const double frames_per_tick = 60.0 / (bpm * midi::TPQ) * sample_rate;
+
+    // No samples: drums compile to nothing, the synth voices are checked
+    SampleBank bank;
+    mixer::MixerSettings mix;
+    int failures = 0, checked = 0;
+    for (Genre genre : {Genre::HIPHOP, Genre::TRAP, Genre::AFROBEATS, Genre::AMAPIANO, Genre::HIGHLIFE,
+                        Genre::JUJU, Genre::KWAITO}) {
+        RenderRequest req;
+        req.genre = genre;
+        req.bpm = bpm;
+        req.loop_bars = bars;
+        if (loop_unit_bars(req) != bars) {
+            std::printf("genre %d: unit of %d bars, expected %d\n", (int)genre, loop_unit_bars(req), bars);
+            ++failures;
+            continue;
+        }
+
+        const auto notes = loop_notes(req, bars);   // as main.cpp writes the .mid
+        const auto voices = compile_loop_voices(notes, bars, bank, mix, bpm, sample_rate, 0);
+        std::vector<const midi::Note*> unmatched;
+        for (auto& n : notes)
+            if (n.channel != midi::DRUM_CHANNEL && synth_model_for_channel(n.channel) != synth::NONE)
+                unmatched.push_back(&n);
+        if (voices.size() != unmatched.size()) {
+            std::printf("genre %d: %zu voices for %zu notes\n", (int)genre, voices.size(), unmatched.size());
+            ++failures;
+            continue;
+        }
+        for (auto& v : voices) {
+            auto it = std::find_if(unmatched.begin(), unmatched.end(), [&](const midi::Note* n) {
+                return n->pitch == v.pitch &&
+                       std::abs(v.frame_offset - (int64_t)(n->tick * frames_per_tick)) <= 1;
+            });
+            if (it == unmatched.end()) {
+                std::printf("genre %d: voice at frame %lld, pitch %.0f has no note\n", (int)genre,
+                            (long long)v.frame_offset, v.pitch);
+                ++failures;
+                continue;
+            }
+            unmatched.erase(it);
+            ++checked;
+        }
+    }
+    std::printf("%d voices checked, %d failures\n", checked, failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
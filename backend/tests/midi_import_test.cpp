@@ -0,0 +1,80 @@
+// A .mid this server exports re-imports onto the channels it was written
+// with: 808 on the bass channel, log drum on the log drum channel, chords
+// and drums where they were. The same file under a DAW's track name keeps
+// the import default (everything melodic on the chord voice), and explicit
+// channel options still apply. Exits non-zero on a mismatch.
+//
+//   g++ -std=c++20 -O2 midi_import_test.cpp -o midi_import_test
+//   ./midi_import_test
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "../src/melody.h"
+#include "../src/midi_reader.h"
+
+namespace fs = std::filesystem;
+
+using Key = std::tuple<uint32_t, uint8_t, uint8_t, uint8_t>;   // tick, channel, pitch, velocity
+
+static std::vector<Key> keys(const std::vector<midi::Note>& notes) {
+    std::vector<Key> k;
+    for (auto& n : notes) k.emplace_back(n.tick, n.channel, n.pitch, n.velocity);
+    std::sort(k.begin(), k.end());
+    return k;
+}
+
+static std::string round_trip(const std::vector<midi::Note>& notes, int bpm, const char* name) {
+    const fs::path path = fs::temp_directory_path() / "midi_import_test.mid";
+    midi::write_midi(path.string(), bpm, notes, name);
+    std::ifstream f(path, std::ios::binary);
+    std::string data{std::istreambuf_iterator<char>(f), {}};
+    fs::remove(path);
+    return data;
+}
+
+int main() {
+    const int bpm = 112;
+    int failures = 0;
+    for (Genre genre : {Genre::HIPHOP, Genre::AFROBEATS, Genre::AMAPIANO, Genre::HIGHLIFE}) {
+        const auto notes = melody::compose_beat(genre, Mood::CHILL, MusicalKey::C_MINOR, bpm, 30.0);
+
+        // As /api/render-offline writes it
+        auto data = round_trip(notes, bpm, "Crescent Offline Render");
+        auto imported = midi::read_midi(data);
+        if (imported.bpm != bpm || keys(imported.notes) != keys(notes)) {
+            std::printf("genre %d: export did not re-import note for note\n", (int)genre);
+            ++failures;
+        }
+
+        // Explicit options win: 808 and log drum swapped
+        midi::ImportChannels swap;
+        swap.bass = midi::LOG_DRUM_CHANNEL;
+        swap.log_drum = midi::BASS_CHANNEL;
+        auto swapped = notes;
+        for (auto& n : swapped) {
+            if (n.channel == midi::BASS_CHANNEL)          n.channel = midi::LOG_DRUM_CHANNEL;
+            else if (n.channel == midi::LOG_DRUM_CHANNEL) n.channel = midi::BASS_CHANNEL;
+        }
+        if (keys(midi::read_midi(data, swap).notes) != keys(swapped)) {
+            std::printf("genre %d: channel options ignored on an export\n", (int)genre);
+            ++failures;
+        }
+
+        // Someone else's file: melodic channels default to the chord voice
+        for (auto& n : midi::read_midi(round_trip(notes, bpm, "Bassline")).notes) {
+            if (n.channel != midi::DRUM_CHANNEL && n.channel != midi::CHORD_CHANNEL) {
+                std::printf("genre %d: foreign file mapped channel %d\n", (int)genre, n.channel);
+                ++failures;
+                break;
+            }
+        }
+    }
+    std::printf("%d failures\n", failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -25,8 +25,9 @@ export async function fetchHistory() {
   return res.json();
 }
 
-export function getAudioUrl(beatId) {
-  return `${API_BASE}/export/audio/${beatId}`;
+export function getAudioUrl(beatId, revision = null) {
+  const url = `${API_BASE}/export/audio/${beatId}`;
+  return revision ? `${url}?rev=${revision}` : url;
 }
 
 export function getMidiUrl(beatId) {
@@ -95,6 +96,13 @@ export async function renderOffline(params) {
   return res.json();
 }
 
+// Progressive render state; `wait` holds the request until the render settles
+export async function getRenderStatus(beatId, wait = 0) {
+  const res = await fetch(`${API_BASE}/render-status/${beatId}?wait=${wait}`);
+  if (!res.ok) throw new Error("Failed to fetch render status");
+  return res.json();
+}
+
 export async function getSampleLibraryStatus() {
   const res = await fetch(`${API_BASE}/samples/status`);
   if (!res.ok) throw new Error("Failed to fetch sample library status");
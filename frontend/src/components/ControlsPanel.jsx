@@ -249,10 +249,11 @@ export default function ControlsPanel({ onGenerate, isLoading, onPlanCreated, on
           {isPlanLoading ? "Creating Plan..." : "Preview Plan (Free)"}
         </button>
 
-        {sampleLibrary && sampleLibrary.available > 0 && (
+        {/* Entries not generated yet are filled in by the built-in kit */}
+        {sampleLibrary && (
           <button
             type="button"
-            disabled={isLoading || !sampleLibrary.complete}
+            disabled={isLoading}
             onClick={() => {
               if (onRenderOffline) {
                 onRenderOffline({
@@ -264,7 +265,11 @@ export default function ControlsPanel({ onGenerate, isLoading, onPlanCreated, on
             }}
             className="w-full py-2.5 rounded-md text-[11px] tracking-[0.12em] uppercase font-medium text-emerald-400 border border-emerald-500/30 hover:border-emerald-400/50 hover:bg-emerald-500/10 transition-all duration-300 disabled:opacity-30 disabled:cursor-not-allowed"
           >
-            Render Offline ({sampleLibrary.available}/{sampleLibrary.total} samples)
+            Render Offline (
+            {sampleLibrary.complete
+              ? `${sampleLibrary.available}/${sampleLibrary.total} samples`
+              : "built-in kit"}
+            )
           </button>
         )}
       </div>
@@ -113,7 +113,7 @@ export default function StudioPage() {
 
             {/* Waveform */}
             <WaveformDisplay
-              audioUrl={getAudioUrl(currentBeat.id)}
+              audioUrl={getAudioUrl(currentBeat.id, currentBeat.revision)}
               muteAudio={hasStemMixer}
               seekTime={hasStemMixer ? currentTime : undefined}
             />
@@ -7,6 +7,7 @@ import {
   getAudioUrl,
   generateFromPlan as apiGenerateFromPlan,
   renderOffline as apiRenderOffline,
+  getRenderStatus,
 } from "../api/client";
 
 let _players = [];
@@ -183,8 +184,21 @@ export const useAudioStore = create((set, get) => ({
     set({ isLoading: true, error: null, currentBeat: null, stemData: null, planData: null });
 
     try {
-      const beat = await apiRenderOffline(params);
+      // The first bars come back right away; the rest is rendered into
+      // the same file, which is reloaded once it settles
+      const beat = await apiRenderOffline({ ...params, progressive: true });
       set({ currentBeat: beat, isLoading: false });
+
+      let status = beat.render;
+      while (status && status.state === "preview") {
+        status = await getRenderStatus(beat.id, 20);
+        if (get().currentBeat?.id !== beat.id) return;
+      }
+      if (status?.state === "complete" && beat.render?.state === "preview") {
+        set({ currentBeat: { ...beat, render: status, revision: "complete" } });
+      } else if (status?.state === "failed") {
+        set({ error: status.error });
+      }
     } catch (err) {
       set({ error: err.message, isLoading: false });
     }